@@ -0,0 +1,107 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A sorted listing of random keys: a cad_btree_t kept sorted against
+ * a cad_array_t sorted after each batch of insertions; then bound
+ * lookups and range deletions.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cad_btree.h"
+
+#define COUNT 1000000
+#define BATCHES 100
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int int_compare(const void *a, const void *b) {
+     intptr_t x = (intptr_t)a, y = (intptr_t)b;
+     return x < y ? -1 : x > y;
+}
+
+static int int_ref_compare(const void *a, const void *b) {
+     return int_compare(*(const void *const *)a, *(const void *const *)b);
+}
+
+int main() {
+     cad_btree_t *b = cad_new_btree(stdlib_memory, int_compare);
+     cad_array_t *a = cad_new_array(stdlib_memory, sizeof(void*));
+     cad_btree_cursor_t cursor;
+     cad_array_cursor_t array_cursor;
+     intptr_t *keys = malloc(COUNT * sizeof(intptr_t));
+     intptr_t sum = 0;
+     void *key;
+     double start;
+     int i, j, more;
+
+     srand(42);
+     for (i = 0; i < COUNT; i++) {
+          keys[i] = ((intptr_t)rand() << 16) ^ rand();
+     }
+
+     /* insert a batch, then list everything in order */
+     start = now_ns();
+     for (j = 0; j < BATCHES; j++) {
+          for (i = j * COUNT / BATCHES; i < (j + 1) * COUNT / BATCHES; i++) {
+               key = (void*)keys[i];
+               a->insert(a, a->count(a), &key);
+          }
+          a->sort(a, int_ref_compare);
+          for (more = a->first(a, &array_cursor); more; more = cad_array_next(&array_cursor)) {
+               sum += *(intptr_t*)cad_array_value(&array_cursor);
+          }
+     }
+     printf("array+sort %8.1f ns/key\n", (now_ns() - start) / COUNT);
+
+     start = now_ns();
+     for (j = 0; j < BATCHES; j++) {
+          for (i = j * COUNT / BATCHES; i < (j + 1) * COUNT / BATCHES; i++) {
+               b->set(b, (void*)keys[i], NULL);
+          }
+          for (more = b->first(b, &cursor); more; more = cad_btree_next(&cursor)) {
+               sum -= (intptr_t)cad_btree_key(&cursor);
+          }
+     }
+     printf("btree      %8.1f ns/key\n", (now_ns() - start) / COUNT);
+
+     start = now_ns();
+     for (i = 0; i < COUNT; i++) {
+          sum += b->lower_bound(b, (void*)(keys[i] + 1), &cursor);
+     }
+     printf("lower_bound %7.1f ns/op\n", (now_ns() - start) / COUNT);
+
+     i = b->count(b);
+     start = now_ns();
+     b->del_range(b, (void*)(intptr_t)1, (void*)(((intptr_t)RAND_MAX << 15)), NULL, NULL);
+     printf("del_range  %8.1f ns/key (%d keys)\n", (now_ns() - start) / (i - b->count(b)), i - b->count(b));
+
+     if (sum == 42) {
+          printf("unlikely\n");
+     }
+     a->free(a);
+     b->free(b);
+     free(keys);
+     return 0;
+}
@@ -0,0 +1,110 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A shared routing table of 100K entries, updated one entry at a time
+ * while readers must keep a consistent view: each update publishes a
+ * new version. Compares a persistent map against copying a hash table
+ * on each update.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cad_hamt.h"
+
+#define ENTRIES 100000
+#define UPDATES 1000000
+#define COPIES 100
+#define LOOKUPS 4000000
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void copy_entry(void *hash, int index, const void *key, void *value, void *data) {
+     cad_hash_t *copy = data;
+     copy->set(copy, key, value);
+}
+
+static cad_hash_t *copy_of(cad_hash_t *hash) {
+     cad_hash_t *result = cad_new_hash(stdlib_memory, cad_hash_ints);
+     result->reserve(result, hash->count(hash));
+     hash->iterate(hash, copy_entry, result);
+     return result;
+}
+
+int main() {
+     cad_hamt_t *hamt = cad_new_hamt(stdlib_memory, cad_hash_ints), *next, *snapshot;
+     cad_hash_t *hash = cad_new_hash(stdlib_memory, cad_hash_ints), *copy;
+     intptr_t i, k;
+     double start, hamt_ns, hash_ns;
+     long found = 0;
+
+     srand(42);
+     for (i = 0; i < ENTRIES; i++) {
+          next = hamt->with(hamt, (void*)i, (void*)(i + 1));
+          hamt->free(hamt);
+          hamt = next;
+          hash->set(hash, (void*)i, (void*)(i + 1));
+     }
+
+     start = now_ns();
+     for (i = 0; i < UPDATES; i++) {
+          k = rand() % ENTRIES;
+          next = hamt->with(hamt, (void*)k, (void*)(i + 1));
+          hamt->free(hamt);
+          hamt = next;
+     }
+     hamt_ns = (now_ns() - start) / UPDATES;
+     start = now_ns();
+     for (i = 0; i < COPIES; i++) {
+          k = rand() % ENTRIES;
+          copy = copy_of(hash);
+          copy->set(copy, (void*)k, (void*)(i + 1));
+          hash->free(hash);
+          hash = copy;
+     }
+     hash_ns = (now_ns() - start) / COPIES;
+     printf("update:   hamt %8.1f ns, hash copy %10.1f ns\n", hamt_ns, hash_ns);
+
+     start = now_ns();
+     for (i = 0; i < UPDATES; i++) {
+          snapshot = hamt->snapshot(hamt);
+          snapshot->free(snapshot);
+     }
+     printf("snapshot: hamt %8.1f ns\n", (now_ns() - start) / UPDATES);
+
+     start = now_ns();
+     for (i = 0; i < LOOKUPS; i++) {
+          found += hamt->get(hamt, (void*)(intptr_t)(rand() % ENTRIES)) != NULL;
+     }
+     hamt_ns = (now_ns() - start) / LOOKUPS;
+     start = now_ns();
+     for (i = 0; i < LOOKUPS; i++) {
+          found += hash->get(hash, (void*)(intptr_t)(rand() % ENTRIES)) != NULL;
+     }
+     hash_ns = (now_ns() - start) / LOOKUPS;
+     printf("get:      hamt %8.1f ns, hash      %10.1f ns (%ld found)\n", hamt_ns, hash_ns, found);
+
+     hamt->free(hamt);
+     hash->free(hash);
+     return 0;
+}
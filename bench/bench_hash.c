@@ -0,0 +1,131 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+ * Mixed insert/delete workloads on a hash table holding one million
+ * string keys:
+ *
+ * - "window": a sliding window, each new key evicts the oldest one
+ *   (a cache or a session table with expiry);
+ * - "random": each step deletes a random live key and inserts a new
+ *   one.
+ *
+ * The fill phase also reports the worst insertion latency.
+ *
+ * Keys are formatted beforehand so that only the hash table work is
+ * measured. Each workload runs with each string keys manager.
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cad_hash.h"
+
+#define KEYS  1000000
+#define STEPS 4000000
+#define KEY_SIZE 16
+
+static char (*keys)[KEY_SIZE];
+static cad_hash_keys_t strings;
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double ns, int ops) {
+     printf("%-8s %8d ops %8.1f ns/op\n", name, ops, ns / ops);
+}
+
+/* also reports the slowest insertion, i.e. the cost of growing */
+static cad_hash_t *fill(void) {
+     cad_hash_t *result = cad_new_hash(stdlib_memory, strings);
+     double start = now_ns(), t0, t1 = start, worst = 0;
+     int i;
+     for (i = 0; i < KEYS; i++) {
+          t0 = t1;
+          result->set(result, keys[i], keys[i]);
+          t1 = now_ns();
+          if (t1 - t0 > worst) {
+               worst = t1 - t0;
+          }
+     }
+     report("fill", now_ns() - start, KEYS);
+     printf("%-8s %8.1f us\n", "worst", worst / 1000);
+     return result;
+}
+
+static void window(void) {
+     cad_hash_t *h = fill();
+     double start = now_ns();
+     int i;
+     for (i = KEYS; i < KEYS + STEPS; i++) {
+          h->del(h, keys[i - KEYS]);
+          h->set(h, keys[i], keys[i]);
+     }
+     report("window", now_ns() - start, 2 * STEPS);
+     h->free(h);
+     /* or the libc consolidates the freed keys during the next fill */
+     malloc_trim(0);
+}
+
+static void random_churn(void) {
+     cad_hash_t *h = fill();
+     int *live = malloc(KEYS * sizeof(int));
+     double start;
+     int i, k;
+     for (i = 0; i < KEYS; i++) {
+          live[i] = i;
+     }
+     srand(42);
+     start = now_ns();
+     for (i = KEYS; i < KEYS + STEPS; i++) {
+          k = rand() % KEYS;
+          h->del(h, keys[live[k]]);
+          h->set(h, keys[i], keys[i]);
+          live[k] = i;
+     }
+     report("random", now_ns() - start, 2 * STEPS);
+     h->free(h);
+     free(live);
+     malloc_trim(0);
+}
+
+int main() {
+     int i;
+     keys = malloc((size_t)(KEYS + STEPS) * KEY_SIZE);
+     for (i = 0; i < KEYS + STEPS; i++) {
+          sprintf(keys[i], "key:%d", i);
+     }
+     strings = cad_hash_strings;
+     printf("cad_hash_strings\n");
+     window();
+     random_churn();
+     strings = cad_hash_strings_fast;
+     printf("cad_hash_strings_fast\n");
+     window();
+     random_churn();
+     strings = cad_hash_strings_siphash;
+     printf("cad_hash_strings_siphash\n");
+     window();
+     random_churn();
+     free(keys);
+     return 0;
+}
@@ -0,0 +1,115 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Scaling of a read-mostly workload (90% get, 10% set) on a table
+ * holding 65536 string keys, from 1 to MAX_THREADS threads:
+ *
+ * - "locked": a plain hash table behind a single mutex;
+ * - "sharded": a concurrent hash table with 64 shards.
+ *
+ * Each thread performs the same number of operations; the reported
+ * throughput is the total number of operations per microsecond of
+ * wall clock time.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cad_hash.h"
+
+#define KEYS        65536
+#define OPS         2000000
+#define MAX_THREADS 8
+#define SHARDS      64
+#define KEY_SIZE    16
+
+static char (*keys)[KEY_SIZE];
+
+static cad_hash_t *hash;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int locked;
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *worker(void *arg) {
+     unsigned int state = (unsigned int)(long)arg * 2654435761U + 1;
+     const char *key;
+     int i;
+     for (i = 0; i < OPS; i++) {
+          state = state * 1103515245U + 12345U;
+          key = keys[(state >> 8) % KEYS];
+          if (locked) {
+               pthread_mutex_lock(&lock);
+          }
+          if ((state >> 24) % 10 != 0) {
+               hash->get(hash, key);
+          } else {
+               hash->set(hash, key, (void*)key);
+          }
+          if (locked) {
+               pthread_mutex_unlock(&lock);
+          }
+     }
+     return NULL;
+}
+
+static void run(const char *name, int threads) {
+     pthread_t t[MAX_THREADS];
+     double start;
+     long i;
+     for (i = 0; i < KEYS; i++) {
+          hash->set(hash, keys[i], keys[i]);
+     }
+     start = now_ns();
+     for (i = 0; i < threads; i++) {
+          pthread_create(t + i, NULL, worker, (void*)i);
+     }
+     for (i = 0; i < threads; i++) {
+          pthread_join(t[i], NULL);
+     }
+     printf("%-8s %2d threads %8.1f ops/us\n", name, threads, (double)OPS * threads * 1000 / (now_ns() - start));
+}
+
+int main() {
+     int i;
+
+     keys = malloc(KEYS * KEY_SIZE);
+     for (i = 0; i < KEYS; i++) {
+          sprintf(keys[i], "key:%d", i);
+     }
+
+     for (i = 1; i <= MAX_THREADS; i *= 2) {
+          hash = cad_new_hash(stdlib_memory, cad_hash_strings_fast);
+          locked = 1;
+          run("locked", i);
+          hash->free(hash);
+
+          hash = cad_new_concurrent_hash(stdlib_memory, cad_hash_strings_fast, SHARDS);
+          locked = 0;
+          run("sharded", i);
+          hash->free(hash);
+     }
+
+     free(keys);
+     return 0;
+}
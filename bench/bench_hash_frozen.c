@@ -0,0 +1,133 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Random lookups in a hash table, in its frozen copy and in its
+ * mapped file, one key at a time (get) or by batches of 64 keys
+ * (get_many), from 16K keys up to 4M keys. The time needed to freeze
+ * the table and to open the mapped file is also reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cad_hash.h"
+
+#define MAX_KEYS (4 * 1024 * 1024)
+#define OPS      (4 * 1024 * 1024)
+#define BATCH    64
+#define KEY_SIZE 16
+
+static char (*keys)[KEY_SIZE];
+static const void **order;
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double ns) {
+     printf("%-15s %8.1f ns/op\n", name, ns / OPS);
+}
+
+static long lookup(const char *name, cad_hash_t *h) {
+     void *values[BATCH];
+     unsigned int i, j;
+     double start;
+     long sum = 0;
+
+     start = now_ns();
+     for (i = 0; i < OPS; i++) {
+          sum += (long)h->get(h, order[i]);
+     }
+     report(name, now_ns() - start);
+
+     start = now_ns();
+     for (i = 0; i < OPS; i += BATCH) {
+          h->get_many(h, order + i, BATCH, values);
+          for (j = 0; j < BATCH; j++) {
+               sum -= (long)values[j];
+          }
+     }
+     report("      get_many", now_ns() - start);
+     return sum;
+}
+
+static void run(unsigned int size) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings_fast);
+     cad_hash_t *frozen, *mapped;
+     char path[] = "/tmp/bench_hash_frozen.XXXXXX";
+     unsigned int i, state = 42;
+     double start;
+     long sum = 0;
+
+     for (i = 0; i < size; i++) {
+          h->set(h, keys[i], keys[i]);
+     }
+     for (i = 0; i < OPS; i++) {
+          state = state * 1103515245U + 12345U;
+          order[i] = keys[(state >> 4) % size];
+     }
+     printf("%u keys\n", size);
+
+     start = now_ns();
+     frozen = cad_new_frozen_hash(stdlib_memory, cad_hash_strings_fast, h);
+     printf("%-15s %8.1f ns/key\n", "freeze", (now_ns() - start) / size);
+     if (frozen == NULL) {
+          printf("cannot freeze\n");
+          h->free(h);
+          return;
+     }
+
+     close(mkstemp(path));
+     cad_hash_write_mapped(frozen, cad_hash_strings_fast, NULL, path);
+     start = now_ns();
+     mapped = cad_new_mapped_hash(stdlib_memory, cad_hash_strings_fast, path);
+     printf("%-15s %8.1f us\n", "open mapped", (now_ns() - start) / 1000);
+     unlink(path);
+
+     sum += lookup("hash   get", h);
+     sum += lookup("frozen get", frozen);
+     sum += lookup("mapped get", mapped);
+
+     if (sum != 0) {
+          printf("wrong values\n");
+     }
+     mapped->free(mapped);
+     frozen->free(frozen);
+     h->free(h);
+}
+
+int main() {
+     unsigned int i;
+
+     keys = malloc((size_t)MAX_KEYS * KEY_SIZE);
+     order = malloc(OPS * sizeof(void*));
+     for (i = 0; i < MAX_KEYS; i++) {
+          sprintf(keys[i], "key:%u", i);
+     }
+
+     for (i = 16 * 1024; i <= MAX_KEYS; i *= 4) {
+          run(i);
+     }
+
+     free(order);
+     free(keys);
+     return 0;
+}
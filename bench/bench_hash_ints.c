@@ -0,0 +1,106 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Integer keys: fill, random lookups then deletion of one million
+ * keys, with cad_hash_ints against boxed keys (each key is a cloned
+ * `int`, the only way before inline keys).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cad_hash.h"
+
+#define KEYS (1000 * 1000)
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double ns) {
+     printf("%-12s %8.1f ns/op\n", name, ns / KEYS);
+}
+
+static unsigned int boxed_hash(const int *key) {
+     return (unsigned int)*key;
+}
+
+static int boxed_compare(const int *key1, const int *key2) {
+     return *key1 != *key2;
+}
+
+static const int *boxed_clone(const int *key) {
+     int *result = malloc(sizeof(int));
+     if (result != NULL) {
+          *result = *key;
+     }
+     return result;
+}
+
+static cad_hash_keys_t boxed = {
+     (cad_hash_keys_hash_fn   )boxed_hash   ,
+     (cad_hash_keys_compare_fn)boxed_compare,
+     (cad_hash_keys_clone_fn  )boxed_clone  ,
+     (cad_hash_keys_free_fn   )free         ,
+     NULL,
+     NULL,
+};
+
+static void run(const char *name, cad_hash_keys_t keys, int inline_keys) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, keys);
+     int i, n;
+     unsigned int state = 42;
+     double start;
+     long sum = 0;
+
+     printf("%s\n", name);
+     start = now_ns();
+     for (i = 0; i < KEYS; i++) {
+          h->set(h, inline_keys ? (const void*)(intptr_t)i : &i, (void*)(intptr_t)(i + 1));
+     }
+     report("set", now_ns() - start);
+
+     start = now_ns();
+     for (i = 0; i < KEYS; i++) {
+          state = state * 1103515245U + 12345U;
+          n = (state >> 4) % KEYS;
+          sum += (intptr_t)h->get(h, inline_keys ? (const void*)(intptr_t)n : &n);
+     }
+     report("get", now_ns() - start);
+
+     start = now_ns();
+     for (i = 0; i < KEYS; i++) {
+          h->del(h, inline_keys ? (const void*)(intptr_t)i : &i);
+     }
+     report("del", now_ns() - start);
+
+     if (sum == 0 || h->count(h) != 0) {
+          printf("wrong values\n");
+     }
+     h->free(h);
+}
+
+int main() {
+     run("boxed", boxed, 0);
+     run("cad_hash_ints", cad_hash_ints, 1);
+     return 0;
+}
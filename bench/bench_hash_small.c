@@ -0,0 +1,67 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The life of the tiny hash tables built for each request (headers,
+ * cookies, query parameters): create, set a few keys, look them up,
+ * then free; for 2 to 16 keys.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "cad_hash.h"
+
+#define ROUNDS 1000000
+
+static const char *keys[] = {
+     "Content-Type", "Content-Length", "Cache-Control", "Location",
+     "Set-Cookie", "Expires", "Last-Modified", "ETag",
+     "Vary", "Server", "Date", "Connection",
+     "Accept", "Accept-Encoding", "Host", "User-Agent",
+};
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main() {
+     cad_hash_t *h;
+     int n, i, j;
+     long sum = 0;
+     double start;
+
+     for (n = 2; n <= 16; n *= 2) {
+          start = now_ns();
+          for (i = 0; i < ROUNDS; i++) {
+               h = cad_new_hash(stdlib_memory, cad_hash_borrowed_keys(cad_hash_strings));
+               for (j = 0; j < n; j++) {
+                    h->set(h, keys[j], (void*)keys[j]);
+               }
+               for (j = 0; j < n; j++) {
+                    sum += h->get(h, keys[j]) != NULL;
+               }
+               h->free(h);
+          }
+          printf("%2d keys %8.1f ns/table\n", n, (now_ns() - start) / ROUNDS);
+     }
+     if (sum != (long)ROUNDS * 30) {
+          printf("wrong values\n");
+     }
+     return 0;
+}
@@ -0,0 +1,83 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Probe statistics of one million URL-shaped keys with each string
+ * keys manager, and with the concurrent and frozen tables.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cad_hash.h"
+
+#define KEYS     1000000
+#define KEY_SIZE 64
+
+static char (*keys)[KEY_SIZE];
+
+static void report(const char *name, cad_hash_t *h) {
+     cad_hash_stats_t stats;
+     int i;
+     h->stats(h, &stats);
+     printf("%-10s capacity %8u  load %.2f  probes avg %.3f max %2u  grows %u rehashes %u\n",
+            name, stats.capacity, stats.load_factor, stats.average_probe, stats.max_probe, stats.grows, stats.rehashes);
+     printf("%10s", "");
+     for (i = 0; i < CAD_HASH_PROBES && i < stats.max_probe; i++) {
+          printf(" %u", stats.probes[i]);
+     }
+     printf("\n");
+}
+
+static cad_hash_t *fill(cad_hash_t *h) {
+     int i;
+     for (i = 0; i < KEYS; i++) {
+          h->set(h, keys[i], keys[i]);
+     }
+     return h;
+}
+
+int main() {
+     cad_hash_t *h, *frozen;
+     int i;
+
+     keys = malloc((size_t)KEYS * KEY_SIZE);
+     for (i = 0; i < KEYS; i++) {
+          sprintf(keys[i], "/api/v1/users/%d/orders/%d?page=%d", i / 100, i % 100, i % 7);
+     }
+
+     h = fill(cad_new_hash(stdlib_memory, cad_hash_strings));
+     report("strings", h);
+     h->free(h);
+
+     h = fill(cad_new_hash(stdlib_memory, cad_hash_strings_siphash));
+     report("siphash", h);
+     h->free(h);
+
+     h = fill(cad_new_hash(stdlib_memory, cad_hash_strings_fast));
+     report("fast", h);
+     frozen = cad_new_frozen_hash(stdlib_memory, cad_hash_strings_fast, h);
+     report("frozen", frozen);
+     frozen->free(frozen);
+     h->free(h);
+
+     h = fill(cad_new_concurrent_hash(stdlib_memory, cad_hash_strings_fast, 16));
+     report("concurrent", h);
+     h->free(h);
+
+     free(keys);
+     return 0;
+}
@@ -0,0 +1,74 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A cache of rendered fragments: skewed requests on 1M paths, through
+ * an LRU cache of 64K fragments (get, then put on a miss).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cad_lru.h"
+
+#define PATHS 1000000
+#define REQUESTS 4000000
+#define CAPACITY 65536
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main() {
+     cad_lru_t *lru = cad_new_lru(stdlib_memory, cad_hash_strings, CAPACITY, NULL, NULL);
+     char **paths = malloc(PATHS * sizeof(char*));
+     int *requests = malloc(REQUESTS * sizeof(int));
+     cad_lru_stats_t stats;
+     double start, r;
+     int i;
+
+     srand(42);
+     for (i = 0; i < PATHS; i++) {
+          paths[i] = malloc(32);
+          snprintf(paths[i], 32, "/page/%d/fragment", i);
+     }
+     for (i = 0; i < REQUESTS; i++) {
+          /* a few hot paths and a long tail */
+          r = (double)rand() / RAND_MAX;
+          requests[i] = (int)(r * r * r * r * (PATHS - 1));
+     }
+
+     start = now_ns();
+     for (i = 0; i < REQUESTS; i++) {
+          if (lru->get(lru, paths[requests[i]]) == NULL) {
+               lru->put(lru, paths[requests[i]], paths[requests[i]], 1);
+          }
+     }
+     lru->stats(lru, &stats);
+     printf("%6.1f ns/request, %4.1f%% hits, %llu evictions\n", (now_ns() - start) / REQUESTS,
+            100.0 * stats.hits / (stats.hits + stats.misses), stats.evictions);
+
+     lru->free(lru);
+     for (i = 0; i < PATHS; i++) {
+          free(paths[i]);
+     }
+     free(paths);
+     free(requests);
+     return 0;
+}
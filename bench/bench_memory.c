@@ -0,0 +1,132 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Compares stdlib_memory and the thread cache memory manager when
+ * events are allocated by an event queue provider thread and freed by
+ * the consumer thread. Several provider/consumer pairs run at the same
+ * time.
+ *
+ * The event queue paces its provider, so each provided item is a batch
+ * of events; only the time spent allocating and freeing is measured.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cad_event_queue.h"
+#include "cad_memory.h"
+
+#define BATCHES 40
+#define EVENTS  20000
+#define MAX_PAIRS 8
+
+typedef struct batch {
+     int count;
+     void *events[EVENTS];
+} batch_t;
+
+typedef struct pair {
+     cad_memory_t memory;
+     cad_event_queue_t *queue;
+     pthread_t consumer;
+     int provided;
+     double alloc_ns;
+     double free_ns;
+} pair_t;
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *provide(pair_t *pair) {
+     batch_t *result;
+     double start;
+     int i;
+     if (pair->provided == BATCHES) {
+          return NULL;
+     }
+     start = now_ns();
+     result = pair->memory.malloc(sizeof(batch_t));
+     result->count = EVENTS;
+     for (i = 0; i < EVENTS; i++) {
+          result->events[i] = pair->memory.malloc(16 + (i % 32) * 16);
+          *(int*)result->events[i] = i;
+     }
+     pair->alloc_ns += now_ns() - start;
+     pair->provided++;
+     return result;
+}
+
+static void *consume(pair_t *pair) {
+     batch_t *batch;
+     double start;
+     int n, i;
+     for (n = 0; n < BATCHES; n++) {
+          batch = pair->queue->pull(pair->queue);
+          start = now_ns();
+          for (i = 0; i < batch->count; i++) {
+               pair->memory.free(batch->events[i]);
+          }
+          pair->memory.free(batch);
+          pair->free_ns += now_ns() - start;
+     }
+     return NULL;
+}
+
+static void run(const char *name, cad_memory_t memory, int pairs) {
+     pair_t pair[MAX_PAIRS];
+     double alloc_ns = 0, free_ns = 0;
+     int i;
+
+     for (i = 0; i < pairs; i++) {
+          memset(pair + i, 0, sizeof(pair_t));
+          pair[i].memory = memory;
+          pair[i].queue = cad_new_event_queue_pthread(stdlib_memory, (provide_data_fn)provide, 16);
+          pthread_create(&(pair[i].consumer), NULL, (void *(*)(void*))consume, pair + i);
+     }
+     for (i = 0; i < pairs; i++) {
+          pair[i].queue->start(pair[i].queue, pair + i);
+     }
+     for (i = 0; i < pairs; i++) {
+          pthread_join(pair[i].consumer, NULL);
+          pair[i].queue->free(pair[i].queue);
+          alloc_ns += pair[i].alloc_ns;
+          free_ns += pair[i].free_ns;
+     }
+
+     printf("%-12s %d pair(s): malloc %6.1f ns, free %6.1f ns\n", name, pairs,
+            alloc_ns / ((double)pairs * BATCHES * EVENTS),
+            free_ns / ((double)pairs * BATCHES * EVENTS));
+}
+
+int main() {
+     cad_memory_t cache;
+     int pairs;
+
+     for (pairs = 1; pairs <= MAX_PAIRS; pairs *= 2) {
+          run("stdlib", stdlib_memory, pairs);
+          cache = cad_new_thread_cache_memory();
+          run("thread cache", cache, pairs);
+          cad_free_memory(cache);
+     }
+
+     return 0;
+}
@@ -0,0 +1,110 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * An allow list: a cad_hash_t with dummy values against a cad_set_t,
+ * for the memory of the table (keys are borrowed) and the lookups;
+ * then the set algebra on two lists.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cad_set.h"
+#include "cad_memory.h"
+
+#define COUNT 1000000
+
+static double now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static size_t live_bytes(cad_memory_t memory) {
+     cad_memory_stats_t stats;
+     cad_counting_memory_stats(memory, &stats);
+     return stats.live_bytes;
+}
+
+int main() {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_hash_keys_t keys = cad_hash_borrowed_keys(cad_hash_strings);
+     char **names = malloc(2 * COUNT * sizeof(char*));
+     cad_hash_t *h = cad_new_hash(memory, keys);
+     cad_set_t *s, *t, *r;
+     size_t bytes;
+     long found = 0;
+     double start;
+     int i;
+
+     for (i = 0; i < 2 * COUNT; i++) {
+          names[i] = malloc(32);
+          snprintf(names[i], 32, "host-%d.example.com", i);
+     }
+
+     for (i = 0; i < COUNT; i++) {
+          h->set(h, names[i], names[i]);
+     }
+     bytes = live_bytes(memory);
+     start = now_ns();
+     for (i = 0; i < 2 * COUNT; i++) {
+          found += h->get(h, names[i]) != NULL;
+     }
+     printf("hash %6.1f bytes/key %6.1f ns/get\n", (double)bytes / COUNT, (now_ns() - start) / (2 * COUNT));
+     h->free(h);
+
+     s = cad_new_set(memory, keys);
+     for (i = 0; i < COUNT; i++) {
+          s->add(s, names[i]);
+     }
+     bytes = live_bytes(memory);
+     start = now_ns();
+     for (i = 0; i < 2 * COUNT; i++) {
+          found += s->contains(s, names[i]);
+     }
+     printf("set  %6.1f bytes/key %6.1f ns/contains\n", (double)bytes / COUNT, (now_ns() - start) / (2 * COUNT));
+
+     t = cad_new_set(memory, keys);
+     for (i = COUNT / 2; i < COUNT + COUNT / 2; i++) {
+          t->add(t, names[i]);
+     }
+     start = now_ns();
+     r = s->unite(s, t);
+     printf("union        %6.1f ns/key\n", (now_ns() - start) / (2 * COUNT));
+     r->free(r);
+     start = now_ns();
+     r = s->intersect(s, t);
+     printf("intersection %6.1f ns/key\n", (now_ns() - start) / COUNT);
+     r->free(r);
+     start = now_ns();
+     r = s->difference(s, t);
+     printf("difference   %6.1f ns/key\n", (now_ns() - start) / COUNT);
+     r->free(r);
+     s->free(s);
+     t->free(t);
+
+     if (found != 2 * COUNT) {
+          printf("wrong lookups\n");
+     }
+     for (i = 0; i < 2 * COUNT; i++) {
+          free(names[i]);
+     }
+     free(names);
+     cad_free_memory(memory);
+     return 0;
+}
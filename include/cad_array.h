@@ -130,6 +130,42 @@ typedef void (*cad_array_sort_fn) (cad_array_t *this, comparator_fn comparator);
  */
 typedef void (*cad_array_clear_fn) (cad_array_t *this);
 
+/**
+ * A cursor on the elements of an array, set by the array's first()
+ * function; its fields are private.
+ *
+ * While a cursor is in use, the current element may be deleted (see
+ * cad_array_del_current()), but no element may be inserted nor
+ * updated. Leaving the loop early needs no cleanup.
+ *
+ * Typical use:
+ * @code
+ * cad_array_cursor_t cursor;
+ * int more;
+ * for (more = array->first(array, &cursor); more; more = cad_array_next(&cursor)) {
+ *      use(cad_array_index(&cursor), cad_array_value(&cursor));
+ * }
+ * @endcode
+ */
+typedef struct cad_array_cursor_s {
+     cad_array_t *array;
+     char *content;
+     size_t size;
+     unsigned int index;
+     unsigned int count;
+} cad_array_cursor_t;
+
+/**
+ * Puts the `cursor` on the first element of the array.
+ *
+ * @param[in] this the target array
+ * @param[out] cursor the cursor to set
+ *
+ * @return 1 if the cursor is on an element, 0 if the array is empty.
+ *
+ */
+typedef int (*cad_array_first_fn) (cad_array_t *this, cad_array_cursor_t *cursor);
+
 struct cad_array_s {
      /**
       * @see array_free_fn
@@ -163,8 +199,45 @@ struct cad_array_s {
       * @see cad_array_clear_fn
       */
      cad_array_clear_fn clear;
+     /**
+      * @see cad_array_first_fn
+      */
+     cad_array_first_fn first;
 };
 
+/**
+ * Moves the `cursor` to the next element.
+ *
+ * @return 1 if the cursor is on an element, 0 at the end.
+ */
+static inline int cad_array_next(cad_array_cursor_t *cursor) {
+     return ++cursor->index < cursor->count;
+}
+
+/**
+ * @return the index of the element the `cursor` is on.
+ */
+static inline unsigned int cad_array_index(const cad_array_cursor_t *cursor) {
+     return cursor->index;
+}
+
+/**
+ * @return the pointer to the element the `cursor` is on.
+ */
+static inline void *cad_array_value(const cad_array_cursor_t *cursor) {
+     return cursor->content + cursor->index * cursor->size;
+}
+
+/**
+ * Deletes the element the `cursor` is on; cad_array_next() then moves
+ * to the element that followed it.
+ */
+static inline void cad_array_del_current(cad_array_cursor_t *cursor) {
+     cursor->array->del(cursor->array, cursor->index);
+     cursor->index--;
+     cursor->count--;
+}
+
 /**
  * Allocates and returns a new array.
  *
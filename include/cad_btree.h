@@ -0,0 +1,296 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAD_BTREE_H_
+#define _CAD_BTREE_H_
+
+/**
+ * @ingroup cad_btree
+ * @file
+ *
+ * An ordered map. Accepts any kinds of pointers as keys and values;
+ * the keys are kept sorted by a comparator.
+ *
+ * The implementation is a B+tree: the keys and values are in the
+ * leaves, which are linked in key order; the nodes hold 16 keys (two
+ * cache lines of key pointers).
+ */
+
+#include "cad_array.h"
+
+/**
+ * @addtogroup cad_btree
+ * @{
+ */
+
+/**
+ * The ordered map public interface.
+ */
+typedef struct cad_btree_s cad_btree_t;
+
+/**
+ * The user must provide a function of this type to iterate through
+ * the keys of an ordered map.
+ *
+ * @param[in] btree the ordered map onto which the iterator is iterating
+ * @param[in] index the current index; the function is called once for each [0..count[
+ * @param[in] key the current key
+ * @param[in] value the current value
+ * @param[in] data user data
+ *
+ */
+typedef void (*cad_btree_iterator_fn)(void *btree, int index, const void *key, void *value, void *data);
+
+/**
+ * Frees the ordered map.
+ *
+ * \a Note: does not free its content!
+ *
+ * @param[in] this the target ordered map
+ *
+ */
+typedef void (*cad_btree_free_fn) (cad_btree_t *this);
+
+/**
+ * Counts the number of keys in the ordered map.
+ *
+ * @param[in] this the target ordered map
+ *
+ * @return the number of keys.
+ *
+ */
+typedef unsigned int (*cad_btree_count_fn) (cad_btree_t *this);
+
+/**
+ * Iterates through all the ordered map's keys, in ascending
+ * order. Calls the provided `iterator` for each key.
+ *
+ * @param[in] this the target ordered map
+ * @param[in] iterator the function called once per key (cannot be NULL)
+ * @param[in] data a user data pointer passed to the `iterator` function
+ *
+ */
+typedef void (*cad_btree_iterate_fn)(cad_btree_t *this, cad_btree_iterator_fn iterator, void *data);
+
+/**
+ * Retrieves a value associated with the given `key`.
+ *
+ * @param[in] this the target ordered map
+ * @param[in] key the key to lookup
+ *
+ * @return the value associated to the provided key, `NULL` if not found.
+ *
+ */
+typedef void *(*cad_btree_get_fn) (cad_btree_t *this, const void *key);
+
+/**
+ * Associates a `value` to a `key`. Both the `key` and the `value` are
+ * stored as is: the `key` must live as long as it is in the ordered
+ * map.
+ *
+ * @param[in] this the target ordered map
+ * @param[in] key the key to set
+ * @param[in] value the value to associate to the `key`
+ *
+ * @return the previous value, or NULL
+ *
+ */
+typedef void *(*cad_btree_set_fn) (cad_btree_t *this, const void *key, void *value);
+
+/**
+ * Removes both a `key` and its associated value from the ordered map.
+ * The map does not keep any reference to a removed key, which may be
+ * freed.
+ *
+ * @param[in] this the target ordered map
+ * @param[in] key the key to delete
+ *
+ * @return the previous value, or NULL
+ *
+ */
+typedef void *(*cad_btree_del_fn) (cad_btree_t *this, const void *key);
+
+/**
+ * Removes all the keys from `from` (included) to `to` (excluded). A
+ * `NULL` bound means no bound: `del_range(this, NULL, NULL, ...)`
+ * empties the ordered map (hence the `NULL` key, or 0 for integer
+ * keys, cannot be a bound). Calls the provided `iterator` for each
+ * removed key, thus providing a way to cleanly free keys and values.
+ *
+ * The keys are removed by runs, one leaf at a time.
+ *
+ * @param[in] this the target ordered map
+ * @param[in] from the lowest key to remove, or `NULL`
+ * @param[in] to the key that stops the removal, or `NULL`
+ * @param[in] iterator the function called once per removed key (may be NULL)
+ * @param[in] data a user data pointer passed to the `iterator` function
+ *
+ * @return the number of removed keys.
+ *
+ */
+typedef unsigned int (*cad_btree_del_range_fn)(cad_btree_t *this, const void *from, const void *to, cad_btree_iterator_fn iterator, void *data);
+
+/**
+ * A cursor on the keys of an ordered map, set by the ordered map's
+ * first(), lower_bound() or upper_bound() functions; its fields are
+ * private.
+ *
+ * The keys are visited in ascending order. While a cursor is in use,
+ * values may be replaced, but no key may be added nor deleted.
+ * Leaving the loop early needs no cleanup.
+ *
+ * Typical use (all the keys from "b" included to "d" excluded):
+ * @code
+ * cad_btree_cursor_t cursor;
+ * int more;
+ * for (more = btree->lower_bound(btree, "b", &cursor); more && strcmp(cad_btree_key(&cursor), "d") < 0; more = cad_btree_next(&cursor)) {
+ *      use(cad_btree_key(&cursor), cad_btree_value(&cursor));
+ * }
+ * @endcode
+ */
+typedef struct cad_btree_cursor_s cad_btree_cursor_t;
+
+/**
+ * Moves the cursor to the first key of the next leaf.
+ *
+ * @param[in] cursor the cursor to move
+ *
+ * @return 1 if the cursor is on a key, 0 at the end.
+ *
+ */
+typedef int (*cad_btree_cursor_next_fn)(cad_btree_cursor_t *cursor);
+
+struct cad_btree_cursor_s {
+   /* the keys and values of the current leaf */
+   const void *const *keys;
+   void *const *values;
+   unsigned int index;
+   unsigned int count;
+   const void *leaf;
+   cad_btree_cursor_next_fn next_leaf;
+};
+
+/**
+ * Puts the `cursor` on the first key of the ordered map.
+ *
+ * @param[in] this the target ordered map
+ * @param[out] cursor the cursor to set
+ *
+ * @return 1 if the cursor is on a key, 0 if the ordered map is empty.
+ *
+ */
+typedef int (*cad_btree_first_fn)(cad_btree_t *this, cad_btree_cursor_t *cursor);
+
+/**
+ * Puts the `cursor` on the first key not less than `key`
+ * (lower_bound()), or greater than `key` (upper_bound()).
+ *
+ * @param[in] this the target ordered map
+ * @param[in] key the key to look for
+ * @param[out] cursor the cursor to set
+ *
+ * @return 1 if the cursor is on a key, 0 if there is no such key.
+ *
+ */
+typedef int (*cad_btree_bound_fn)(cad_btree_t *this, const void *key, cad_btree_cursor_t *cursor);
+
+struct cad_btree_s {
+   /**
+    * @see cad_btree_free_fn
+    */
+   cad_btree_free_fn      free;
+   /**
+    * @see cad_btree_count_fn
+    */
+   cad_btree_count_fn     count;
+   /**
+    * @see cad_btree_iterate_fn
+    */
+   cad_btree_iterate_fn   iterate;
+   /**
+    * @see cad_btree_get_fn
+    */
+   cad_btree_get_fn       get;
+   /**
+    * @see cad_btree_set_fn
+    */
+   cad_btree_set_fn       set;
+   /**
+    * @see cad_btree_del_fn
+    */
+   cad_btree_del_fn       del;
+   /**
+    * @see cad_btree_del_range_fn
+    */
+   cad_btree_del_range_fn del_range;
+   /**
+    * @see cad_btree_first_fn
+    */
+   cad_btree_first_fn     first;
+   /**
+    * @see cad_btree_bound_fn
+    */
+   cad_btree_bound_fn     lower_bound;
+   /**
+    * @see cad_btree_bound_fn
+    */
+   cad_btree_bound_fn     upper_bound;
+};
+
+/**
+ * Moves the `cursor` to the next key.
+ *
+ * @return 1 if the cursor is on a key, 0 at the end.
+ */
+static inline int cad_btree_next(cad_btree_cursor_t *cursor) {
+   if (++cursor->index < cursor->count) {
+      return 1;
+   }
+   return cursor->next_leaf(cursor);
+}
+
+/**
+ * @return the key the `cursor` is on.
+ */
+static inline const void *cad_btree_key(const cad_btree_cursor_t *cursor) {
+   return cursor->keys[cursor->index];
+}
+
+/**
+ * @return the value of the key the `cursor` is on.
+ */
+static inline void *cad_btree_value(const cad_btree_cursor_t *cursor) {
+   return cursor->values[cursor->index];
+}
+
+/**
+ * Allocates and returns a new ordered map.
+ *
+ * The `comparator` is called with the keys themselves (not pointers
+ * to them, unlike qsort()), e.g. `strcmp` for C strings.
+ *
+ * @param[in] memory the memory manager of the ordered map
+ * @param[in] comparator the keys comparator
+ *
+ * @return the newly allocated ordered map.
+ */
+__PUBLIC__ cad_btree_t *cad_new_btree(cad_memory_t memory, comparator_fn comparator);
+
+/**
+ * @}
+ */
+
+#endif /* _CAD_BTREE_H_ */
@@ -0,0 +1,173 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAD_HAMT_H_
+#define _CAD_HAMT_H_
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * A persistent hash map (a "hash array mapped trie"). A map is never
+ * modified: with() and without() return new versions that share all
+ * their unchanged nodes with the original one. Taking a snapshot is
+ * O(1), and versions may be read by several threads without locks.
+ */
+
+#include "cad_hash.h"
+
+/**
+ * @addtogroup cad_hash
+ * @{
+ */
+
+/**
+ * The persistent hash map public interface. Each pointer is one
+ * version of the map, freed on its own.
+ */
+typedef struct cad_hamt_s cad_hamt_t;
+
+/**
+ * Frees the version. Its nodes, and the keys it cloned, are freed
+ * when no other version shares them.
+ *
+ * \a Note: does not free the values!
+ *
+ * @param[in] this the target version
+ *
+ */
+typedef void (*cad_hamt_free_fn) (cad_hamt_t *this);
+
+/**
+ * Counts the number of keys in the version.
+ *
+ * @param[in] this the target version
+ *
+ * @return the number of keys.
+ *
+ */
+typedef unsigned int (*cad_hamt_count_fn) (cad_hamt_t *this);
+
+/**
+ * Iterates through all the version's keys, in no particular order.
+ * Calls the provided `iterator` for each key.
+ *
+ * @param[in] this the target version
+ * @param[in] iterator the function called once per key (cannot be NULL)
+ * @param[in] data a user data pointer passed to the `iterator` function
+ *
+ */
+typedef void (*cad_hamt_iterate_fn)(cad_hamt_t *this, cad_hash_iterator_fn iterator, void *data);
+
+/**
+ * Retrieves a value associated with the given `key`.
+ *
+ * @param[in] this the target version
+ * @param[in] key the key to lookup
+ *
+ * @return the value associated to the provided key, `NULL` if not found.
+ *
+ */
+typedef void *(*cad_hamt_get_fn) (cad_hamt_t *this, const void *key);
+
+/**
+ * Returns a new version where the `key` is associated to the
+ * `value`. Only the O(log32(n)) nodes on the path to the key are
+ * copied. The `key` is cloned (if the keys manager clones); the
+ * provided `key` may be freed by the caller.
+ *
+ * @param[in] this the target version (unchanged)
+ * @param[in] key the key to set
+ * @param[in] value the value to associate to the `key`
+ *
+ * @return the new version, `NULL` on error.
+ *
+ */
+typedef cad_hamt_t *(*cad_hamt_with_fn) (cad_hamt_t *this, const void *key, void *value);
+
+/**
+ * Returns a new version without the `key` (nor its value).
+ *
+ * @param[in] this the target version (unchanged)
+ * @param[in] key the key to remove
+ *
+ * @return the new version, `NULL` on error.
+ *
+ */
+typedef cad_hamt_t *(*cad_hamt_without_fn) (cad_hamt_t *this, const void *key);
+
+/**
+ * Returns a new version with the same keys, in O(1): e.g. to give a
+ * consistent view of the map to another thread, which frees it when
+ * done.
+ *
+ * @param[in] this the target version
+ *
+ * @return the new version, `NULL` on error.
+ *
+ */
+typedef cad_hamt_t *(*cad_hamt_snapshot_fn) (cad_hamt_t *this);
+
+struct cad_hamt_s {
+   /**
+    * @see cad_hamt_free_fn
+    */
+   cad_hamt_free_fn     free;
+   /**
+    * @see cad_hamt_count_fn
+    */
+   cad_hamt_count_fn    count;
+   /**
+    * @see cad_hamt_iterate_fn
+    */
+   cad_hamt_iterate_fn  iterate;
+   /**
+    * @see cad_hamt_get_fn
+    */
+   cad_hamt_get_fn      get;
+   /**
+    * @see cad_hamt_with_fn
+    */
+   cad_hamt_with_fn     with;
+   /**
+    * @see cad_hamt_without_fn
+    */
+   cad_hamt_without_fn  without;
+   /**
+    * @see cad_hamt_snapshot_fn
+    */
+   cad_hamt_snapshot_fn snapshot;
+};
+
+/**
+ * Allocates and returns a new, empty, persistent hash map.
+ *
+ * The nodes are reference-counted and allocated from the given
+ * memory manager, which must be thread-safe if versions are freed
+ * by several threads.
+ *
+ * @param[in] memory the memory manager of the map and all its versions
+ * @param[in] keys the keys manager (any, including borrowed and packed keys)
+ *
+ * @return the newly allocated version.
+ */
+__PUBLIC__ cad_hamt_t *cad_new_hamt(cad_memory_t memory, cad_hash_keys_t keys);
+
+/**
+ * @}
+ */
+
+#endif /* _CAD_HAMT_H_ */
@@ -24,7 +24,8 @@
  * A hash table. Accepts any kinds of pointers as keys and values (you
  * must provide the functions to hash the keys).
  *
- * The implementation is based on Python's.
+ * The implementation is a "Swiss table": open addressing with one
+ * control byte per slot, probed by groups of 16 slots.
  */
 
 #include "cad_shared.h"
@@ -131,6 +132,175 @@ typedef void *(*cad_hash_del_fn) (cad_hash_t *this, const void *key);
  */
 typedef void (*cad_hash_clean_fn)(cad_hash_t *this, cad_hash_iterator_fn iterator, void *data);
 
+/**
+ * Makes room for at least `count` keys, so that the hash table does
+ * not need to grow until it holds that many keys.
+ *
+ * @param[in] this the target hash table
+ * @param[in] count the expected number of keys
+ *
+ * @return 0 on success, -1 on error
+ *
+ */
+typedef int (*cad_hash_reserve_fn)(cad_hash_t *this, unsigned int count);
+
+/**
+ * Gives back the memory not needed by the current keys, e.g. after a
+ * burst of insertions followed by deletions.
+ *
+ * @param[in] this the target hash table
+ *
+ * @return 0 on success, -1 on error
+ *
+ */
+typedef int (*cad_hash_shrink_to_fit_fn)(cad_hash_t *this);
+
+/**
+ * A cursor on the keys of a hash table, set by the hash table's
+ * first() function; its fields are private.
+ *
+ * The keys are visited in the same order as with iterate(), without
+ * any callback. While a cursor is in use, the current key may be
+ * deleted (see cad_hash_del_current()) and values may be replaced,
+ * but no key may be added. Leaving the loop early needs no cleanup.
+ *
+ * Typical use:
+ * @code
+ * cad_hash_cursor_t cursor;
+ * int more;
+ * for (more = hash->first(hash, &cursor); more; more = cad_hash_next(&cursor)) {
+ *      use(cad_hash_key(&cursor), cad_hash_value(&cursor));
+ * }
+ * @endcode
+ */
+typedef struct cad_hash_cursor_s cad_hash_cursor_t;
+
+/**
+ * Moves the cursor of a hash table that does not store its entries
+ * in a dense array.
+ *
+ * @param[in] cursor the cursor to move
+ *
+ * @return 1 if the cursor is on a key, 0 at the end.
+ *
+ */
+typedef int (*cad_hash_cursor_next_fn)(cad_hash_cursor_t *cursor);
+
+struct cad_hash_cursor_s {
+   cad_hash_t *hash;
+   const void *key;
+   void *value;
+   /* the entries: a key pointer, then a value pointer at `value_offset` */
+   const char *entries;
+   size_t stride;
+   size_t value_offset;
+   const void *hole;             /* the key of deleted entries */
+   unsigned int position;
+   unsigned int end;
+   cad_hash_cursor_next_fn next; /* used instead of the entries if not NULL */
+};
+
+/**
+ * Puts the `cursor` on the first key of the hash table.
+ *
+ * @param[in] this the target hash table
+ * @param[out] cursor the cursor to set
+ *
+ * @return 1 if the cursor is on a key, 0 if the hash table is empty.
+ *
+ */
+typedef int (*cad_hash_first_fn)(cad_hash_t *this, cad_hash_cursor_t *cursor);
+
+/**
+ * Retrieves the values of `count` keys at once, like get() for each
+ * key but faster on big tables: the memory accesses of the keys are
+ * started together instead of being waited for one after the other.
+ *
+ * @param[in] this the target hash table
+ * @param[in] keys the keys to look for
+ * @param[in] count the number of keys
+ * @param[out] values the values of the keys, `NULL` for unknown keys
+ *
+ */
+typedef void (*cad_hash_get_many_fn)(cad_hash_t *this, const void *const *keys, unsigned int count, void **values);
+
+/**
+ * Inserts or replaces the values of `count` keys at once, like set()
+ * for each key in turn but faster on big tables.
+ *
+ * @param[in] this the target hash table
+ * @param[in] keys the keys to set
+ * @param[in] values the values to set
+ * @param[in] count the number of keys
+ * @param[out] old_values the values returned by set() for each key (may be `NULL`)
+ *
+ */
+typedef void (*cad_hash_set_many_fn)(cad_hash_t *this, const void *const *keys, void *const *values, unsigned int count, void **old_values);
+
+/**
+ * The number of entries of the probe length histogram of a hash
+ * table.
+ */
+#define CAD_HASH_PROBES 16
+
+/**
+ * The statistics of a hash table, to compare hash functions and table
+ * engines on real data, or to catch pathological keys.
+ *
+ * The probe length of a key is the number of places read to find
+ * it: index groups (of 16 slots) for cad_new_hash(), slots for
+ * cad_new_concurrent_hash(), and slots for frozen and mapped tables
+ * (always 1, except for keys sharing the same hash).
+ */
+typedef struct cad_hash_stats {
+   /**
+    * The number of slots.
+    */
+   unsigned int capacity;
+   /**
+    * The number of keys.
+    */
+   unsigned int count;
+   /**
+    * The number of keys per slot.
+    */
+   double load_factor;
+   /**
+    * The average probe length of the keys.
+    */
+   double average_probe;
+   /**
+    * The longest probe length.
+    */
+   unsigned int max_probe;
+   /**
+    * `probes[i]` is the number of keys with a probe length of `i + 1`;
+    * the last entry also counts the longer probes.
+    */
+   unsigned int probes[CAD_HASH_PROBES];
+   /**
+    * The number of times the table grew.
+    */
+   unsigned int grows;
+   /**
+    * The number of times the table was rebuilt without growing (to
+    * squeeze out deleted keys, or to shrink).
+    */
+   unsigned int rehashes;
+} cad_hash_stats_t;
+
+/**
+ * Computes the statistics of the hash table. All the keys are looked
+ * up again: this is meant for diagnostics, not for hot paths.
+ *
+ * @param[in] this the target hash table
+ * @param[out] stats the statistics
+ *
+ * @return 0 on success, -1 on error.
+ *
+ */
+typedef int (*cad_hash_stats_fn)(cad_hash_t *this, cad_hash_stats_t *stats);
+
 struct cad_hash_s {
    /**
     * @see hash_free_fn
@@ -160,8 +330,77 @@ struct cad_hash_s {
     * @see hash_clean_fn
     */
    cad_hash_clean_fn clean;
+   /**
+    * @see hash_reserve_fn
+    */
+   cad_hash_reserve_fn reserve;
+   /**
+    * @see hash_shrink_to_fit_fn
+    */
+   cad_hash_shrink_to_fit_fn shrink_to_fit;
+   /**
+    * @see cad_hash_first_fn
+    */
+   cad_hash_first_fn first;
+   /**
+    * @see cad_hash_get_many_fn
+    */
+   cad_hash_get_many_fn get_many;
+   /**
+    * @see cad_hash_set_many_fn
+    */
+   cad_hash_set_many_fn set_many;
+   /**
+    * @see cad_hash_stats_fn
+    */
+   cad_hash_stats_fn stats;
 };
 
+/**
+ * Moves the `cursor` to the next key.
+ *
+ * @return 1 if the cursor is on a key, 0 at the end.
+ */
+static inline int cad_hash_next(cad_hash_cursor_t *cursor) {
+   const char *entry;
+   if (cursor->next != NULL) {
+      return cursor->next(cursor);
+   }
+   while (++cursor->position < cursor->end) {
+      entry = cursor->entries + cursor->position * cursor->stride;
+      if (*(const void *const *)entry != cursor->hole) {
+         cursor->key   = *(const void *const *)entry;
+         cursor->value = *(void *const *)(entry + cursor->value_offset);
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * @return the key the `cursor` is on.
+ */
+static inline const void *cad_hash_key(const cad_hash_cursor_t *cursor) {
+   return cursor->key;
+}
+
+/**
+ * @return the value of the key the `cursor` is on.
+ */
+static inline void *cad_hash_value(const cad_hash_cursor_t *cursor) {
+   return cursor->value;
+}
+
+/**
+ * Deletes the key the `cursor` is on; cad_hash_next() then moves to
+ * the key that followed it.
+ *
+ * @return the deleted value.
+ */
+static inline void *cad_hash_del_current(cad_hash_cursor_t *cursor) {
+   return cursor->hash->del(cursor->hash, cursor->key);
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /**
@@ -203,6 +442,30 @@ typedef const void *(*cad_hash_keys_clone_fn) (const void *key);
  */
 typedef void (*cad_hash_keys_free_fn) (void *key);
 
+/**
+ * Optional keyed hash function. If provided, the hash table uses it
+ * instead of the plain `hash` function, with a 128-bit `seed` derived
+ * from the table's salt (see hash_salt_fn).
+ *
+ * @param[in] key the key to hash
+ * @param[in] seed the secret key of the hash table
+ *
+ * @return the hash value of a key
+ */
+typedef unsigned int (*cad_hash_keys_salted_hash_fn) (const void *key, const unsigned long long seed[2]);
+
+/**
+ * Optional function that gives the size of a key, in bytes. Needed
+ * by packed keys.
+ *
+ * @param[in] key the key
+ *
+ * @return the number of bytes to copy to clone the key
+ *
+ * @see cad_hash_packed_keys
+ */
+typedef size_t (*cad_hash_keys_size_fn) (const void *key);
+
 /**
  * The user must provide an object with this public interface of the
  * functions to the hash table creator (new_hash()). The hash table
@@ -225,6 +488,16 @@ typedef struct cad_hash_keys {
     * @see hash_keys_free_fn
     */
    cad_hash_keys_free_fn    free;
+   /**
+    * May be `NULL`.
+    * @see hash_keys_salted_hash_fn
+    */
+   cad_hash_keys_salted_hash_fn salted_hash;
+   /**
+    * May be `NULL`.
+    * @see hash_keys_size_fn
+    */
+   cad_hash_keys_size_fn    size;
 } cad_hash_keys_t;
 
 /**
@@ -232,6 +505,65 @@ typedef struct cad_hash_keys {
  */
 __PUBLIC__ extern cad_hash_keys_t cad_hash_strings;
 
+/**
+ * A keys manager for C strings, using a fast word-at-a-time hash
+ * function (wyhash). Use it for trusted keys.
+ */
+__PUBLIC__ extern cad_hash_keys_t cad_hash_strings_fast;
+
+/**
+ * A keys manager for C strings, using SipHash-2-4 keyed with the hash
+ * table's salt. Slower than cad_hash_strings_fast, but resists
+ * collision flooding: use it for keys coming from untrusted input.
+ */
+__PUBLIC__ extern cad_hash_keys_t cad_hash_strings_siphash;
+
+/**
+ * A keys manager for integer keys, cast to pointers: use
+ * `(const void*)(intptr_t)n` as key. Keys are stored as they are in
+ * the hash table, without any allocation; the hash and comparison are
+ * inlined by the hash table.
+ *
+ * One value is reserved to mark the deleted entries (the `hole` of the
+ * cursors, the address of a private object): set() does not store it
+ * and returns `NULL`.
+ */
+__PUBLIC__ extern cad_hash_keys_t cad_hash_ints;
+
+/**
+ * A keys manager for pointer keys, compared by address (the pointed
+ * data is never read). This is the same keys manager as
+ * cad_hash_ints: keys are stored as they are, without any allocation.
+ */
+__PUBLIC__ extern cad_hash_keys_t cad_hash_pointers;
+
+/**
+ * Returns a keys manager that borrows the keys instead of cloning
+ * them: the caller guarantees that each key lives as long as it is in
+ * the hash table. Note that set() always stores the given key, even
+ * if an equal key was already there.
+ *
+ * @param[in] keys the original keys manager
+ *
+ * @return the borrowing keys manager
+ */
+__PUBLIC__ cad_hash_keys_t cad_hash_borrowed_keys(cad_hash_keys_t keys);
+
+/**
+ * Returns a keys manager that copies the keys into a key arena owned
+ * by the hash table and allocated from its memory manager, instead of
+ * cloning each of them. The original keys manager must have a `size`
+ * function.
+ *
+ * The space of deleted keys is only given back by shrink_to_fit() and
+ * clean(): packed keys suit tables that mostly grow.
+ *
+ * @param[in] keys the original keys manager
+ *
+ * @return the packing keys manager
+ */
+__PUBLIC__ cad_hash_keys_t cad_hash_packed_keys(cad_hash_keys_t keys);
+
 /**
  * Allocates and returns a new hash table.
  *
@@ -239,9 +571,94 @@ __PUBLIC__ extern cad_hash_keys_t cad_hash_strings;
  */
 __PUBLIC__ cad_hash_t *cad_new_hash(cad_memory_t memory, cad_hash_keys_t keys);
 
+/**
+ * Allocates and returns a new concurrent hash table: all its
+ * functions may be called from several threads at the same time.
+ *
+ * Keys are spread over `shards` shards (rounded up to a power of
+ * two), each with its own lock taken by the writers; get() and
+ * iterate() take no lock. Iteration is weakly consistent: it sees
+ * each key present during the whole iteration, but may or may not
+ * see concurrent changes. Cursors are weaker: each step takes the
+ * shard lock, and a key moved by a concurrent resize may be missed or
+ * seen twice.
+ *
+ * The `memory` must be thread-safe (e.g. `stdlib_memory` or a thread
+ * cache memory manager). Borrowed keys must live as long as the hash
+ * table, since a reader may still compare them after del(). Values
+ * returned by get() must be protected by the caller against
+ * concurrent del().
+ *
+ * @return the newly allocated hash table.
+ */
+__PUBLIC__ cad_hash_t *cad_new_concurrent_hash(cad_memory_t memory, cad_hash_keys_t keys, unsigned int shards);
+
+/**
+ * Allocates and returns a new read-only hash table holding the keys
+ * and values of `source`, laid out as a minimal perfect hash: get()
+ * reads exactly one slot. Meant for tables built once and read many
+ * times (MIME types, routes, reserved names...).
+ *
+ * `keys` must be the keys manager of `source`; the keys are copied the
+ * same way (cloned, packed or borrowed), and `source` may be freed
+ * afterwards. Values are not copied. set() and del() do nothing and
+ * return `NULL`; clean() does nothing; reserve() fails beyond the
+ * current count. Iteration order is not the insertion order.
+ *
+ * @return the newly allocated hash table, `NULL` if it could not be
+ * built.
+ */
+__PUBLIC__ cad_hash_t *cad_new_frozen_hash(cad_memory_t memory, cad_hash_keys_t keys, cad_hash_t *source);
+
+/**
+ * Gives the number of bytes of a `value` to write in a mapped hash
+ * file (see cad_hash_write_mapped()).
+ *
+ * @param[in] value the value
+ *
+ * @return the number of bytes to copy
+ */
+typedef size_t (*cad_hash_value_size_fn)(const void *value);
+
+/**
+ * Writes the keys and values of `hash` to the file at `path`, in a
+ * form that cad_new_mapped_hash() maps back without any parsing. The
+ * file is written aside then renamed, so that processes still mapping
+ * the previous file are not disturbed.
+ *
+ * `keys` must be the keys manager of `hash` and have a `size`
+ * function; the hash of a key must not depend on its address. If
+ * `value_size` is `NULL`, the values themselves are written (e.g.
+ * small integers); otherwise the bytes they point to are written.
+ *
+ * The file uses the native byte order and word size.
+ *
+ * @return 0 on success, -1 on error.
+ */
+__PUBLIC__ int cad_hash_write_mapped(cad_hash_t *hash, cad_hash_keys_t keys, cad_hash_value_size_fn value_size, const char *path);
+
+/**
+ * Maps the file at `path`, written by cad_hash_write_mapped(), and
+ * returns a read-only hash table (like cad_new_frozen_hash()) that
+ * looks up keys directly in the mapped pages. Opening costs one
+ * mmap() whatever the size of the table, and the pages are shared by
+ * all the processes that map the same file.
+ *
+ * Keys and values point into the read-only mapping: they must not be
+ * written to, and live until the hash table is freed. The header is
+ * checked, and so are the offsets of all the slots (one pass over
+ * them, without reading the keys); the bytes of the keys and values
+ * are trusted.
+ *
+ * @return the newly allocated hash table, `NULL` if the file cannot
+ * be mapped or is not a mapped hash file.
+ */
+__PUBLIC__ cad_hash_t *cad_new_mapped_hash(cad_memory_t memory, cad_hash_keys_t keys, const char *path);
+
 /**
  * A function of this type is used each time a hash table is
- * allocated. It provides an offset to the hash table indices.
+ * allocated. It provides an offset to the hash table indices, and the
+ * seed of the keyed hash functions.
  */
 typedef int (*hash_salt_fn)(void);
 
@@ -0,0 +1,123 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAD_INTERN_H_
+#define _CAD_INTERN_H_
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * A string interning table. Equal strings are interned as the same
+ * canonical string (the "atom"), so that atoms can be compared by
+ * pointer.
+ */
+
+#include "cad_hash.h"
+
+/**
+ * @addtogroup cad_hash
+ * @{
+ */
+
+/**
+ * The interning table public interface.
+ */
+typedef struct cad_intern_s cad_intern_t;
+
+/**
+ * Frees the interning table, and all its atoms.
+ *
+ * @param[in] this the target interning table
+ *
+ */
+typedef void (*cad_intern_free_fn) (cad_intern_t *this);
+
+/**
+ * Counts the number of atoms in the interning table.
+ *
+ * @param[in] this the target interning table
+ *
+ * @return the number of atoms.
+ *
+ */
+typedef unsigned int (*cad_intern_count_fn) (cad_intern_t *this);
+
+/**
+ * Interns a string. The string is copied the first time it is
+ * interned; the provided `string` may be freed by the caller.
+ *
+ * @param[in] this the target interning table
+ * @param[in] string the string to intern
+ *
+ * @return the atom equal to the `string`, `NULL` on error. The atom
+ * lives as long as the interning table.
+ *
+ */
+typedef const char *(*cad_intern_intern_fn) (cad_intern_t *this, const char *string);
+
+/**
+ * Looks up the atom of a string, without interning it.
+ *
+ * @param[in] this the target interning table
+ * @param[in] string the string to look up
+ *
+ * @return the atom equal to the `string`, `NULL` if the string was
+ * never interned.
+ *
+ */
+typedef const char *(*cad_intern_lookup_fn) (cad_intern_t *this, const char *string);
+
+struct cad_intern_s {
+   /**
+    * @see cad_intern_free_fn
+    */
+   cad_intern_free_fn   free;
+   /**
+    * @see cad_intern_count_fn
+    */
+   cad_intern_count_fn  count;
+   /**
+    * @see cad_intern_intern_fn
+    */
+   cad_intern_intern_fn intern;
+   /**
+    * @see cad_intern_lookup_fn
+    */
+   cad_intern_lookup_fn lookup;
+};
+
+/**
+ * Allocates and returns a new interning table. Atoms are allocated
+ * from the given memory manager.
+ *
+ * @return the newly allocated interning table.
+ */
+__PUBLIC__ cad_intern_t *cad_new_intern(cad_memory_t memory);
+
+/**
+ * A keys manager for atoms: keys are hashed and compared by pointer,
+ * and never cloned. Only use it with keys that are all atoms of the
+ * same interning table. This is the same keys manager as
+ * cad_hash_pointers.
+ */
+__PUBLIC__ extern cad_hash_keys_t cad_hash_atoms;
+
+/**
+ * @}
+ */
+
+#endif /* _CAD_INTERN_H_ */
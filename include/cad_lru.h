@@ -0,0 +1,216 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAD_LRU_H_
+#define _CAD_LRU_H_
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * A cache with a bounded capacity, that evicts the least recently
+ * used keys first (LRU). Accepts any kinds of pointers as keys and
+ * values, with the same keys managers as the hash tables.
+ */
+
+#include "cad_hash.h"
+
+/**
+ * @addtogroup cad_hash
+ * @{
+ */
+
+/**
+ * The cache public interface.
+ */
+typedef struct cad_lru_s cad_lru_t;
+
+/**
+ * The user may provide a function of this type to be told of the
+ * values leaving the cache: evicted to make room, replaced by put()
+ * with another value, or removed by clean(). It may free the value;
+ * the key is still valid during the call.
+ *
+ * @param[in] lru the cache
+ * @param[in] key the key of the value
+ * @param[in] value the value leaving the cache
+ * @param[in] data the user data given to cad_new_lru()
+ *
+ */
+typedef void (*cad_lru_evict_fn)(void *lru, const void *key, void *value, void *data);
+
+/**
+ * Frees the cache, and the keys it cloned.
+ *
+ * \a Note: does not free the values! (see cad_lru_clean_fn)
+ *
+ * @param[in] this the target cache
+ *
+ */
+typedef void (*cad_lru_free_fn) (cad_lru_t *this);
+
+/**
+ * Counts the number of keys in the cache.
+ *
+ * @param[in] this the target cache
+ *
+ * @return the number of keys.
+ *
+ */
+typedef unsigned int (*cad_lru_count_fn) (cad_lru_t *this);
+
+/**
+ * Retrieves the value of a `key`, which becomes the most recently
+ * used one. Counts a hit or a miss.
+ *
+ * @param[in] this the target cache
+ * @param[in] key the key to lookup
+ *
+ * @return the value of the key, `NULL` if not found.
+ *
+ */
+typedef void *(*cad_lru_get_fn) (cad_lru_t *this, const void *key);
+
+/**
+ * Associates a `value` to a `key`, which becomes the most recently
+ * used one. If not already there, the `key` is cloned; the provided
+ * `key` may be freed by the caller. The least recently used keys are
+ * evicted until the sizes of the values fit in the capacity. Nothing
+ * is evicted if the put fails.
+ *
+ * @param[in] this the target cache
+ * @param[in] key the key to set
+ * @param[in] value the value to associate to the `key`
+ * @param[in] size the size of the value, in the unit of the capacity
+ *
+ * @return 0 on success, -1 on error (nothing is cached if `size` is
+ * greater than the capacity).
+ *
+ */
+typedef int (*cad_lru_put_fn) (cad_lru_t *this, const void *key, void *value, size_t size);
+
+/**
+ * Removes both a `key` and its associated value from the cache,
+ * without calling the eviction function.
+ *
+ * @param[in] this the target cache
+ * @param[in] key the key to delete
+ *
+ * @return the previous value, or NULL
+ *
+ */
+typedef void *(*cad_lru_del_fn) (cad_lru_t *this, const void *key);
+
+/**
+ * Removes all the cache's keys. Calls the eviction function for each
+ * value, thus providing a way to cleanly free them.
+ *
+ * @param[in] this the target cache
+ *
+ */
+typedef void (*cad_lru_clean_fn)(cad_lru_t *this);
+
+/**
+ * The statistics of a cache.
+ */
+typedef struct cad_lru_stats {
+   /**
+    * The capacity, as given to cad_new_lru().
+    */
+   size_t capacity;
+   /**
+    * The sum of the sizes of the cached values.
+    */
+   size_t size;
+   /**
+    * The number of keys.
+    */
+   unsigned int count;
+   /**
+    * The number of get() calls that found their key.
+    */
+   unsigned long long hits;
+   /**
+    * The number of get() calls that did not find their key.
+    */
+   unsigned long long misses;
+   /**
+    * The number of keys evicted to make room.
+    */
+   unsigned long long evictions;
+} cad_lru_stats_t;
+
+/**
+ * Takes a snapshot of the statistics of the cache.
+ *
+ * @param[in] this the target cache
+ * @param[out] stats the statistics
+ *
+ */
+typedef void (*cad_lru_stats_fn)(cad_lru_t *this, cad_lru_stats_t *stats);
+
+struct cad_lru_s {
+   /**
+    * @see cad_lru_free_fn
+    */
+   cad_lru_free_fn  free;
+   /**
+    * @see cad_lru_count_fn
+    */
+   cad_lru_count_fn count;
+   /**
+    * @see cad_lru_get_fn
+    */
+   cad_lru_get_fn   get;
+   /**
+    * @see cad_lru_put_fn
+    */
+   cad_lru_put_fn   put;
+   /**
+    * @see cad_lru_del_fn
+    */
+   cad_lru_del_fn   del;
+   /**
+    * @see cad_lru_clean_fn
+    */
+   cad_lru_clean_fn clean;
+   /**
+    * @see cad_lru_stats_fn
+    */
+   cad_lru_stats_fn stats;
+};
+
+/**
+ * Allocates and returns a new cache.
+ *
+ * The `capacity` is in the unit of the sizes given to put(): e.g.
+ * bytes, or 1 per value for a maximum number of keys.
+ *
+ * @param[in] memory the memory manager of the cache
+ * @param[in] keys the keys manager (any, including borrowed and packed keys)
+ * @param[in] capacity the maximum sum of the sizes of the values
+ * @param[in] evict the function told of the values leaving the cache (may be `NULL`)
+ * @param[in] data a user data pointer passed to the `evict` function
+ *
+ * @return the newly allocated cache.
+ */
+__PUBLIC__ cad_lru_t *cad_new_lru(cad_memory_t memory, cad_hash_keys_t keys, size_t capacity, cad_lru_evict_fn evict, void *data);
+
+/**
+ * @}
+ */
+
+#endif /* _CAD_LRU_H_ */
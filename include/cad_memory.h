@@ -0,0 +1,352 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAD_MEMORY_H_
+#define _CAD_MEMORY_H_
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * Alternative memory managers. All of them are plain @ref
+ * cad_memory_t values that can be given to any libCad object.
+ *
+ * Because a `cad_memory_t` carries no user data, each memory manager
+ * created here uses one of a fixed number of internal slots (see
+ * CAD_MEMORY_SLOTS); a slot is given back by cad_free_memory().
+ */
+
+#include "cad_shared.h"
+#include "cad_stream.h"
+
+/**
+ * @addtogroup cad_utils
+ * @{
+ */
+
+/**
+ * The maximum number of memory managers that may be alive at the
+ * same time.
+ */
+#define CAD_MEMORY_SLOTS 32
+
+/**
+ * The extended memory manager interface. Memory managers that know
+ * the size of the blocks they are given back may use it to avoid
+ * keeping a per-block header.
+ *
+ * All the blocks managed through this interface are also valid for
+ * the matching `cad_memory_t`, and vice-versa.
+ *
+ * @see cad_memory_ex
+ */
+typedef struct cad_memory_ex cad_memory_ex_t;
+
+/**
+ * Frees a block of which the caller knows the size.
+ *
+ * @param[in] this the extended memory manager
+ * @param[in] ptr the block to free (may be `NULL`)
+ * @param[in] size the size requested when the block was allocated
+ * (or last reallocated)
+ */
+typedef void (*cad_memory_free_sized_fn)(cad_memory_ex_t *this, void *ptr, size_t size);
+
+/**
+ * Reallocates a block of which the caller knows the size.
+ *
+ * @param[in] this the extended memory manager
+ * @param[in] ptr the block to reallocate (may be `NULL`)
+ * @param[in] old_size the size requested when the block was
+ * allocated (or last reallocated)
+ * @param[in] size the new size
+ *
+ * @return the reallocated block, or `NULL` if it could not be allocated.
+ */
+typedef void *(*cad_memory_realloc_sized_fn)(cad_memory_ex_t *this, void *ptr, size_t old_size, size_t size);
+
+/**
+ * Gives the number of bytes actually usable in a block; it is at
+ * least the requested size.
+ *
+ * @param[in] this the extended memory manager
+ * @param[in] ptr the block
+ *
+ * @return the usable size of the block.
+ */
+typedef size_t (*cad_memory_usable_size_fn)(cad_memory_ex_t *this, void *ptr);
+
+/**
+ * Allocates an aligned block. The block is freed as any other block.
+ *
+ * @param[in] this the extended memory manager
+ * @param[in] alignment the alignment, a power of two
+ * @param[in] size the size of the block
+ *
+ * @return the newly allocated block, or `NULL` if it could not be
+ * allocated (or if the alignment is not supported).
+ */
+typedef void *(*cad_memory_aligned_malloc_fn)(cad_memory_ex_t *this, size_t alignment, size_t size);
+
+struct cad_memory_ex {
+     /**
+      * @see cad_memory_free_sized_fn
+      */
+     cad_memory_free_sized_fn     free_sized;
+     /**
+      * @see cad_memory_realloc_sized_fn
+      */
+     cad_memory_realloc_sized_fn  realloc_sized;
+     /**
+      * @see cad_memory_usable_size_fn
+      */
+     cad_memory_usable_size_fn    usable_size;
+     /**
+      * @see cad_memory_aligned_malloc_fn
+      */
+     cad_memory_aligned_malloc_fn aligned_malloc;
+};
+
+/**
+ * Gives the extended interface of a memory manager. It is available
+ * for @\ref stdlib_memory and for all the memory managers created
+ * by the `cad_new_*_memory` functions.
+ *
+ * Objects should look it up once and keep it.
+ *
+ * @param[in] memory the memory manager
+ *
+ * @return the extended interface, or `NULL` if the memory manager
+ * does not provide one.
+ */
+__PUBLIC__ cad_memory_ex_t *cad_memory_ex(cad_memory_t memory);
+
+/**
+ * Allocates and returns a new arena (a.k.a. region) memory manager.
+ *
+ * Memory is bump-allocated from chunks of `chunk_size` bytes (bigger
+ * requests get their own chunk). `free` does nothing; `realloc`
+ * grows the last allocated block in place when possible. All the
+ * memory is given back at once by cad_reset_memory() (the chunks are
+ * kept for reuse) or by cad_free_memory().
+ *
+ * \a Note: arenas are not thread-safe.
+ *
+ * @param[in] chunk_size the size of each chunk; 0 means a default size
+ *
+ * @return the new memory manager; its functions are `NULL` if it
+ * could not be allocated.
+ */
+__PUBLIC__ cad_memory_t cad_new_arena_memory(size_t chunk_size);
+
+/**
+ * The number of size classes of the pool memory manager.
+ */
+#define CAD_POOL_MEMORY_CLASSES 22
+
+/**
+ * The occupancy counters of one size class of a pool memory manager.
+ */
+typedef struct cad_pool_memory_class_stats {
+     /**
+      * The size of the blocks of this class.
+      */
+     size_t block_size;
+     /**
+      * The number of slabs currently allocated.
+      */
+     size_t slabs;
+     /**
+      * The number of blocks in those slabs.
+      */
+     size_t blocks;
+     /**
+      * The number of blocks currently in use.
+      */
+     size_t used;
+     /**
+      * The maximum number of blocks ever in use at the same time.
+      */
+     size_t peak;
+     /**
+      * The total number of blocks allocated.
+      */
+     size_t allocations;
+} cad_pool_memory_class_stats_t;
+
+/**
+ * The occupancy counters of a pool memory manager.
+ */
+typedef struct cad_pool_memory_stats {
+     /**
+      * The counters of each size class, by increasing block size.
+      */
+     cad_pool_memory_class_stats_t classes[CAD_POOL_MEMORY_CLASSES];
+     /**
+      * The number of big blocks (bigger than the biggest class)
+      * currently in use.
+      */
+     size_t big_count;
+     /**
+      * The total size of those big blocks.
+      */
+     size_t big_bytes;
+} cad_pool_memory_stats_t;
+
+/**
+ * Allocates and returns a new pool (a.k.a. slab) memory manager.
+ *
+ * Blocks up to 1024 bytes are rounded up to one of
+ * CAD_POOL_MEMORY_CLASSES size classes; each class has its own
+ * page-sized slabs and free lists. Bigger blocks are allocated
+ * individually.
+ *
+ * \a Note: pools are not thread-safe.
+ *
+ * @return the new memory manager; its functions are `NULL` if it
+ * could not be allocated.
+ */
+__PUBLIC__ cad_memory_t cad_new_pool_memory(void);
+
+/**
+ * Reads the occupancy counters of a pool memory manager.
+ *
+ * @param[in] memory the pool memory manager
+ * @param[out] stats the counters
+ *
+ * @return 0 if the counters were read, -1 if the memory manager is
+ * not a pool.
+ */
+__PUBLIC__ int cad_pool_memory_stats(cad_memory_t memory, cad_pool_memory_stats_t *stats);
+
+/**
+ * The number of buckets of the counting memory manager size
+ * histogram.
+ */
+#define CAD_MEMORY_HISTOGRAM 16
+
+/**
+ * The statistics of a counting memory manager.
+ */
+typedef struct cad_memory_stats {
+     /**
+      * The number of bytes currently allocated.
+      */
+     size_t live_bytes;
+     /**
+      * The maximum number of bytes ever allocated at the same time.
+      */
+     size_t peak_bytes;
+     /**
+      * The number of calls to `malloc`.
+      */
+     size_t allocations;
+     /**
+      * The number of calls to `realloc`.
+      */
+     size_t reallocations;
+     /**
+      * The number of calls to `free`.
+      */
+     size_t frees;
+     /**
+      * The histogram of the requested sizes (by `malloc` and
+      * `realloc`): bucket `i` counts sizes up to `16 << i` bytes; the
+      * last bucket counts all the bigger sizes.
+      */
+     size_t histogram[CAD_MEMORY_HISTOGRAM];
+} cad_memory_stats_t;
+
+/**
+ * Allocates and returns a new counting memory manager. It delegates
+ * all the allocations to the `inner` memory manager, and keeps
+ * statistics (see cad_counting_memory_stats()).
+ *
+ * The counting memory manager is thread-safe if `inner` is.
+ *
+ * @param[in] inner the memory manager that actually allocates memory
+ *
+ * @return the new memory manager; its functions are `NULL` if it
+ * could not be allocated.
+ */
+__PUBLIC__ cad_memory_t cad_new_counting_memory(cad_memory_t inner);
+
+/**
+ * Takes a snapshot of the statistics of a counting memory manager.
+ *
+ * @param[in] memory the counting memory manager
+ * @param[out] stats the statistics
+ *
+ * @return 0 if the statistics were read, -1 if the memory manager is
+ * not a counting one.
+ */
+__PUBLIC__ int cad_counting_memory_stats(cad_memory_t memory, cad_memory_stats_t *stats);
+
+/**
+ * Prints a human-readable report of the statistics of a counting
+ * memory manager.
+ *
+ * @param[in] memory the counting memory manager
+ * @param[in] out the stream to print the report to
+ *
+ * @return 0 if the report was printed, -1 if the memory manager is
+ * not a counting one.
+ */
+__PUBLIC__ int cad_counting_memory_report(cad_memory_t memory, cad_output_stream_t *out);
+
+/**
+ * Allocates and returns a new thread cache memory manager, meant for
+ * multi-threaded programs (e.g. an event queue provider thread that
+ * allocates the events the consumer thread frees).
+ *
+ * Blocks up to 1024 bytes are served from per-thread free lists
+ * without any lock. A block freed by another thread than the one that
+ * allocated it goes back to its owner thread through a lock-free list.
+ * Bigger blocks are delegated to `malloc(3)`.
+ *
+ * Small blocks are kept for reuse until the memory manager is freed.
+ *
+ * @return the new memory manager; its functions are `NULL` if it
+ * could not be allocated.
+ */
+__PUBLIC__ cad_memory_t cad_new_thread_cache_memory(void);
+
+/**
+ * Releases all the memory allocated by the given memory manager, but
+ * keeps the manager usable. All the blocks it allocated become
+ * invalid.
+ *
+ * @param[in] memory the memory manager to reset
+ *
+ * @return 0 if the memory was reset, -1 if the memory manager does
+ * not support reset.
+ */
+__PUBLIC__ int cad_reset_memory(cad_memory_t memory);
+
+/**
+ * Frees a memory manager created by one of the `cad_new_*_memory`
+ * functions. Does nothing on other memory managers (e.g. @ref
+ * stdlib_memory).
+ *
+ * @param[in] memory the memory manager to free
+ */
+__PUBLIC__ void cad_free_memory(cad_memory_t memory);
+
+/**
+ * @}
+ */
+
+#endif /* _CAD_MEMORY_H_ */
@@ -0,0 +1,222 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAD_SET_H_
+#define _CAD_SET_H_
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * A hash set: a hash table with keys only, for membership tests. It
+ * uses the same keys managers and the same "Swiss table" index as
+ * cad_new_hash(), but its slots hold no value.
+ */
+
+#include "cad_hash.h"
+
+/**
+ * @addtogroup cad_hash
+ * @{
+ */
+
+/**
+ * The hash set public interface.
+ */
+typedef struct cad_set_s cad_set_t;
+
+/**
+ * The user must provide a function of this type to iterate through
+ * all the keys of a hash set.
+ *
+ * @param[in] set the hash set onto which the iterator is iterating
+ * @param[in] index the current index; the function is called once for each [0..count[
+ * @param[in] key the current key
+ * @param[in] data user data
+ *
+ */
+typedef void (*cad_set_iterator_fn)(void *set, int index, const void *key, void *data);
+
+/**
+ * Frees the hash set, and the keys it cloned.
+ *
+ * @param[in] this the target hash set
+ *
+ */
+typedef void (*cad_set_free_fn) (cad_set_t *this);
+
+/**
+ * Counts the number of keys in the hash set.
+ *
+ * @param[in] this the target hash set
+ *
+ * @return the number of keys.
+ *
+ */
+typedef unsigned int (*cad_set_count_fn) (cad_set_t *this);
+
+/**
+ * Iterates through all the hash set's keys, in no particular
+ * order. Calls the provided `iterator` for each key.
+ *
+ * @param[in] this the target hash set
+ * @param[in] iterator the function called once per key (cannot be NULL)
+ * @param[in] data a user data pointer passed to the `iterator` function
+ *
+ */
+typedef void (*cad_set_iterate_fn)(cad_set_t *this, cad_set_iterator_fn iterator, void *data);
+
+/**
+ * Adds a `key` to the hash set. If not already there, the `key` is
+ * cloned; the provided `key` may be freed by the caller.
+ *
+ * @param[in] this the target hash set
+ * @param[in] key the key to add
+ *
+ * @return 1 if the key was added, 0 if it was already there, -1 on
+ * error.
+ *
+ */
+typedef int (*cad_set_add_fn) (cad_set_t *this, const void *key);
+
+/**
+ * Tells if a `key` is in the hash set.
+ *
+ * @param[in] this the target hash set
+ * @param[in] key the key to look up
+ *
+ * @return 1 if the key is in the hash set, 0 otherwise.
+ *
+ */
+typedef int (*cad_set_contains_fn) (cad_set_t *this, const void *key);
+
+/**
+ * Removes a `key` from the hash set.
+ *
+ * @param[in] this the target hash set
+ * @param[in] key the key to remove
+ *
+ * @return 1 if the key was removed, 0 if it was not there.
+ *
+ */
+typedef int (*cad_set_remove_fn) (cad_set_t *this, const void *key);
+
+/**
+ * Removes all the hash set's keys.
+ *
+ * @param[in] this the target hash set
+ *
+ */
+typedef void (*cad_set_clean_fn)(cad_set_t *this);
+
+/**
+ * Makes room for at least `count` keys, so that the hash set does
+ * not need to grow until it holds that many keys.
+ *
+ * @param[in] this the target hash set
+ * @param[in] count the expected number of keys
+ *
+ * @return 0 on success, -1 on error
+ *
+ */
+typedef int (*cad_set_reserve_fn)(cad_set_t *this, unsigned int count);
+
+/**
+ * Computes a new hash set from the target hash set and an `other`
+ * one: their union, intersection, or difference (the keys of the
+ * target that are not in `other`).
+ *
+ * Both sets must have been created by cad_new_set() with equivalent
+ * keys managers. The result uses the memory and keys manager of the
+ * target; its table is allocated once, at its final size. The hash
+ * of the keys is not computed again when both sets share the same
+ * salt, as do the results of these functions and their target.
+ *
+ * @param[in] this the target hash set
+ * @param[in] other the other hash set
+ *
+ * @return the new hash set, `NULL` on error.
+ *
+ */
+typedef cad_set_t *(*cad_set_algebra_fn)(cad_set_t *this, cad_set_t *other);
+
+struct cad_set_s {
+   /**
+    * @see cad_set_free_fn
+    */
+   cad_set_free_fn     free;
+   /**
+    * @see cad_set_count_fn
+    */
+   cad_set_count_fn    count;
+   /**
+    * @see cad_set_iterate_fn
+    */
+   cad_set_iterate_fn  iterate;
+   /**
+    * @see cad_set_add_fn
+    */
+   cad_set_add_fn      add;
+   /**
+    * @see cad_set_contains_fn
+    */
+   cad_set_contains_fn contains;
+   /**
+    * @see cad_set_remove_fn
+    */
+   cad_set_remove_fn   remove;
+   /**
+    * @see cad_set_clean_fn
+    */
+   cad_set_clean_fn    clean;
+   /**
+    * @see cad_set_reserve_fn
+    */
+   cad_set_reserve_fn  reserve;
+   /**
+    * The union (`union` is a C keyword).
+    * @see cad_set_algebra_fn
+    */
+   cad_set_algebra_fn  unite;
+   /**
+    * The intersection.
+    * @see cad_set_algebra_fn
+    */
+   cad_set_algebra_fn  intersect;
+   /**
+    * The difference.
+    * @see cad_set_algebra_fn
+    */
+   cad_set_algebra_fn  difference;
+};
+
+/**
+ * Allocates and returns a new hash set. Any keys manager may be used,
+ * including borrowed and packed keys (see cad_hash_borrowed_keys()
+ * and cad_hash_packed_keys()) and cad_hash_ints.
+ *
+ * @param[in] memory the memory manager of the hash set
+ * @param[in] keys the keys manager
+ *
+ * @return the newly allocated hash set.
+ */
+__PUBLIC__ cad_set_t *cad_new_set(cad_memory_t memory, cad_hash_keys_t keys);
+
+/**
+ * @}
+ */
+
+#endif /* _CAD_SET_H_ */
@@ -25,21 +25,30 @@
 #include <string.h>
 
 #include "cad_array.h"
+#include "cad_memory.h"
 
 struct cad_array_impl {
      cad_array_t fn;
      cad_memory_t memory;
+     cad_memory_ex_t *ex;
 
      int capacity;
      int count;
      int eltsize;
 
      void *content;
+     size_t size; /* the content size last requested from the memory manager */
 };
 
 static void free_(struct cad_array_impl *this) {
-     this->memory.free(this->content);
-     this->memory.free(this);
+     cad_memory_ex_t *ex = this->ex;
+     if (ex != NULL) {
+          ex->free_sized(ex, this->content, this->size);
+          ex->free_sized(ex, this, sizeof(struct cad_array_impl));
+     } else {
+          this->memory.free(this->content);
+          this->memory.free(this);
+     }
 }
 
 static unsigned int count(struct cad_array_impl *this) {
@@ -55,16 +64,16 @@ static void *get(struct cad_array_impl *this, unsigned int index) {
 }
 
 static void grow(struct cad_array_impl *this, int grow_factor) {
-     int new_capacity;
-     if (this->capacity == 0) {
-          new_capacity = grow_factor * grow_factor;
-          this->content = this->memory.malloc(new_capacity * this->eltsize);
-          memset(this->content, 0, new_capacity * this->eltsize);
+     int new_capacity = this->capacity == 0 ? grow_factor * grow_factor : this->capacity * grow_factor;
+     if (this->ex != NULL) {
+          this->content = this->ex->realloc_sized(this->ex, this->content, this->size, new_capacity * this->eltsize);
+          this->size = new_capacity * this->eltsize;
+          /* use the slack the memory manager may have given */
+          new_capacity = this->ex->usable_size(this->ex, this->content) / this->eltsize;
      } else {
-          new_capacity = this->capacity * grow_factor;
           this->content = this->memory.realloc(this->content, new_capacity * this->eltsize);
-          memset(this->content + this->count * this->eltsize, 0, this->count * this->eltsize);
      }
+     memset(this->content + this->capacity * this->eltsize, 0, (new_capacity - this->capacity) * this->eltsize);
      this->capacity = new_capacity;
 }
 
@@ -118,6 +127,15 @@ static void clear(struct cad_array_impl *this) {
      this->count = 0;
 }
 
+static int first(struct cad_array_impl *this, cad_array_cursor_t *cursor) {
+     cursor->array   = (cad_array_t*)this;
+     cursor->content = this->content;
+     cursor->size    = this->eltsize;
+     cursor->index   = 0;
+     cursor->count   = this->count;
+     return this->count > 0;
+}
+
 static cad_array_t fn = {
      (cad_array_free_fn   )free_  ,
      (cad_array_count_fn  )count  ,
@@ -127,6 +145,7 @@ static cad_array_t fn = {
      (cad_array_del_fn    )del    ,
      (cad_array_sort_fn   )sort   ,
      (cad_array_clear_fn  )clear  ,
+     (cad_array_first_fn  )first  ,
 };
 
 __PUBLIC__ cad_array_t *cad_new_array(cad_memory_t memory, size_t size) {
@@ -134,9 +153,11 @@ __PUBLIC__ cad_array_t *cad_new_array(cad_memory_t memory, size_t size) {
      if (!result) return NULL;
      result->fn      = fn;
      result->memory  = memory;
+     result->ex      = cad_memory_ex(memory);
      result->capacity= 0;
      result->count   = 0;
      result->content = NULL;
+     result->size    = 0;
      result->eltsize = size;
      return (cad_array_t*)result;
 }
@@ -0,0 +1,545 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_btree
+ * @file
+ *
+ * This file contains the implementation of ordered maps.
+ *
+ * The B+tree keeps the keys and values in the leaves, linked in key
+ * order for the cursors. The inner nodes only hold separators: the
+ * keys of `children[i]` are not less than `keys[i - 1]`, and less than
+ * `keys[i]`.
+ *
+ * Insertion splits the full nodes on its way down, so that a split
+ * never goes up. Deletion goes down to a leaf, removes a run of keys
+ * from it, and fixes the nodes left with too few keys on its way back
+ * up, by merging them with a sibling or by sharing the sibling's keys.
+ *
+ * A separator is always the first key of the subtree on its right: it
+ * is a key still in the tree, that the user may free once removed. A
+ * deletion that removes the first key of a subtree replaces its
+ * separator on its way back up.
+ */
+
+#include <string.h>
+
+#include "cad_btree.h"
+#include "cad_memory_internal.h"
+
+#define MAX_KEYS 16 /* two cache lines of key pointers */
+/* an inner split gives one key less to the right node: the middle key goes up */
+#define min_keys(node) ((node)->leaf ? MAX_KEYS / 2 : MAX_KEYS / 2 - 1)
+
+typedef struct node {
+     unsigned int count;
+     int leaf;
+     const void *keys[MAX_KEYS];
+} node_t;
+
+typedef struct leaf {
+     node_t node;
+     void *values[MAX_KEYS];
+     struct leaf *next;
+} leaf_t;
+
+typedef struct inner {
+     node_t node;
+     node_t *children[MAX_KEYS + 1];
+} inner_t;
+
+struct cad_btree_impl {
+     cad_btree_t fn;
+     cad_memory_t memory;
+     cad_memory_ex_t *ex;
+     comparator_fn comparator;
+     unsigned int count;
+     node_t *root; /* NULL until the first key is set */
+};
+
+/*
+ * The keys removed by a deletion: from the key the deletion starts
+ * at, to `to`.
+ */
+typedef struct range {
+     const void *to;
+     int bounded;    /* otherwise, up to the last key */
+     int closed;     /* `to` is removed too */
+     cad_btree_iterator_fn iterator;
+     void *data;
+     int index;      /* of the next removed key, for the iterator */
+     void *value;    /* of the last removed key */
+} range_t;
+
+static node_t *new_node(struct cad_btree_impl *this, int leaf) {
+     node_t *result = this->memory.malloc(leaf ? sizeof(leaf_t) : sizeof(inner_t));
+     if (result != NULL) {
+          result->count = 0;
+          result->leaf  = leaf;
+          if (leaf) {
+               ((leaf_t*)result)->next = NULL;
+          }
+     }
+     return result;
+}
+
+static void free_node(struct cad_btree_impl *this, node_t *node) {
+     memory_free_sized(this->memory, this->ex, node, node->leaf ? sizeof(leaf_t) : sizeof(inner_t));
+}
+
+static void free_tree(struct cad_btree_impl *this, node_t *node) {
+     unsigned int i;
+     if (!node->leaf) {
+          for (i = 0; i <= node->count; i++) {
+               free_tree(this, ((inner_t*)node)->children[i]);
+          }
+     }
+     free_node(this, node);
+}
+
+/* The number of keys of the node less than `key`. */
+static unsigned int lower_index(struct cad_btree_impl *this, const node_t *node, const void *key) {
+     unsigned int low = 0, high = node->count, mid;
+     while (low < high) {
+          mid = (low + high) / 2;
+          if (this->comparator(node->keys[mid], key) < 0) {
+               low = mid + 1;
+          } else {
+               high = mid;
+          }
+     }
+     return low;
+}
+
+/* The number of keys of the node not greater than `key`. */
+static unsigned int upper_index(struct cad_btree_impl *this, const node_t *node, const void *key) {
+     unsigned int low = 0, high = node->count, mid;
+     while (low < high) {
+          mid = (low + high) / 2;
+          if (this->comparator(node->keys[mid], key) <= 0) {
+               low = mid + 1;
+          } else {
+               high = mid;
+          }
+     }
+     return low;
+}
+
+/* The leaf where `key` is, or would be. */
+static leaf_t *leaf_of(struct cad_btree_impl *this, const void *key) {
+     node_t *node = this->root;
+     while (node != NULL && !node->leaf) {
+          node = ((inner_t*)node)->children[upper_index(this, node, key)];
+     }
+     return (leaf_t*)node;
+}
+
+static leaf_t *first_leaf(struct cad_btree_impl *this) {
+     node_t *node = this->root;
+     while (node != NULL && !node->leaf) {
+          node = ((inner_t*)node)->children[0];
+     }
+     return (leaf_t*)node;
+}
+
+static int next_leaf(cad_btree_cursor_t *cursor);
+
+static int set_cursor(cad_btree_cursor_t *cursor, const leaf_t *leaf, unsigned int index) {
+     while (leaf != NULL && index >= leaf->node.count) {
+          leaf = leaf->next;
+          index = 0;
+     }
+     cursor->leaf      = leaf;
+     cursor->next_leaf = next_leaf;
+     if (leaf == NULL) {
+          cursor->index = cursor->count = 0;
+          return 0;
+     }
+     cursor->keys   = leaf->node.keys;
+     cursor->values = leaf->values;
+     cursor->index  = index;
+     cursor->count  = leaf->node.count;
+     return 1;
+}
+
+static int next_leaf(cad_btree_cursor_t *cursor) {
+     const leaf_t *leaf = cursor->leaf;
+     if (leaf == NULL) {
+          return 0;
+     }
+     return set_cursor(cursor, leaf->next, 0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Splits the full `i`-th child of the `parent`, which is not full. */
+static int split_child(struct cad_btree_impl *this, inner_t *parent, unsigned int i) {
+     node_t *child = parent->children[i];
+     node_t *right = new_node(this, child->leaf);
+     const void *separator;
+     unsigned int half = MAX_KEYS / 2;
+
+     if (right == NULL) {
+          return -1;
+     }
+     if (child->leaf) {
+          right->count = MAX_KEYS - half;
+          memcpy(right->keys, child->keys + half, right->count * sizeof(void*));
+          memcpy(((leaf_t*)right)->values, ((leaf_t*)child)->values + half, right->count * sizeof(void*));
+          ((leaf_t*)right)->next = ((leaf_t*)child)->next;
+          ((leaf_t*)child)->next = (leaf_t*)right;
+          separator = right->keys[0];
+     } else {
+          /* the middle key goes up */
+          right->count = MAX_KEYS - half - 1;
+          memcpy(right->keys, child->keys + half + 1, right->count * sizeof(void*));
+          memcpy(((inner_t*)right)->children, ((inner_t*)child)->children + half + 1, (right->count + 1) * sizeof(node_t*));
+          separator = child->keys[half];
+     }
+     child->count = half;
+
+     memmove(parent->node.keys + i + 1, parent->node.keys + i, (parent->node.count - i) * sizeof(void*));
+     memmove(parent->children + i + 2, parent->children + i + 1, (parent->node.count - i) * sizeof(node_t*));
+     parent->node.keys[i] = separator;
+     parent->children[i + 1] = right;
+     parent->node.count++;
+     return 0;
+}
+
+static int grow_root(struct cad_btree_impl *this) {
+     inner_t *root = (inner_t*)new_node(this, 0);
+     if (root == NULL) {
+          return -1;
+     }
+     root->children[0] = this->root;
+     if (split_child(this, root, 0)) {
+          free_node(this, &(root->node));
+          return -1;
+     }
+     this->root = &(root->node);
+     return 0;
+}
+
+static void *set(struct cad_btree_impl *this, const void *key, void *value) {
+     node_t *node;
+     leaf_t *leaf;
+     inner_t *inner;
+     unsigned int i;
+     void *result;
+
+     if (this->root == NULL) {
+          this->root = new_node(this, 1);
+          if (this->root == NULL) {
+               return NULL;
+          }
+     } else if (this->root->count == MAX_KEYS && grow_root(this)) {
+          return NULL;
+     }
+
+     node = this->root;
+     while (!node->leaf) {
+          inner = (inner_t*)node;
+          i = upper_index(this, node, key);
+          if (inner->children[i]->count == MAX_KEYS) {
+               if (split_child(this, inner, i)) {
+                    return NULL;
+               }
+               if (this->comparator(key, node->keys[i]) >= 0) {
+                    i++;
+               }
+          }
+          node = inner->children[i];
+     }
+
+     leaf = (leaf_t*)node;
+     i = lower_index(this, node, key);
+     if (i < node->count && this->comparator(node->keys[i], key) == 0) {
+          result = leaf->values[i];
+          leaf->values[i] = value;
+          return result;
+     }
+     memmove(node->keys + i + 1, node->keys + i, (node->count - i) * sizeof(void*));
+     memmove(leaf->values + i + 1, leaf->values + i, (node->count - i) * sizeof(void*));
+     node->keys[i] = key;
+     leaf->values[i] = value;
+     node->count++;
+     this->count++;
+     return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void remove_separator(inner_t *parent, unsigned int i) {
+     memmove(parent->node.keys + i, parent->node.keys + i + 1, (parent->node.count - i - 1) * sizeof(void*));
+     memmove(parent->children + i + 1, parent->children + i + 2, (parent->node.count - i - 1) * sizeof(node_t*));
+     parent->node.count--;
+}
+
+/*
+ * Fixes the `i`-th child of the `parent`, left with too few keys
+ * (maybe none): merges it with a sibling if both fit in one node,
+ * shares their keys evenly otherwise.
+ */
+static void fix_child(struct cad_btree_impl *this, inner_t *parent, unsigned int i) {
+     const void *keys[2 * MAX_KEYS + 1];
+     void *items[2 * MAX_KEYS + 2]; /* the values of leaves, the children of inner nodes */
+     unsigned int l = i == parent->node.count ? i - 1 : i;
+     node_t *a = parent->children[l], *b = parent->children[l + 1];
+     unsigned int total = 0, half, rest;
+     int leaf = a->leaf;
+
+     memcpy(keys, a->keys, a->count * sizeof(void*));
+     total = a->count;
+     if (!leaf) {
+          keys[total++] = parent->node.keys[l];
+     }
+     memcpy(keys + total, b->keys, b->count * sizeof(void*));
+     if (leaf) {
+          memcpy(items, ((leaf_t*)a)->values, a->count * sizeof(void*));
+          memcpy(items + a->count, ((leaf_t*)b)->values, b->count * sizeof(void*));
+     } else {
+          memcpy(items, ((inner_t*)a)->children, (a->count + 1) * sizeof(void*));
+          memcpy(items + a->count + 1, ((inner_t*)b)->children, (b->count + 1) * sizeof(void*));
+     }
+     total += b->count;
+
+     if (total <= MAX_KEYS) {
+          memcpy(a->keys, keys, total * sizeof(void*));
+          if (leaf) {
+               memcpy(((leaf_t*)a)->values, items, total * sizeof(void*));
+               ((leaf_t*)a)->next = ((leaf_t*)b)->next;
+          } else {
+               memcpy(((inner_t*)a)->children, items, (total + 1) * sizeof(void*));
+          }
+          a->count = total;
+          free_node(this, b);
+          remove_separator(parent, l);
+          return;
+     }
+
+     half = total / 2;
+     if (leaf) {
+          rest = total - half;
+          memcpy(a->keys, keys, half * sizeof(void*));
+          memcpy(((leaf_t*)a)->values, items, half * sizeof(void*));
+          memcpy(b->keys, keys + half, rest * sizeof(void*));
+          memcpy(((leaf_t*)b)->values, items + half, rest * sizeof(void*));
+          parent->node.keys[l] = b->keys[0];
+     } else {
+          /* the middle key goes up */
+          rest = total - half - 1;
+          memcpy(a->keys, keys, half * sizeof(void*));
+          memcpy(((inner_t*)a)->children, items, (half + 1) * sizeof(void*));
+          memcpy(b->keys, keys + half + 1, rest * sizeof(void*));
+          memcpy(((inner_t*)b)->children, items + half + 1, (rest + 1) * sizeof(void*));
+          parent->node.keys[l] = keys[half];
+     }
+     a->count = half;
+     b->count = rest;
+}
+
+static int before_end(struct cad_btree_impl *this, const void *key, const range_t *range) {
+     int cmp;
+     if (!range->bounded) {
+          return 1;
+     }
+     cmp = this->comparator(key, range->to);
+     return cmp < 0 || (cmp == 0 && range->closed);
+}
+
+/* The first key of a subtree without empty leaves. */
+static const void *first_key(node_t *node) {
+     while (!node->leaf) {
+          node = ((inner_t*)node)->children[0];
+     }
+     return node->keys[0];
+}
+
+/* Removes the run of keys of the `range` from `key` in the leaf where `key` is. */
+static unsigned int remove_run(struct cad_btree_impl *this, node_t *node, const void *key, range_t *range) {
+     inner_t *inner;
+     node_t *child;
+     leaf_t *leaf;
+     unsigned int i, from, to, result;
+
+     if (!node->leaf) {
+          inner = (inner_t*)node;
+          i = upper_index(this, node, key);
+          child = inner->children[i];
+          result = remove_run(this, child, key, range);
+          if (i > 0) {
+               /* the removed keys may include the separator, already freed by the user */
+               if (child->count > 0 || !child->leaf) {
+                    node->keys[i - 1] = first_key(child);
+               } else if (i < node->count) {
+                    /* an empty leaf, merged below with the next one */
+                    node->keys[i - 1] = node->keys[i];
+               }
+          }
+          if (child->count < min_keys(child)) {
+               fix_child(this, inner, i);
+          }
+          return result;
+     }
+
+     leaf = (leaf_t*)node;
+     from = lower_index(this, node, key);
+     for (to = from; to < node->count && before_end(this, node->keys[to], range); to++) {
+          if (range->iterator != NULL) {
+               range->iterator(this, range->index, node->keys[to], leaf->values[to], range->data);
+          }
+          range->index++;
+          range->value = leaf->values[to];
+     }
+     result = to - from;
+     memmove(node->keys + from, node->keys + to, (node->count - to) * sizeof(void*));
+     memmove(leaf->values + from, leaf->values + to, (node->count - to) * sizeof(void*));
+     node->count -= result;
+     this->count -= result;
+     return result;
+}
+
+static unsigned int remove_from(struct cad_btree_impl *this, const void *key, range_t *range) {
+     unsigned int result = remove_run(this, this->root, key, range);
+     node_t *root;
+     while (!this->root->leaf && this->root->count == 0) {
+          root = this->root;
+          this->root = ((inner_t*)root)->children[0];
+          free_node(this, root);
+     }
+     return result;
+}
+
+static void *del(struct cad_btree_impl *this, const void *key) {
+     range_t range = { key, 1, 1, NULL, NULL, 0, NULL };
+     if (this->count == 0) {
+          return NULL;
+     }
+     remove_from(this, key, &range);
+     return range.value;
+}
+
+static int first(struct cad_btree_impl *this, cad_btree_cursor_t *cursor);
+static int lower_bound(struct cad_btree_impl *this, const void *key, cad_btree_cursor_t *cursor);
+
+static unsigned int del_range(struct cad_btree_impl *this, const void *from, const void *to, cad_btree_iterator_fn iterator, void *data) {
+     range_t range = { to, to != NULL, 0, iterator, data, 0, NULL };
+     cad_btree_cursor_t cursor;
+     unsigned int result = 0;
+     int more;
+
+     if (from == NULL && to == NULL) {
+          /* everything goes: no need to fix the nodes */
+          for (more = first(this, &cursor); more; more = cad_btree_next(&cursor)) {
+               if (iterator != NULL) {
+                    iterator(this, range.index, cad_btree_key(&cursor), cad_btree_value(&cursor), data);
+               }
+               range.index++;
+          }
+          if (this->root != NULL) {
+               free_tree(this, this->root);
+               this->root = NULL;
+          }
+          result = this->count;
+          this->count = 0;
+          return result;
+     }
+
+     /* once a run is removed, the next one starts at the first key left from `from` */
+     for (more = from == NULL ? first(this, &cursor) : lower_bound(this, from, &cursor);
+          more && before_end(this, cad_btree_key(&cursor), &range);
+          more = from == NULL ? first(this, &cursor) : lower_bound(this, from, &cursor)) {
+          result += remove_from(this, cad_btree_key(&cursor), &range);
+     }
+     return result;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void free_(struct cad_btree_impl *this) {
+     if (this->root != NULL) {
+          free_tree(this, this->root);
+     }
+     this->memory.free(this);
+}
+
+static unsigned int count(struct cad_btree_impl *this) {
+     return this->count;
+}
+
+static void iterate(struct cad_btree_impl *this, cad_btree_iterator_fn iterator, void *data) {
+     leaf_t *leaf;
+     unsigned int i;
+     int index = 0;
+     for (leaf = first_leaf(this); leaf != NULL; leaf = leaf->next) {
+          for (i = 0; i < leaf->node.count; i++) {
+               iterator(this, index++, leaf->node.keys[i], leaf->values[i], data);
+          }
+     }
+}
+
+static void *get(struct cad_btree_impl *this, const void *key) {
+     leaf_t *leaf = leaf_of(this, key);
+     unsigned int i;
+     if (leaf == NULL) {
+          return NULL;
+     }
+     i = lower_index(this, &(leaf->node), key);
+     if (i < leaf->node.count && this->comparator(leaf->node.keys[i], key) == 0) {
+          return leaf->values[i];
+     }
+     return NULL;
+}
+
+static int first(struct cad_btree_impl *this, cad_btree_cursor_t *cursor) {
+     return set_cursor(cursor, first_leaf(this), 0);
+}
+
+static int lower_bound(struct cad_btree_impl *this, const void *key, cad_btree_cursor_t *cursor) {
+     leaf_t *leaf = leaf_of(this, key);
+     return set_cursor(cursor, leaf, leaf == NULL ? 0 : lower_index(this, &(leaf->node), key));
+}
+
+static int upper_bound(struct cad_btree_impl *this, const void *key, cad_btree_cursor_t *cursor) {
+     leaf_t *leaf = leaf_of(this, key);
+     return set_cursor(cursor, leaf, leaf == NULL ? 0 : upper_index(this, &(leaf->node), key));
+}
+
+static cad_btree_t fn = {
+     (cad_btree_free_fn     )free_      ,
+     (cad_btree_count_fn    )count      ,
+     (cad_btree_iterate_fn  )iterate    ,
+     (cad_btree_get_fn      )get        ,
+     (cad_btree_set_fn      )set        ,
+     (cad_btree_del_fn      )del        ,
+     (cad_btree_del_range_fn)del_range  ,
+     (cad_btree_first_fn    )first      ,
+     (cad_btree_bound_fn    )lower_bound,
+     (cad_btree_bound_fn    )upper_bound,
+};
+
+__PUBLIC__ cad_btree_t *cad_new_btree(cad_memory_t memory, comparator_fn comparator) {
+     struct cad_btree_impl *result = memory.malloc(sizeof(struct cad_btree_impl));
+     if (!result) return NULL;
+     result->fn         = fn;
+     result->memory     = memory;
+     result->ex         = cad_memory_ex(memory);
+     result->comparator = comparator;
+     result->count      = 0;
+     result->root       = NULL;
+     return (cad_btree_t*)result;
+}
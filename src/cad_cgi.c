@@ -275,14 +275,15 @@ static char *no_value(cad_memory_t memory) {
    return result;
 }
 
-static cad_hash_t *parse_query_or_form(meta_impl *this, cad_input_stream_t *in) {
-   cad_hash_t *result = cad_new_hash(this->memory, cad_hash_strings);
+static cad_hash_t *parse_query_or_form(meta_impl *this, cad_input_stream_t *in, unsigned int expected) {
+   cad_hash_t *result = cad_new_hash(this->memory, cad_hash_packed_keys(cad_hash_strings_siphash));
    int s = 1;
    char *attribute = NULL;
    char *value = NULL;
    cad_output_stream_t *out = new_cad_output_stream_from_string(&attribute, this->memory);
    char encoded = 0;
    int c = in->item(in);
+   result->reserve(result, expected);
    while (c != -1 && s > 0) {
       switch(s) {
       case 1: // reading attribute
@@ -399,6 +400,19 @@ static cad_hash_t *parse_query_or_form(meta_impl *this, cad_input_stream_t *in)
    return result;
 }
 
+#define MAX_EXPECTED_FIELDS 1024
+
+static unsigned int count_fields(const char *query_string) {
+   unsigned int result = 1;
+   const char *c;
+   for (c = query_string; *c; c++) {
+      if (*c == '&') {
+         result++;
+      }
+   }
+   return result;
+}
+
 static cad_hash_t *query_string(meta_impl *this) {
    cad_hash_t *result = this->query_string;
    if (result == NULL) {
@@ -406,7 +420,7 @@ static cad_hash_t *query_string(meta_impl *this) {
       if (query_string != NULL) {
          cad_input_stream_t *in = new_cad_input_stream_from_string(query_string, this->memory);
          if (in != NULL) {
-            result = this->query_string = parse_query_or_form(this, in);
+            result = this->query_string = parse_query_or_form(this, in, count_fields(query_string));
             in->free(in);
          }
       }
@@ -419,7 +433,8 @@ static cad_hash_t *input_as_form(meta_impl *this) {
    if (result == NULL) {
       cad_input_stream_t *in = this->in;
       if (in != NULL) {
-         result = this->input_as_form = parse_query_or_form(this, in);
+         /* the body is not read yet: assume fields of about 16 bytes ("name=value&") */
+         result = this->input_as_form = parse_query_or_form(this, in, this->content_length > MAX_EXPECTED_FIELDS * 16 ? MAX_EXPECTED_FIELDS : this->content_length / 16);
          in->free(in);
       }
    }
@@ -685,12 +700,13 @@ static meta_impl *new_meta(cad_memory_t memory, cad_input_stream_t *in) {
    result->content_length = content_length;
    result->content_type.type = NULL;
    result->content_type.subtype = NULL;
-   result->content_type.parameters = cad_new_hash(memory, cad_hash_strings);
+   result->content_type.parameters = cad_new_hash(memory, cad_hash_packed_keys(cad_hash_strings_siphash));
    result->gateway_interface.major = 0;
    result->gateway_interface.minor = 0;
    result->path_info = NULL;
    result->path_translated = NULL;
    result->query_string = NULL;
+   result->input_as_form = NULL;
    result->remote_addr = NULL;
    result->remote_host = NULL;
    result->remote_ident = NULL;
@@ -853,11 +869,10 @@ static void flush_body(const char *body, cad_output_stream_t *out) {
    }
 }
 
-static void flush_header(void *hash, int index, const char *key, const char *value, response_impl *response) {
-   response->out->put(response->out, "%s: %s\r\n", key, value == NULL ? "" : value);
-}
-
 static int flush_response(response_impl *response) {
+   cad_hash_cursor_t cursor;
+   const char *value;
+   int more;
    response->out->put(response->out, "Content-Type: %s\r\n", response->content_type == NULL ? "text/plain" : response->content_type);
    response->out->put(response->out, "Status: %d\r\n", response->status == 0 ? 200 : response->status);
    if (response->redirect_path != NULL) {
@@ -867,7 +882,10 @@ static int flush_response(response_impl *response) {
          response->out->put(response->out, "Location: %s\r\n", response->redirect_path);
       }
    }
-   response->headers->iterate(response->headers, (cad_hash_iterator_fn)flush_header, response);
+   for (more = response->headers->first(response->headers, &cursor); more; more = cad_hash_next(&cursor)) {
+      value = cad_hash_value(&cursor);
+      response->out->put(response->out, "%s: %s\r\n", (const char*)cad_hash_key(&cursor), value == NULL ? "" : value);
+   }
    flush_cookies(response->cookies, response->out);
    response->out->put(response->out, "\r\n");
    flush_body(response->body, response->out);
@@ -899,7 +917,7 @@ static response_impl *new_cad_cgi_response(cad_memory_t memory, cad_input_stream
    result->redirect_fragment = NULL;
    result->status = 0;
    result->content_type = NULL;
-   result->headers = cad_new_hash(memory, cad_hash_strings);
+   result->headers = cad_new_hash(memory, cad_hash_packed_keys(cad_hash_strings_fast));
    result->meta = new_meta(memory, in);
    result->fd = fd;
    result->out = out;
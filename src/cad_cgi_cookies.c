@@ -167,6 +167,7 @@ cad_cgi_cookie_t *new_cad_cgi_cookie(cad_memory_t memory, const char *name) {
    result->expires = 0;
    result->max_age = 0;
    result->flag = Cookie_default;
+   result->value = NULL;
    result->domain = NULL;
    result->path = NULL;
    return (cad_cgi_cookie_t*)result;
@@ -203,19 +204,12 @@ static int set(cookies_impl *this, cad_cgi_cookie_t *cookie) {
    return 0;
 }
 
-typedef struct {
-   cad_cgi_cookie_iterator_fn iterator;
-   cad_cgi_cookies_t *jar;
-   void *data;
-} iterate_data_t;
-
-static void jar_iterate(void *hash, int index, const char *key, cad_cgi_cookie_t *cookie, iterate_data_t *data) {
-   data->iterator(data->jar, cookie, data->data);
-}
-
 static void iterate(cookies_impl *this, cad_cgi_cookie_iterator_fn iterator, void *data) {
-   iterate_data_t hash_data = {iterator, (cad_cgi_cookies_t*)this, data};
-   this->jar->iterate(this->jar, (cad_hash_iterator_fn)jar_iterate, &hash_data);
+   cad_hash_cursor_t cursor;
+   int more;
+   for (more = this->jar->first(this->jar, &cursor); more; more = cad_hash_next(&cursor)) {
+      iterator((cad_cgi_cookies_t*)this, cad_hash_value(&cursor), data);
+   }
 }
 
 static cad_cgi_cookies_t cookies_fn = {
@@ -352,7 +346,7 @@ cad_cgi_cookies_t *new_cookies(cad_memory_t memory) {
    if (!result) return NULL;
    result->fn = cookies_fn;
    result->memory = memory;
-   result->jar = cad_new_hash(memory, cad_hash_strings);
+   result->jar = cad_new_hash(memory, cad_hash_borrowed_keys(cad_hash_strings_siphash)); // keys are the cookie names
 
    const char *http_cookie = getenv("HTTP_COOKIE");
    if (http_cookie != NULL) {
@@ -422,7 +416,7 @@ static char *encode_value(const char *value, cad_memory_t memory) {
    return result;
 }
 
-static void flush_cookie(void *hash, int index, const char *key, cookie_impl *cookie, cad_output_stream_t *out) {
+static void flush_cookie(cookie_impl *cookie, cad_output_stream_t *out) {
    if (cookie->changed) {
       char *encoded_value = encode_value(cookie->value, cookie->memory);
       out->put(out, "Set-Cookie: %s=%s", cookie->name, cookie->value == NULL ? "" : encoded_value);
@@ -455,5 +449,9 @@ static void flush_cookie(void *hash, int index, const char *key, cookie_impl *co
 
 void flush_cookies(cad_cgi_cookies_t *cookies, cad_output_stream_t *out) {
    cookies_impl *this = (cookies_impl*)cookies;
-   this->jar->iterate(this->jar, (cad_hash_iterator_fn)flush_cookie, out);
+   cad_hash_cursor_t cursor;
+   int more;
+   for (more = this->jar->first(this->jar, &cursor); more; more = cad_hash_next(&cursor)) {
+      flush_cookie(cad_hash_value(&cursor), out);
+   }
 }
@@ -0,0 +1,544 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the implementation of persistent hash maps.
+ *
+ * The trie consumes the hash of the keys 5 bits at a time: each node
+ * has a 32-bit bitmap of its present children, which are packed in an
+ * array. A child is a leaf (one key), another node, or a collision
+ * node (the keys that share the same full hash).
+ *
+ * Nodes and leaves are immutable and reference-counted: a new version
+ * copies the nodes on the path to the key it changes, and shares all
+ * the other ones. A leaf owns its cloned key. Removing keys collapses
+ * the nodes left with a single leaf, so that a set of keys always
+ * gives the same trie.
+ */
+
+#include "cad_hash_internal.h"
+#include "cad_hamt.h"
+#include "cad_memory_internal.h"
+
+#define BITS 5
+#define chunk_of(hash, shift) (((hash) >> (shift)) & 31)
+
+enum kind {
+     kind_leaf,
+     kind_node,
+     kind_collision,
+};
+
+typedef struct object {
+     int refcount;
+     int kind;
+} object_t;
+
+typedef struct leaf {
+     object_t object;
+     unsigned int hash;
+     const void *key;
+     void *value;
+} leaf_t;
+
+typedef struct node {
+     object_t object;
+     unsigned int bitmap;
+     object_t *children[];
+} node_t;
+
+typedef struct collision {
+     object_t object;
+     unsigned int hash;
+     unsigned int count;
+     leaf_t *leaves[];
+} collision_t;
+
+#define children_of(node) ((node)->children)
+#define leaves_of(collision) ((collision)->leaves)
+#define size_of(node) __builtin_popcount((node)->bitmap)
+
+struct cad_hamt_impl {
+     cad_hamt_t fn;
+     cad_memory_t memory;
+     cad_memory_ex_t *ex;
+     cad_hash_keys_t keys;
+     hash_seed_t seed;   /* shared by all the versions */
+     unsigned int count;
+     node_t *root;       /* NULL if empty */
+};
+
+static void *new_object(struct cad_hamt_impl *this, int kind, size_t size) {
+     object_t *result = this->memory.malloc(size);
+     if (result != NULL) {
+          result->refcount = 1;
+          result->kind     = kind;
+     }
+     return result;
+}
+
+static object_t *retain(object_t *object) {
+     __sync_add_and_fetch(&(object->refcount), 1);
+     return object;
+}
+
+static void release(struct cad_hamt_impl *this, object_t *object) {
+     node_t *node;
+     collision_t *collision;
+     unsigned int i, n;
+
+     if (object == NULL || __sync_sub_and_fetch(&(object->refcount), 1) > 0) {
+          return;
+     }
+     switch (object->kind) {
+     case kind_leaf:
+          free_hash_key(this->memory, &(this->keys), ((leaf_t*)object)->key);
+          memory_free_sized(this->memory, this->ex, object, sizeof(leaf_t));
+          break;
+     case kind_node:
+          node = (node_t*)object;
+          n = size_of(node);
+          for (i = 0; i < n; i++) {
+               release(this, children_of(node)[i]);
+          }
+          memory_free_sized(this->memory, this->ex, object, sizeof(node_t) + n * sizeof(object_t*));
+          break;
+     case kind_collision:
+          collision = (collision_t*)object;
+          for (i = 0; i < collision->count; i++) {
+               release(this, &(leaves_of(collision)[i]->object));
+          }
+          memory_free_sized(this->memory, this->ex, object, sizeof(collision_t) + collision->count * sizeof(leaf_t*));
+          break;
+     }
+}
+
+static node_t *new_node(struct cad_hamt_impl *this, unsigned int bitmap) {
+     node_t *result = new_object(this, kind_node, sizeof(node_t) + __builtin_popcount(bitmap) * sizeof(object_t*));
+     if (result != NULL) {
+          result->bitmap = bitmap;
+     }
+     return result;
+}
+
+static collision_t *new_collision(struct cad_hamt_impl *this, unsigned int hash, unsigned int count) {
+     collision_t *result = new_object(this, kind_collision, sizeof(collision_t) + count * sizeof(leaf_t*));
+     if (result != NULL) {
+          result->hash  = hash;
+          result->count = count;
+     }
+     return result;
+}
+
+/* The hash of the keys under a leaf or a collision node. */
+static unsigned int hash_of(object_t *object) {
+     return object->kind == kind_leaf ? ((leaf_t*)object)->hash : ((collision_t*)object)->hash;
+}
+
+static int is_key(struct cad_hamt_impl *this, leaf_t *leaf, const void *key, unsigned int hash) {
+     return leaf->hash == hash && (leaf->key == key || this->keys.compare(leaf->key, key) == 0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+ * Ownership: the functions below take the references they are given
+ * (except `node` and `collision`, only read), and return new objects
+ * with one reference, or NULL on error after releasing what they
+ * took.
+ */
+
+/* A copy of the node where the `i`-th child is replaced by `child`. */
+static node_t *copy_with(struct cad_hamt_impl *this, node_t *node, unsigned int i, object_t *child) {
+     node_t *result = new_node(this, node->bitmap);
+     unsigned int j, n = size_of(node);
+     if (result == NULL) {
+          release(this, child);
+          return NULL;
+     }
+     for (j = 0; j < n; j++) {
+          children_of(result)[j] = j == i ? child : retain(children_of(node)[j]);
+     }
+     return result;
+}
+
+/* A node with both `a` (a leaf or a collision node) and `leaf`, of different hashes. */
+static node_t *pair(struct cad_hamt_impl *this, object_t *a, leaf_t *leaf, unsigned int shift) {
+     unsigned int ca = chunk_of(hash_of(a), shift), cb = chunk_of(leaf->hash, shift);
+     object_t *child;
+     node_t *result;
+     if (ca == cb) {
+          child = (object_t*)pair(this, a, leaf, shift + BITS);
+          if (child == NULL) {
+               return NULL;
+          }
+          result = new_node(this, 1U << ca);
+          if (result == NULL) {
+               release(this, child);
+               return NULL;
+          }
+          children_of(result)[0] = child;
+          return result;
+     }
+     result = new_node(this, (1U << ca) | (1U << cb));
+     if (result == NULL) {
+          release(this, a);
+          release(this, &(leaf->object));
+          return NULL;
+     }
+     children_of(result)[ca < cb ? 0 : 1] = a;
+     children_of(result)[ca < cb ? 1 : 0] = &(leaf->object);
+     return result;
+}
+
+static object_t *insert(struct cad_hamt_impl *this, object_t *object, unsigned int shift, leaf_t *leaf, int *added);
+
+static object_t *insert_collision(struct cad_hamt_impl *this, collision_t *collision, unsigned int shift, leaf_t *leaf, int *added) {
+     collision_t *result;
+     unsigned int i, j, n = collision->count;
+     if (leaf->hash != collision->hash) {
+          *added = 1;
+          return (object_t*)pair(this, retain(&(collision->object)), leaf, shift);
+     }
+     for (i = 0; i < n && !is_key(this, leaves_of(collision)[i], leaf->key, leaf->hash); i++) {
+     }
+     *added = i == n;
+     result = new_collision(this, collision->hash, *added ? n + 1 : n);
+     if (result == NULL) {
+          release(this, &(leaf->object));
+          return NULL;
+     }
+     for (j = 0; j < n; j++) {
+          if (j != i) {
+               leaves_of(result)[j] = (leaf_t*)retain(&(leaves_of(collision)[j]->object));
+          }
+     }
+     leaves_of(result)[i] = leaf;
+     return &(result->object);
+}
+
+static object_t *insert(struct cad_hamt_impl *this, object_t *object, unsigned int shift, leaf_t *leaf, int *added) {
+     node_t *node = (node_t*)object, *result;
+     object_t *child;
+     unsigned int bit, i, j, n;
+     collision_t *collision;
+
+     if (object->kind == kind_collision) {
+          return insert_collision(this, (collision_t*)object, shift, leaf, added);
+     }
+
+     bit = 1U << chunk_of(leaf->hash, shift);
+     i = __builtin_popcount(node->bitmap & (bit - 1));
+     if (!(node->bitmap & bit)) {
+          *added = 1;
+          n = size_of(node);
+          result = new_node(this, node->bitmap | bit);
+          if (result == NULL) {
+               release(this, &(leaf->object));
+               return NULL;
+          }
+          for (j = 0; j < n; j++) {
+               children_of(result)[j < i ? j : j + 1] = retain(children_of(node)[j]);
+          }
+          children_of(result)[i] = &(leaf->object);
+          return &(result->object);
+     }
+
+     child = children_of(node)[i];
+     if (child->kind != kind_leaf) {
+          child = insert(this, child, shift + BITS, leaf, added);
+     } else if (is_key(this, (leaf_t*)child, leaf->key, leaf->hash)) {
+          *added = 0;
+          child = &(leaf->object);
+     } else if (((leaf_t*)child)->hash == leaf->hash) {
+          *added = 1;
+          collision = new_collision(this, leaf->hash, 2);
+          if (collision == NULL) {
+               release(this, &(leaf->object));
+               return NULL;
+          }
+          leaves_of(collision)[0] = (leaf_t*)retain(child);
+          leaves_of(collision)[1] = leaf;
+          child = &(collision->object);
+     } else {
+          *added = 1;
+          child = (object_t*)pair(this, retain(child), leaf, shift + BITS);
+     }
+     if (child == NULL) {
+          return NULL;
+     }
+     return (object_t*)copy_with(this, node, i, child);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+ * Returns the object without the key: the object itself (not
+ * retained) if the key is not there, NULL if nothing is left, or a
+ * new object. `*removed` is 1 if the key was removed, 0 if it was
+ * not there, -1 on error.
+ */
+static object_t *remove_key(struct cad_hamt_impl *this, object_t *object, unsigned int shift, const void *key, unsigned int hash, int *removed);
+
+static object_t *remove_collision(struct cad_hamt_impl *this, collision_t *collision, const void *key, unsigned int hash, int *removed) {
+     collision_t *result;
+     unsigned int i, j, n = collision->count;
+     for (i = 0; i < n && !is_key(this, leaves_of(collision)[i], key, hash); i++) {
+     }
+     if (i == n) {
+          *removed = 0;
+          return &(collision->object);
+     }
+     *removed = 1;
+     if (n == 2) {
+          return retain(&(leaves_of(collision)[1 - i]->object));
+     }
+     result = new_collision(this, hash, n - 1);
+     if (result == NULL) {
+          *removed = -1;
+          return NULL;
+     }
+     for (j = 0; j < n; j++) {
+          if (j != i) {
+               leaves_of(result)[j < i ? j : j - 1] = (leaf_t*)retain(&(leaves_of(collision)[j]->object));
+          }
+     }
+     return &(result->object);
+}
+
+static object_t *remove_key(struct cad_hamt_impl *this, object_t *object, unsigned int shift, const void *key, unsigned int hash, int *removed) {
+     node_t *node = (node_t*)object, *result;
+     object_t *child, *sub;
+     unsigned int bit, i, j, n;
+
+     if (object->kind == kind_collision) {
+          return remove_collision(this, (collision_t*)object, key, hash, removed);
+     }
+
+     bit = 1U << chunk_of(hash, shift);
+     if (!(node->bitmap & bit)) {
+          *removed = 0;
+          return object;
+     }
+     i = __builtin_popcount(node->bitmap & (bit - 1));
+     n = size_of(node);
+     child = children_of(node)[i];
+     if (child->kind == kind_leaf) {
+          if (!is_key(this, (leaf_t*)child, key, hash)) {
+               *removed = 0;
+               return object;
+          }
+          *removed = 1;
+          sub = NULL;
+     } else {
+          sub = remove_key(this, child, shift + BITS, key, hash, removed);
+          if (*removed != 1) {
+               return *removed == 0 ? object : NULL;
+          }
+     }
+
+     if (sub == NULL) {
+          if (n == 1) {
+               return NULL;
+          }
+          if (n == 2 && shift > 0 && children_of(node)[1 - i]->kind != kind_node) {
+               /* collapse: the parent holds the last leaf directly */
+               return retain(children_of(node)[1 - i]);
+          }
+          result = new_node(this, node->bitmap & ~bit);
+          if (result == NULL) {
+               *removed = -1;
+               return NULL;
+          }
+          for (j = 0; j < n; j++) {
+               if (j != i) {
+                    children_of(result)[j < i ? j : j - 1] = retain(children_of(node)[j]);
+               }
+          }
+          return &(result->object);
+     }
+     if (n == 1 && shift > 0 && sub->kind != kind_node) {
+          return sub;
+     }
+     result = copy_with(this, node, i, sub);
+     if (result == NULL) {
+          *removed = -1;
+     }
+     return (object_t*)result;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static cad_hamt_t fn;
+
+/* A new version of the map, that takes the reference of `root`. */
+static struct cad_hamt_impl *new_version(struct cad_hamt_impl *this, node_t *root, unsigned int count) {
+     struct cad_hamt_impl *result = this->memory.malloc(sizeof(struct cad_hamt_impl));
+     if (result == NULL) {
+          release(this, (object_t*)root);
+          return NULL;
+     }
+     *result = *this;
+     result->root  = root;
+     result->count = count;
+     return result;
+}
+
+static void free_(struct cad_hamt_impl *this) {
+     release(this, (object_t*)this->root);
+     this->memory.free(this);
+}
+
+static unsigned int count(struct cad_hamt_impl *this) {
+     return this->count;
+}
+
+static void iterate_object(struct cad_hamt_impl *this, object_t *object, int *index, cad_hash_iterator_fn iterator, void *data) {
+     leaf_t *leaf;
+     unsigned int i, n;
+     switch (object->kind) {
+     case kind_leaf:
+          leaf = (leaf_t*)object;
+          iterator(this, (*index)++, leaf->key, leaf->value, data);
+          break;
+     case kind_node:
+          n = size_of((node_t*)object);
+          for (i = 0; i < n; i++) {
+               iterate_object(this, children_of((node_t*)object)[i], index, iterator, data);
+          }
+          break;
+     case kind_collision:
+          for (i = 0; i < ((collision_t*)object)->count; i++) {
+               iterate_object(this, &(leaves_of((collision_t*)object)[i]->object), index, iterator, data);
+          }
+          break;
+     }
+}
+
+static void iterate(struct cad_hamt_impl *this, cad_hash_iterator_fn iterator, void *data) {
+     int index = 0;
+     if (this->root != NULL) {
+          iterate_object(this, &(this->root->object), &index, iterator, data);
+     }
+}
+
+static void *get(struct cad_hamt_impl *this, const void *key) {
+     unsigned int hash, bit, shift = 0, i;
+     object_t *object = (object_t*)this->root;
+     collision_t *collision;
+
+     if (object == NULL) {
+          return NULL;
+     }
+     hash = hash_key(&(this->keys), &(this->seed), key);
+     while (object->kind == kind_node) {
+          bit = 1U << chunk_of(hash, shift);
+          if (!(((node_t*)object)->bitmap & bit)) {
+               return NULL;
+          }
+          object = children_of((node_t*)object)[__builtin_popcount(((node_t*)object)->bitmap & (bit - 1))];
+          shift += BITS;
+     }
+     if (object->kind == kind_leaf) {
+          return is_key(this, (leaf_t*)object, key, hash) ? ((leaf_t*)object)->value : NULL;
+     }
+     collision = (collision_t*)object;
+     for (i = 0; i < collision->count; i++) {
+          if (is_key(this, leaves_of(collision)[i], key, hash)) {
+               return leaves_of(collision)[i]->value;
+          }
+     }
+     return NULL;
+}
+
+static cad_hamt_t *with(struct cad_hamt_impl *this, const void *key, void *value) {
+     leaf_t *leaf = new_object(this, kind_leaf, sizeof(leaf_t));
+     node_t *root;
+     int added = 1;
+
+     if (leaf == NULL) {
+          return NULL;
+     }
+     leaf->hash  = hash_key(&(this->keys), &(this->seed), key);
+     leaf->value = value;
+     leaf->key   = clone_hash_key(this->memory, &(this->keys), key);
+     if (leaf->key == NULL && key != NULL) {
+          memory_free_sized(this->memory, this->ex, leaf, sizeof(leaf_t));
+          return NULL;
+     }
+
+     if (this->root == NULL) {
+          root = new_node(this, 1U << chunk_of(leaf->hash, 0));
+          if (root != NULL) {
+               children_of(root)[0] = &(leaf->object);
+          } else {
+               release(this, &(leaf->object));
+          }
+     } else {
+          root = (node_t*)insert(this, &(this->root->object), 0, leaf, &added);
+     }
+     if (root == NULL) {
+          return NULL;
+     }
+     return (cad_hamt_t*)new_version(this, root, this->count + added);
+}
+
+static cad_hamt_t *without(struct cad_hamt_impl *this, const void *key) {
+     object_t *root;
+     int removed = 0;
+     if (this->root == NULL) {
+          return (cad_hamt_t*)new_version(this, NULL, 0);
+     }
+     root = remove_key(this, &(this->root->object), 0, key, hash_key(&(this->keys), &(this->seed), key), &removed);
+     switch (removed) {
+     case 0:
+          return (cad_hamt_t*)new_version(this, (node_t*)retain(root), this->count);
+     case 1:
+          return (cad_hamt_t*)new_version(this, (node_t*)root, this->count - 1);
+     default:
+          return NULL;
+     }
+}
+
+static cad_hamt_t *snapshot(struct cad_hamt_impl *this) {
+     return (cad_hamt_t*)new_version(this, this->root == NULL ? NULL : (node_t*)retain(&(this->root->object)), this->count);
+}
+
+static cad_hamt_t fn = {
+     (cad_hamt_free_fn    )free_   ,
+     (cad_hamt_count_fn   )count   ,
+     (cad_hamt_iterate_fn )iterate ,
+     (cad_hamt_get_fn     )get     ,
+     (cad_hamt_with_fn    )with    ,
+     (cad_hamt_without_fn )without ,
+     (cad_hamt_snapshot_fn)snapshot,
+};
+
+__PUBLIC__ cad_hamt_t *cad_new_hamt(cad_memory_t memory, cad_hash_keys_t keys) {
+     struct cad_hamt_impl *result = memory.malloc(sizeof(struct cad_hamt_impl));
+     if (!result) return NULL;
+     result->fn     = fn;
+     result->memory = memory;
+     result->ex     = cad_memory_ex(memory);
+     result->keys   = keys;
+     result->count  = 0;
+     result->root   = NULL;
+     init_hash_seed(&(result->seed));
+     return (cad_hamt_t*)result;
+}
@@ -21,10 +21,25 @@
  * This file contains the implementation of hash tables. That
  * implementation is a general-purpose hashing table.
  *
- * The original hashing algorithm comes from Python; implementation
- * and bugs are mine.
+ * The index follows the "Swiss table" design: each slot has a control
+ * byte that is either EMPTY, DELETED, or the low 7 bits of the hash of
+ * the key stored in the slot. Slots are probed by groups of 16 control
+ * bytes, compared all at once (with SSE2 when available); keys are
+ * only compared when the 7-bit tag matches.
+ *
+ * The slots do not hold the entries themselves but their position in
+ * a dense array of entries, kept in insertion order (like the "compact
+ * dict" of CPython 3.6+). Iteration is a linear scan of that array,
+ * and deleted entries leave holes that are squeezed out when the array
+ * is full.
+ *
+ * Growing is incremental: the old arrays are kept while the entries
+ * are moved, a few at a time, to the new ones. Squeezing the holes out
+ * goes the same way, into new arrays of the same capacity.
  */
 
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <string.h>
 #include <sys/types.h>
@@ -32,9 +47,13 @@
 #include <fcntl.h>
 #include <unistd.h>
 
-#include "cad_hash.h"
+#include "cad_hash_internal.h"
+#include "cad_intern.h"
+#include "cad_memory_internal.h"
 
-#define PERTURB_SHIFT 5
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+#define MIGRATE_STEP 64 /* entries added to the new index by each operation */
+#define SMALL_SIZE 8    /* entries kept in the hash table object, without an index */
 
 typedef struct cad_hash_key {
      const void *key;
@@ -46,17 +65,61 @@ typedef struct cad_hash_entry {
      void            *value;
 } cad_hash_entry_t;
 
+/*
+ * The index maps the keys to their position in the entries
+ * array. Positions are stored on 1, 2 or 4 bytes depending on the
+ * capacity: small tables have a small index.
+ */
+typedef struct index {
+     unsigned int capacity; /* 0, or a power of two not less than GROUP_SIZE */
+     unsigned int used;     /* full and deleted slots */
+     unsigned int width;    /* size of a position */
+     unsigned char *ctrl;
+     void *positions;
+} index_t;
+
+#define is_packed(this) ((this)->keys.clone == NULL && (this)->keys.size != NULL)
+#define is_borrowed(this) ((this)->keys.clone == NULL && (this)->keys.size == NULL)
+
 struct cad_hash_impl {
      cad_hash_t fn;
      cad_memory_t memory;
+     cad_memory_ex_t *ex;
      cad_hash_keys_t   keys;
+     key_chunk_t *key_chunks;
+     size_t key_garbage;    /* bytes of deleted packed keys */
 
-     int capacity;
-     int count;
-     int salt;
-     cad_hash_entry_t *entries;
+     unsigned int count;
+     hash_seed_t seed;
+     cad_hash_entry_t *entries;     /* in insertion order, with holes left by del */
+     unsigned int entries_capacity; /* MAX_LOAD(index.capacity) */
+     unsigned int entries_used;     /* live entries and holes */
+     index_t index;
+
+     /* during a migration: the old arrays; their entries are moved to
+      * the front of the new ones, and the new entries are appended from
+      * `append_base` on */
+     cad_hash_entry_t *old_entries;
+     unsigned int old_entries_capacity;
+     unsigned int old_entries_used;
+     index_t old;
+     unsigned int migrated;    /* the old entries before that one are moved */
+     unsigned int moved;       /* the position of the next moved entry */
+     unsigned int append_base;
+
+     unsigned int grows;
+     unsigned int rehashes;
+
+     /* the entries of small tables (when the index capacity is 0) */
+     cad_hash_entry_t small[SMALL_SIZE];
 };
 
+static const char hole;
+#define HOLE ((const void*)&hole)
+#define is_hole(entry) ((entry)->key.key == HOLE)
+
+#define is_small(this) ((this)->index.capacity == 0)
+
 static unsigned int string_hash(const char *key) {
      unsigned int result = 0;
      while (*key) {
@@ -66,212 +129,844 @@ static unsigned int string_hash(const char *key) {
      return result;
 }
 
+static size_t string_size(const char *key) {
+     return strlen(key) + 1;
+}
+
 __PUBLIC__ cad_hash_keys_t cad_hash_strings = {
      (cad_hash_keys_hash_fn)string_hash,
      (cad_hash_keys_compare_fn)strcmp,
      (cad_hash_keys_clone_fn)strdup,
      (cad_hash_keys_free_fn)free,
+     NULL,
+     (cad_hash_keys_size_fn)string_size,
 };
 
-static cad_hash_key_t hash(const char *key, cad_hash_keys_t keys, int salt) {
-     cad_hash_key_t result = { key, keys.hash(key) + salt };
-     return result;
+/*
+ * Integer and pointer keys are the key pointer itself: they are
+ * stored in the entries as they are, never cloned nor freed. The hash
+ * table recognizes them and inlines their hash and comparison.
+ *
+ * Only the HOLE address cannot be a key: set() refuses it. No pointer
+ * given by the user can be equal to it.
+ */
+
+static unsigned int word_hash(const void *key) {
+     unsigned long long word = (unsigned long long)(uintptr_t)key;
+     return (unsigned int)(word ^ (word >> 32));
+}
+
+static int word_compare(const void *key1, const void *key2) {
+     return key1 != key2;
 }
 
-typedef struct index_context {
-     unsigned int index;
-     unsigned int perturb;
-} index_context_t;
+#define is_words(keys) ((keys)->compare == word_compare)
 
-static void next_index_of(index_context_t *context) {
-     context->index = (5 * context->index) + 1 + context->perturb;
-     context->perturb >>= PERTURB_SHIFT;
+__PUBLIC__ cad_hash_keys_t cad_hash_ints = {
+     word_hash,
+     word_compare,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+};
+
+/* the same keys manager under other names: a pointer is a word too */
+__PUBLIC__ extern cad_hash_keys_t cad_hash_pointers __attribute__((alias("cad_hash_ints")));
+__PUBLIC__ extern cad_hash_keys_t cad_hash_atoms __attribute__((alias("cad_hash_ints")));
+
+__PUBLIC__ cad_hash_keys_t cad_hash_borrowed_keys(cad_hash_keys_t keys) {
+     keys.clone = NULL;
+     keys.free  = NULL;
+     keys.size  = NULL;
+     return keys;
 }
 
-static int index_of(cad_hash_entry_t *entries, cad_hash_keys_t keys, int capacity, cad_hash_key_t key, index_context_t *save_context) {
-     int result;
-     const void *k;
-     int found;
-     cad_hash_keys_compare_fn cmp = keys.compare;
+__PUBLIC__ cad_hash_keys_t cad_hash_packed_keys(cad_hash_keys_t keys) {
+     keys.clone = NULL;
+     keys.free  = NULL;
+     return keys;
+}
 
-     index_context_t context = {
-          key.hash,
-          key.hash,
-     };
+/* The user hash functions are not expected to spread their bits: the
+ * tag and the group both need good low and high bits, hence this
+ * final mix (from MurmurHash3). */
+static unsigned int mix(unsigned int h) {
+     h ^= h >> 16;
+     h *= 0x85ebca6b;
+     h ^= h >> 13;
+     h *= 0xc2b2ae35;
+     h ^= h >> 16;
+     return h;
+}
 
-     result = context.index % capacity;
-     k = entries[result].key.key;
-     found = k ? !cmp(key.key, k) : 1;
+unsigned int hash_key(const cad_hash_keys_t *keys, const hash_seed_t *seed, const void *key) {
+     if (is_words(keys)) {
+          return mix(word_hash(key) + seed->salt);
+     }
+     if (keys->salted_hash != NULL) {
+          return keys->salted_hash(key, seed->key);
+     }
+     return mix(keys->hash(key) + seed->salt);
+}
 
-     while (!found) {
-          next_index_of(&context);
-          result = context.index % capacity;
-          k = entries[result].key.key;
-          found = k ? !cmp(key.key, k) : 1;
+const void *clone_hash_key(cad_memory_t memory, const cad_hash_keys_t *keys, const void *key) {
+     void *result;
+     size_t size;
+     if (keys->clone != NULL) {
+          return keys->clone(key);
+     }
+     if (keys->size == NULL) {
+          return key; /* borrowed */
+     }
+     size = keys->size(key);
+     result = memory.malloc(size);
+     if (result != NULL) {
+          memcpy(result, key, size);
      }
+     return result;
+}
 
-     if (!k) result = -result - 1;
+void free_hash_key(cad_memory_t memory, const cad_hash_keys_t *keys, const void *key) {
+     if (keys->clone != NULL) {
+          keys->free((void*)key);
+     } else if (keys->size != NULL) {
+          memory.free((void*)key);
+     }
+}
+
+static cad_hash_key_t hash(struct cad_hash_impl *this, const void *key) {
+     cad_hash_key_t result = { key, hash_key(&(this->keys), &(this->seed), key) };
+     return result;
+}
 
-     if (save_context) *save_context = context;
+static key_chunk_t *new_key_chunk(cad_memory_t memory, size_t capacity) {
+     key_chunk_t *result = memory.malloc(KEY_CHUNK_HEADER + capacity);
+     if (result != NULL) {
+          result->capacity = capacity;
+          result->used     = 0;
+     }
+     return result;
+}
 
+const void *pack_key(cad_memory_t memory, key_chunk_t **chunks, const void *key, size_t size) {
+     size_t need = KEY_ALIGNED(size);
+     key_chunk_t *chunk = *chunks;
+     char *result;
+     if (need > KEY_CHUNK_SIZE / 4) {
+          /* big keys get their own chunk, kept behind the one in use */
+          chunk = new_key_chunk(memory, need);
+          if (chunk == NULL) {
+               return NULL;
+          }
+          if (*chunks == NULL) {
+               chunk->next = NULL;
+               *chunks = chunk;
+          } else {
+               chunk->next = (*chunks)->next;
+               (*chunks)->next = chunk;
+          }
+     } else if (chunk == NULL || chunk->used + need > chunk->capacity) {
+          chunk = new_key_chunk(memory, KEY_CHUNK_SIZE);
+          if (chunk == NULL) {
+               return NULL;
+          }
+          chunk->next = *chunks;
+          *chunks = chunk;
+     }
+     result = (char*)chunk + KEY_CHUNK_HEADER + chunk->used;
+     chunk->used += need;
+     memcpy(result, key, size);
      return result;
 }
 
-static void rehash(struct cad_hash_impl *this) {
-     int i, index;
-     cad_hash_key_t key;
-
-     for (i = 0; i < this->capacity; i++) {
-          key = this->entries[i].key;
-          if (key.key) {
-             index = index_of(this->entries, this->keys, this->capacity, key, NULL);
-               if (index < 0) {
-                    // broken collision cycle, fix it
-                    index = -index - 1;
-                    this->entries[index].key   = key;
-                    this->entries[index].value = this->entries[i].value;
-                    this->entries[i].key.key = NULL;
-                    this->entries[i].value   = NULL;
-                    i = -1; // restart
+void free_key_chunks(cad_memory_t memory, cad_memory_ex_t *ex, key_chunk_t *chunks) {
+     key_chunk_t *next;
+     while (chunks != NULL) {
+          next = chunks->next;
+          memory_free_sized(memory, ex, chunks, KEY_CHUNK_HEADER + chunks->capacity);
+          chunks = next;
+     }
+}
+
+static const void *clone_key(struct cad_hash_impl *this, const void *key) {
+     if (is_packed(this)) {
+          return pack_key(this->memory, &(this->key_chunks), key, this->keys.size(key));
+     }
+     if (is_borrowed(this)) {
+          return key;
+     }
+     return this->keys.clone(key);
+}
+
+static void free_key(struct cad_hash_impl *this, const void *key) {
+     if (is_packed(this)) {
+          this->key_garbage += KEY_ALIGNED(this->keys.size(key));
+     } else if (!is_borrowed(this)) {
+          this->keys.free((void*)key);
+     }
+}
+
+static unsigned int position(const index_t *index, unsigned int slot) {
+     switch (index->width) {
+     case 1:  return ((unsigned char *)index->positions)[slot];
+     case 2:  return ((unsigned short*)index->positions)[slot];
+     default: return ((unsigned int  *)index->positions)[slot];
+     }
+}
+
+static void set_position(index_t *index, unsigned int slot, unsigned int position) {
+     switch (index->width) {
+     case 1:  ((unsigned char *)index->positions)[slot] = (unsigned char )position; break;
+     case 2:  ((unsigned short*)index->positions)[slot] = (unsigned short)position; break;
+     default: ((unsigned int  *)index->positions)[slot] = position;                 break;
+     }
+}
+
+/* Returns the slot of the key in the index of those entries, or -1 if not found. */
+static int slot_of(struct cad_hash_impl *this, index_t *index, cad_hash_entry_t *entries, cad_hash_key_t key) {
+     cad_hash_keys_compare_fn cmp = this->keys.compare;
+     int words = is_words(&(this->keys));
+     unsigned char tag = tag_of(key.hash);
+     const unsigned char *group;
+     cad_hash_entry_t *entry;
+     unsigned int match;
+     int slot;
+     probe_t probe;
+
+     if (index->capacity == 0) {
+          return -1;
+     }
+     start_probe(&probe, index->capacity, key.hash);
+     for (;;) {
+          group = index->ctrl + probe.group * GROUP_SIZE;
+          for (match = match_tag(group, tag); match != 0; match &= match - 1) {
+               slot = probe.group * GROUP_SIZE + __builtin_ctz(match);
+               entry = entries + position(index, slot);
+               if (entry->key.hash == key.hash && !is_hole(entry)
+                   && (words ? key.key == entry->key.key : !cmp(key.key, entry->key.key))) {
+                    return slot;
                }
           }
+          if (match_empty(group)) {
+               return -1;
+          }
+          next_probe(&probe);
      }
 }
 
-static void grow(struct cad_hash_impl *this, int grow_factor) {
-     int new_capacity;
-     cad_hash_entry_t *new_entries;
-     cad_hash_entry_t field;
-     int i, index;
-     if (this->capacity == 0) {
-          new_capacity = grow_factor * grow_factor;
-          this->entries = (cad_hash_entry_t *)this->memory.malloc(new_capacity * sizeof(cad_hash_entry_t));
-          memset(this->entries, 0, new_capacity * sizeof(cad_hash_entry_t));
+/* Returns the first free (empty or deleted) slot on the key's probe sequence. */
+static int free_slot_of(index_t *index, unsigned int hash) {
+     unsigned int match;
+     probe_t probe;
+     start_probe(&probe, index->capacity, hash);
+     for (;;) {
+          match = match_free(index->ctrl + probe.group * GROUP_SIZE);
+          if (match != 0) {
+               return probe.group * GROUP_SIZE + __builtin_ctz(match);
+          }
+          next_probe(&probe);
      }
-     else {
-          new_capacity = this->capacity * grow_factor;
-          new_entries = (cad_hash_entry_t *)this->memory.malloc(new_capacity * sizeof(cad_hash_entry_t));
-          memset(new_entries, 0, new_capacity * sizeof(cad_hash_entry_t));
-          for (i = 0; i < this->capacity; i++) {
-               field = this->entries[i];
-               if (field.key.key) {
-                    index = -index_of(new_entries, this->keys, new_capacity, field.key, NULL) - 1;
-                    new_entries[index] = field;
+}
+
+static void insert_position(index_t *index, unsigned int hash, unsigned int position) {
+     int slot = free_slot_of(index, hash);
+     if (index->ctrl[slot] == CTRL_EMPTY) {
+          index->used++;
+     }
+     index->ctrl[slot] = tag_of(hash);
+     set_position(index, slot, position);
+}
+
+static void remove_slot(index_t *index, int slot) {
+     if (match_empty(index->ctrl + (slot & ~(GROUP_SIZE - 1)))) {
+          /* the group was never full, so no probe sequence went past
+           * it: the slot can be emptied */
+          index->ctrl[slot] = CTRL_EMPTY;
+          index->used--;
+     } else {
+          /* leave a tombstone: the probe sequences going through that
+           * slot must not be broken */
+          index->ctrl[slot] = CTRL_DELETED;
+     }
+}
+
+/* Small tables have no index: their few entries are scanned, the hash first. */
+static cad_hash_entry_t *scan(struct cad_hash_impl *this, cad_hash_key_t key) {
+     cad_hash_keys_compare_fn cmp = this->keys.compare;
+     int words = is_words(&(this->keys));
+     cad_hash_entry_t *entry;
+     unsigned int i;
+     for (i = 0; i < this->entries_used; i++) {
+          entry = this->entries + i;
+          if (entry->key.hash == key.hash && !is_hole(entry)
+              && (words ? key.key == entry->key.key : !cmp(key.key, entry->key.key))) {
+               return entry;
+          }
+     }
+     return NULL;
+}
+
+/* Returns the entry of the key (and its index and slot, -1 for small tables), or NULL if not found. */
+static cad_hash_entry_t *lookup(struct cad_hash_impl *this, cad_hash_key_t key, index_t **index, int *slot) {
+     *index = &(this->index);
+     if (is_small(this)) {
+          *slot = -1;
+          return scan(this, key);
+     }
+     *slot = slot_of(this, *index, this->entries, key);
+     if (*slot >= 0) {
+          return this->entries + position(*index, *slot);
+     }
+     if (this->old_entries != NULL) {
+          *index = &(this->old);
+          *slot = slot_of(this, *index, this->old_entries, key);
+          if (*slot >= 0) {
+               return this->old_entries + position(*index, *slot);
+          }
+     }
+     return NULL;
+}
+
+#define width_of(capacity) ((capacity) <= 256 ? 1 : (capacity) <= 65536 ? 2 : 4)
+#define INDEX_SIZE(capacity) ((size_t)(capacity) * (1 + width_of(capacity)))
+/* true if both the index and the entries of that capacity have a byte size */
+#define CAPACITY_FITS(capacity) ((capacity) <= (size_t)-1 / (1 + width_of(capacity)) \
+                                 && MAX_LOAD(capacity) <= (size_t)-1 / sizeof(cad_hash_entry_t))
+
+static int new_index(struct cad_hash_impl *this, index_t *index, unsigned int capacity) {
+     /* one block: the control bytes, then the positions */
+     index->ctrl = (unsigned char *)this->memory.malloc(INDEX_SIZE(capacity));
+     if (index->ctrl == NULL) {
+          return 0;
+     }
+     index->positions = index->ctrl + capacity;
+     index->capacity  = capacity;
+     index->width     = width_of(capacity);
+     index->used      = 0;
+     memset(index->ctrl, CTRL_EMPTY, capacity);
+     return 1;
+}
+
+static void free_index(struct cad_hash_impl *this, index_t *index) {
+     if (index->ctrl != NULL) {
+          memory_free_sized(this->memory, this->ex, index->ctrl, INDEX_SIZE(index->capacity));
+     }
+     memset(index, 0, sizeof(index_t));
+}
+
+static void free_entries(struct cad_hash_impl *this, cad_hash_entry_t *entries, unsigned int capacity) {
+     if (entries != NULL && entries != this->small) {
+          memory_free_sized(this->memory, this->ex, entries, capacity * sizeof(cad_hash_entry_t));
+     }
+}
+
+/*
+ * Moves the next `count` old entries to the new arrays. Moved entries
+ * become holes, so that the old index does not find them any more.
+ */
+static void migrate(struct cad_hash_impl *this, unsigned int count) {
+     cad_hash_entry_t *entry;
+     unsigned int i, end;
+
+     if (this->old_entries == NULL) {
+          return;
+     }
+     end = this->old_entries_used - this->migrated < count ? this->old_entries_used : this->migrated + count;
+     for (i = this->migrated; i < end; i++) {
+          entry = this->old_entries + i;
+          if (!is_hole(entry)) {
+               this->entries[this->moved] = *entry;
+               insert_position(&(this->index), entry->key.hash, this->moved++);
+               entry->key.key = HOLE;
+          }
+     }
+     this->migrated = end;
+     if (end == this->old_entries_used) {
+          /* the keys deleted before being moved leave a gap */
+          while (this->moved < this->append_base) {
+               this->entries[this->moved++].key.key = HOLE;
+          }
+          free_entries(this, this->old_entries, this->old_entries_capacity);
+          free_index(this, &(this->old));
+          this->old_entries = NULL;
+     }
+}
+
+#define finish_migration(this) migrate((this), (this)->old_entries_used)
+
+/*
+ * Allocates new arrays and starts moving the entries there. The move
+ * goes on with each get, set and del, like Redis does, so that no
+ * single operation pays for the whole table.
+ */
+static int start_resize(struct cad_hash_impl *this, unsigned int new_capacity) {
+     index_t index;
+     cad_hash_entry_t *entries;
+     finish_migration(this);
+     if (!new_index(this, &index, new_capacity)) {
+          return 0;
+     }
+     entries = this->memory.malloc(MAX_LOAD(new_capacity) * sizeof(cad_hash_entry_t));
+     if (entries == NULL) {
+          free_index(this, &index);
+          return 0;
+     }
+     if (new_capacity > this->index.capacity) {
+          this->grows++;
+     } else {
+          this->rehashes++;
+     }
+     this->old_entries          = this->entries;
+     this->old_entries_capacity = this->entries_capacity;
+     this->old_entries_used     = this->entries_used;
+     this->old                  = this->index;
+     this->migrated             = 0;
+     this->moved                = 0;
+     this->append_base          = this->count;
+     this->entries          = entries;
+     this->entries_capacity = MAX_LOAD(new_capacity);
+     this->entries_used     = this->count;
+     this->index            = index;
+     migrate(this, MIGRATE_STEP);
+     return 1;
+}
+
+static int resize(struct cad_hash_impl *this, unsigned int new_capacity) {
+     if (!start_resize(this, new_capacity)) {
+          return 0;
+     }
+     finish_migration(this);
+     return 1;
+}
+
+/* Moves the live entries to the small array, in order, and drops the index. */
+static void make_small(struct cad_hash_impl *this) {
+     unsigned int i, n = 0;
+     for (i = 0; i < this->entries_used; i++) {
+          if (!is_hole(this->entries + i)) {
+               this->small[n++] = this->entries[i];
+          }
+     }
+     free_entries(this, this->entries, this->entries_capacity);
+     free_index(this, &(this->index));
+     this->entries          = this->small;
+     this->entries_capacity = SMALL_SIZE;
+     this->entries_used     = n;
+}
+
+/*
+ * Called when the entries array is full. If at least half of the
+ * entries are holes, they are only squeezed out: the cost is then
+ * paid by the deletions that left those holes, and a table with churn
+ * does not grow forever.
+ *
+ * Otherwise the table doubles. Either way, the new arrays have room
+ * for the entries appended during the migration: at least half of
+ * them are free, and at most one entry is appended per MIGRATE_STEP
+ * moved entries.
+ *
+ * Small tables are squeezed as long as they have holes, and get their
+ * first index at once: there are too few entries to spread the work.
+ */
+static int make_room(struct cad_hash_impl *this) {
+     unsigned int capacity;
+     finish_migration(this);
+     capacity = this->index.capacity;
+     if (capacity == 0) {
+          if (this->count < SMALL_SIZE) {
+               make_small(this);
+               return 1;
+          }
+          return resize(this, GROUP_SIZE);
+     }
+     if (this->count <= this->entries_capacity / 2) {
+          return start_resize(this, capacity);
+     }
+     if (capacity * 2 == 0 || !CAPACITY_FITS(capacity * 2)) {
+          return 0;
+     }
+     return start_resize(this, capacity * 2);
+}
+
+/* The smallest capacity that holds `count` keys, 0 if too big (or if
+ * its index or entries would not have a byte size). */
+static unsigned int capacity_for(unsigned int count) {
+     unsigned int result = GROUP_SIZE;
+     while (MAX_LOAD(result) < count) {
+          result <<= 1;
+          if (result == 0) {
+               return 0;
+          }
+     }
+     return CAPACITY_FITS(result) ? result : 0;
+}
+
+static int reserve(struct cad_hash_impl *this, unsigned int count) {
+     unsigned int new_capacity = capacity_for(count);
+     if (new_capacity == 0) {
+          return -1;
+     }
+     if (is_small(this) && count <= SMALL_SIZE) {
+          return 0;
+     }
+     finish_migration(this);
+     if (new_capacity > this->index.capacity && !resize(this, new_capacity)) {
+          return -1;
+     }
+     return 0;
+}
+
+/* Copies the live packed keys to new chunks, leaving the deleted ones behind. */
+static int compact_keys(struct cad_hash_impl *this) {
+     key_chunk_t *chunks = NULL;
+     cad_hash_entry_t *entry;
+     const void *key;
+     unsigned int i;
+     for (i = 0; i < this->entries_used; i++) {
+          entry = this->entries + i;
+          if (!is_hole(entry)) {
+               key = pack_key(this->memory, &chunks, entry->key.key, this->keys.size(entry->key.key));
+               if (key == NULL) {
+                    free_key_chunks(this->memory, this->ex, chunks);
+                    return 0;
                }
+               entry->key.key = key;
+          }
+     }
+     free_key_chunks(this->memory, this->ex, this->key_chunks);
+     this->key_chunks  = chunks;
+     this->key_garbage = 0;
+     return 1;
+}
+
+static int shrink_to_fit(struct cad_hash_impl *this) {
+     unsigned int new_capacity;
+     finish_migration(this);
+     if (this->count <= SMALL_SIZE) {
+          if (!is_small(this)) {
+               this->rehashes++;
+          }
+          make_small(this);
+          if (this->count == 0) {
+               free_key_chunks(this->memory, this->ex, this->key_chunks);
+               this->key_chunks  = NULL;
+               this->key_garbage = 0;
+               return 0;
           }
-          this->memory.free(this->entries);
-          this->entries = new_entries;
+     } else {
+          new_capacity = capacity_for(this->count);
+          if ((new_capacity < this->index.capacity || this->entries_used > this->count) && !resize(this, new_capacity)) {
+               return -1;
+          }
+     }
+     if (this->key_garbage != 0 && !compact_keys(this)) {
+          return -1;
      }
-     this->capacity = new_capacity;
+     return 0;
 }
 
 static unsigned int count(struct cad_hash_impl *this) {
      return this->count;
 }
 
-static void iterate_(struct cad_hash_impl *this, cad_hash_iterator_fn iterator, void *data, int clean) {
-     int i, index = 0;
+static void iterate_entries(struct cad_hash_impl *this, cad_hash_entry_t *entries, unsigned int from, unsigned int to, int *index, cad_hash_iterator_fn iterator, void *data, int clean) {
+     unsigned int i;
      cad_hash_entry_t entry;
-     for (i = 0; index < this->count; i++) {
-          entry = this->entries[i];
-          if (entry.key.key) {
-               iterator(this, index++, entry.key.key, entry.value, data);
+     for (i = from; i < to; i++) {
+          entry = entries[i];
+          if (!is_hole(&entry)) {
+               iterator(this, (*index)++, entry.key.key, entry.value, data);
                if (clean) {
-                    this->keys.free((void*)entry.key.key);
+                    free_key(this, entry.key.key);
                }
           }
      }
 }
 
+/*
+ * In insertion order. The migration is finished first: the iterator
+ * may call get(), which would otherwise move entries (and free the old
+ * array) under our feet.
+ */
+static void iterate_(struct cad_hash_impl *this, cad_hash_iterator_fn iterator, void *data, int clean) {
+     int index = 0;
+     finish_migration(this);
+     iterate_entries(this, this->entries, 0, this->entries_used, &index, iterator, data, clean);
+}
+
 static void iterate(struct cad_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
      iterate_(this, iterator, data, 0);
 }
 
 static void clean(struct cad_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
      iterate_(this, iterator, data, 1);
-     this->count = 0;
-     memset(this->entries, 0, this->capacity * sizeof(cad_hash_entry_t));
+     free_key_chunks(this->memory, this->ex, this->key_chunks);
+     this->key_chunks   = NULL;
+     this->key_garbage  = 0;
+     this->count        = 0;
+     this->entries_used = 0;
+     this->index.used   = 0;
+     if (this->index.capacity != 0) {
+          memset(this->index.ctrl, CTRL_EMPTY, this->index.capacity);
+     }
+}
+
+/* The cursor walks the entries array: the migration, if any, must be finished. */
+static int first(struct cad_hash_impl *this, cad_hash_cursor_t *cursor) {
+     finish_migration(this);
+     cursor->hash         = (cad_hash_t*)this;
+     cursor->entries      = (const char*)this->entries;
+     cursor->stride       = sizeof(cad_hash_entry_t);
+     cursor->value_offset = offsetof(cad_hash_entry_t, value);
+     cursor->hole         = HOLE;
+     cursor->position     = (unsigned int)-1;
+     cursor->end          = this->entries_used;
+     cursor->next         = NULL;
+     return cad_hash_next(cursor);
 }
 
 static void *get(struct cad_hash_impl *this, const void *key) {
      void *result = NULL;
-     int index;
+     cad_hash_entry_t *entry;
+     index_t *index;
+     int slot;
      if (this->count) {
-          index = index_of(this->entries, this->keys, this->capacity, hash(key, this->keys, this->salt), NULL);
-          if (index >= 0) {
-               result = this->entries[index].value;
+          migrate(this, MIGRATE_STEP);
+          entry = lookup(this, hash(this, key), &index, &slot);
+          if (entry != NULL) {
+               result = entry->value;
           }
      }
      return result;
 }
 
-static void *set(struct cad_hash_impl *this, const void *key, void *value) {
+static void *set_hashed(struct cad_hash_impl *this, cad_hash_key_t hkey, void *value) {
      void *result = NULL;
-     int index;
-     cad_hash_key_t hkey = hash(key, this->keys, this->salt);
-     if (this->capacity == 0) {
-          grow(this, 2);
-     }
-     index = index_of(this->entries, this->keys, this->capacity, hkey, NULL);
-     if (index >= 0) {
-          result = this->entries[index].value;
+     index_t *index;
+     cad_hash_entry_t *entry;
+     int slot;
+     const void *key = hkey.key;
+     entry = lookup(this, hkey, &index, &slot);
+     if (entry != NULL) {
+          result = entry->value;
+          if (is_borrowed(this)) {
+               entry->key.key = key;
+          }
      }
      else {
-          if (this->count * 3 >= this->capacity * 2) {
-               grow(this, 2);
-               index = index_of(this->entries, this->keys, this->capacity, hkey, NULL);
+          if (key == HOLE) {
+               return NULL; /* reserved for the deleted entries */
+          }
+          if (this->entries_used == this->entries_capacity && !make_room(this)) {
+               return NULL;
+          }
+          hkey.key = clone_key(this, key);
+          if (hkey.key == NULL && key != NULL) {
+               return NULL;
+          }
+          entry = this->entries + this->entries_used;
+          entry->key = hkey;
+          if (!is_small(this)) {
+               insert_position(&(this->index), hkey.hash, this->entries_used);
           }
-          index = -index - 1;
-          hkey.key = this->keys.clone(key);
-          this->entries[index].key = hkey;
+          this->entries_used++;
           this->count++;
      }
-     this->entries[index].value = value;
+     entry->value = value;
      return result;
 }
 
+static void *set(struct cad_hash_impl *this, const void *key, void *value) {
+     cad_hash_key_t hkey = hash(this, key);
+     migrate(this, MIGRATE_STEP);
+     return set_hashed(this, hkey, value);
+}
+
 static void *del(struct cad_hash_impl *this, const void *key) {
      void *result = NULL;
+     index_t *index;
+     cad_hash_entry_t *entry;
+     int slot;
      if (this->count) {
-          cad_hash_key_t hkey = hash(key, this->keys, this->salt);
-          int index = index_of(this->entries, this->keys, this->capacity, hkey, NULL);
-
-          if (index >= 0) {
-               result = this->entries[index].value;
-               this->keys.free((void*)this->entries[index].key.key);
-               this->entries[index].key.key = NULL;
-               this->entries[index].value   = NULL;
+          migrate(this, MIGRATE_STEP);
+          entry = lookup(this, hash(this, key), &index, &slot);
+          if (entry != NULL) {
+               result = entry->value;
+               free_key(this, entry->key.key);
+               entry->key.key = HOLE;
+               if (slot >= 0) {
+                    remove_slot(index, slot);
+               }
                this->count--;
-               rehash(this);
           }
      }
      return result;
 }
 
+/*
+ * The batch functions walk their keys several times, each pass
+ * prefetching what the next one needs: first the index group, then
+ * the candidate entry (the first one with the right tag), then its
+ * key. The last pass does the real lookups, hopefully in cache.
+ */
+#define BATCH_SIZE 16
+
+static void prefetch_batch(struct cad_hash_impl *this, const void *const *keys, unsigned int count, cad_hash_key_t *hkeys) {
+     const cad_hash_entry_t *candidates[BATCH_SIZE];
+     index_t *index = &(this->index);
+     unsigned int i, first_slot, match;
+
+     for (i = 0; i < count; i++) {
+          hkeys[i] = hash(this, keys[i]);
+     }
+     if (index->capacity == 0) {
+          return;
+     }
+     for (i = 0; i < count; i++) {
+          first_slot = (group_of(hkeys[i].hash) & (index->capacity / GROUP_SIZE - 1)) * GROUP_SIZE;
+          __builtin_prefetch(index->ctrl + first_slot);
+          __builtin_prefetch((char*)index->positions + first_slot * index->width);
+     }
+     for (i = 0; i < count; i++) {
+          first_slot = (group_of(hkeys[i].hash) & (index->capacity / GROUP_SIZE - 1)) * GROUP_SIZE;
+          match = match_tag(index->ctrl + first_slot, tag_of(hkeys[i].hash));
+          candidates[i] = NULL;
+          if (match != 0) {
+               candidates[i] = this->entries + position(index, first_slot + __builtin_ctz(match));
+               __builtin_prefetch(candidates[i]);
+          }
+     }
+     for (i = 0; i < count; i++) {
+          if (candidates[i] != NULL) {
+               __builtin_prefetch(candidates[i]->key.key);
+          }
+     }
+}
+
+static void get_many(struct cad_hash_impl *this, const void *const *keys, unsigned int count, void **values) {
+     cad_hash_key_t hkeys[BATCH_SIZE];
+     cad_hash_entry_t *entry;
+     index_t *index;
+     unsigned int i, j, n;
+     int slot;
+     for (i = 0; i < count; i += n) {
+          n = count - i < BATCH_SIZE ? count - i : BATCH_SIZE;
+          if (this->count == 0) {
+               memset(values + i, 0, n * sizeof(void*));
+               continue;
+          }
+          migrate(this, n * MIGRATE_STEP);
+          prefetch_batch(this, keys + i, n, hkeys);
+          for (j = 0; j < n; j++) {
+               entry = lookup(this, hkeys[j], &index, &slot);
+               values[i + j] = entry == NULL ? NULL : entry->value;
+          }
+     }
+}
+
+static void set_many(struct cad_hash_impl *this, const void *const *keys, void *const *values, unsigned int count, void **old_values) {
+     cad_hash_key_t hkeys[BATCH_SIZE];
+     unsigned int i, j, n;
+     void *old;
+     for (i = 0; i < count; i += n) {
+          n = count - i < BATCH_SIZE ? count - i : BATCH_SIZE;
+          migrate(this, n * MIGRATE_STEP);
+          prefetch_batch(this, keys + i, n, hkeys);
+          for (j = 0; j < n; j++) {
+               old = set_hashed(this, hkeys[j], values[i + j]);
+               if (old_values != NULL) {
+                    old_values[i + j] = old;
+               }
+          }
+     }
+}
+
+/* The number of groups read before reaching the slot. */
+static unsigned int probe_length(index_t *index, unsigned int hash, int slot) {
+     unsigned int result = 1;
+     probe_t probe;
+     start_probe(&probe, index->capacity, hash);
+     while (probe.group != slot / GROUP_SIZE) {
+          next_probe(&probe);
+          result++;
+     }
+     return result;
+}
+
+void count_probe(cad_hash_stats_t *stats, unsigned int length) {
+     stats->probes[(length < CAD_HASH_PROBES ? length : CAD_HASH_PROBES) - 1]++;
+     if (length > stats->max_probe) {
+          stats->max_probe = length;
+     }
+}
+
+void finish_stats(cad_hash_stats_t *stats, unsigned long long total) {
+     stats->load_factor   = stats->capacity == 0 ? 0 : (double)stats->count / stats->capacity;
+     stats->average_probe = stats->count == 0 ? 0 : (double)total / stats->count;
+}
+
+static int stats(struct cad_hash_impl *this, cad_hash_stats_t *stats) {
+     unsigned long long total = 0;
+     unsigned int i, length;
+     cad_hash_entry_t *entry;
+     index_t *index;
+     finish_migration(this);
+     memset(stats, 0, sizeof(cad_hash_stats_t));
+     stats->capacity = is_small(this) ? SMALL_SIZE : this->index.capacity;
+     stats->count    = this->count;
+     stats->grows    = this->grows;
+     stats->rehashes = this->rehashes;
+     for (i = 0; i < this->entries_used; i++) {
+          entry = this->entries + i;
+          if (!is_hole(entry)) {
+               /* small tables: the entries read by the scan */
+               index = &(this->index);
+               length = is_small(this) ? i + 1 : probe_length(index, entry->key.hash, slot_of(this, index, this->entries, entry->key));
+               count_probe(stats, length);
+               total += length;
+          }
+     }
+     finish_stats(stats, total);
+     return 0;
+}
+
 static void free_(struct cad_hash_impl *this) {
-     int i, index = 0;
-     cad_hash_entry_t entry;
-     for (i = 0; index < this->count; i++) {
-          entry = this->entries[i];
-          if (entry.key.key) {
-               index++;
-               this->keys.free((void*)entry.key.key);
+     unsigned int i;
+     finish_migration(this);
+     if (this->keys.clone != NULL) {
+          for (i = 0; i < this->entries_used; i++) {
+               if (!is_hole(this->entries + i)) {
+                    this->keys.free((void*)this->entries[i].key.key);
+               }
           }
      }
-     this->memory.free(this->entries);
-     this->memory.free(this);
+     free_entries(this, this->entries, this->entries_capacity);
+     free_index(this, &(this->index));
+     free_key_chunks(this->memory, this->ex, this->key_chunks);
+     memory_free_sized(this->memory, this->ex, this, sizeof(struct cad_hash_impl));
 }
 
 static cad_hash_t fn = {
-     (cad_hash_free_fn   )free_  ,
-     (cad_hash_count_fn  )count  ,
-     (cad_hash_iterate_fn)iterate,
-     (cad_hash_get_fn    )get    ,
-     (cad_hash_set_fn    )set    ,
-     (cad_hash_del_fn    )del    ,
-     (cad_hash_clean_fn  )clean  ,
+     (cad_hash_free_fn         )free_        ,
+     (cad_hash_count_fn        )count        ,
+     (cad_hash_iterate_fn      )iterate      ,
+     (cad_hash_get_fn          )get          ,
+     (cad_hash_set_fn          )set          ,
+     (cad_hash_del_fn          )del          ,
+     (cad_hash_clean_fn        )clean        ,
+     (cad_hash_reserve_fn      )reserve      ,
+     (cad_hash_shrink_to_fit_fn)shrink_to_fit,
+     (cad_hash_first_fn        )first        ,
+     (cad_hash_get_many_fn     )get_many     ,
+     (cad_hash_set_many_fn     )set_many     ,
+     (cad_hash_stats_fn        )stats        ,
 };
 
+/* Mixed into the seed of the keyed hash functions, only if the
+ * default salt is used (so that other salts stay deterministic). */
+static unsigned long long hash_secret[2] = { 0, 0 };
+
 static void init_rand(void) {
    int seed = 0;
    int fd = open("/dev/random", O_RDONLY);
@@ -282,6 +977,9 @@ static void init_rand(void) {
          srand(seed);
          ok = 1;
       }
+      if (read(fd, hash_secret, sizeof(hash_secret)) != sizeof(hash_secret)) {
+         hash_secret[0] = hash_secret[1] = 0;
+      }
       close(fd);
    }
    if (!ok) {
@@ -300,16 +998,41 @@ int default_hash_salt(void) {
 
 static hash_salt_fn hash_salt = default_hash_salt;
 
+static unsigned long long splitmix(unsigned long long *state) {
+     unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+     z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+     z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+     return z ^ (z >> 31);
+}
+
+void init_hash_seed(hash_seed_t *seed) {
+     unsigned long long state;
+     seed->salt = hash_salt();
+     state = (unsigned int)seed->salt ^ hash_secret[0];
+     seed->key[0] = splitmix(&state);
+     state ^= hash_secret[1];
+     seed->key[1] = splitmix(&state);
+}
+
 __PUBLIC__ cad_hash_t *cad_new_hash(cad_memory_t memory, cad_hash_keys_t keys) {
      struct cad_hash_impl *result = (struct cad_hash_impl *)memory.malloc(sizeof(struct cad_hash_impl));
      if (!result) return NULL;
-     result->fn       = fn;
-     result->memory   = memory;
-     result->keys     = keys;
-     result->capacity = 0;
-     result->count    = 0;
-     result->salt     = hash_salt();
-     result->entries  = NULL;
+     result->fn               = fn;
+     result->memory           = memory;
+     result->ex               = cad_memory_ex(memory);
+     result->keys             = keys;
+     result->key_chunks       = NULL;
+     result->key_garbage      = 0;
+     result->count            = 0;
+     result->grows            = 0;
+     result->rehashes         = 0;
+     init_hash_seed(&(result->seed));
+     result->entries          = result->small;
+     result->entries_capacity = SMALL_SIZE;
+     result->entries_used     = 0;
+     result->old_entries      = NULL;
+     result->old_entries_used = 0;
+     memset(&(result->index), 0, sizeof(index_t));
      return (cad_hash_t*)result;
 }
 
@@ -0,0 +1,683 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the implementation of concurrent hash tables.
+ *
+ * Keys are spread over shards by hash. Each shard has its own lock,
+ * taken by the writers (set, del, clean...). Readers (get, iterate)
+ * take no lock at all: they read the shard table through atomic
+ * loads, and the nodes and tables removed by the writers are only
+ * freed when no reader can see them any more (epoch-based
+ * reclamation).
+ *
+ * Each shard is an open-addressed table of pointers to nodes, probed
+ * linearly. A node's key never changes; its value is updated
+ * atomically. A deleted node is replaced by a tombstone.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "cad_hash_internal.h"
+
+#define MIN_CAPACITY      8
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 4)
+#define RECLAIM_THRESHOLD 64
+
+#define load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define store(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* Epochs, shared by all the concurrent hash tables */
+
+/*
+ * Each thread that reads a concurrent hash table has a reader
+ * record. While reading, the record is active and holds the global
+ * epoch at the time the read started.
+ *
+ * Each removed object is tagged with the global epoch, which is then
+ * incremented. Readers that start later cannot reach the object; the
+ * object can be freed once all the active readers started after it
+ * was removed.
+ */
+typedef struct reader {
+     struct reader *next;
+     unsigned long epoch;
+     int depth; /* nested reads; active if not zero */
+     int orphan;
+} reader_t;
+
+static unsigned long global_epoch = 1;
+static reader_t *readers = NULL; /* never shrinks: dead threads leave orphans behind */
+static pthread_key_t reader_key;
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+static __thread reader_t *thread_reader = NULL;
+
+static void orphan_reader(reader_t *reader) {
+     store(&(reader->orphan), 1);
+}
+
+static void init_readers(void) {
+     pthread_key_create(&reader_key, (void (*)(void*))orphan_reader);
+}
+
+static reader_t *get_reader(void) {
+     reader_t *result = thread_reader;
+     reader_t *head;
+     if (result == NULL) {
+          pthread_once(&reader_once, init_readers);
+          for (result = load(&readers); result != NULL; result = result->next) {
+               if (load(&(result->orphan)) && __sync_bool_compare_and_swap(&(result->orphan), 1, 0)) {
+                    break;
+               }
+          }
+          if (result == NULL) {
+               result = malloc(sizeof(reader_t));
+               if (result == NULL) {
+                    return NULL;
+               }
+               result->epoch  = 0;
+               result->depth  = 0;
+               result->orphan = 0;
+               do {
+                    head = load(&readers);
+                    result->next = head;
+               } while (!__sync_bool_compare_and_swap(&readers, head, result));
+          }
+          pthread_setspecific(reader_key, result);
+          thread_reader = result;
+     }
+     return result;
+}
+
+static reader_t *enter(void) {
+     reader_t *result = get_reader();
+     if (result != NULL) {
+          if (result->depth == 0) {
+               store(&(result->epoch), load(&global_epoch));
+          }
+          store(&(result->depth), result->depth + 1);
+          /* the epoch must be visible before any shared pointer is read */
+          __sync_synchronize();
+     }
+     return result;
+}
+
+static void leave(reader_t *reader) {
+     if (reader != NULL) {
+          /* release: the reads are done before the reader looks inactive */
+          store(&(reader->depth), reader->depth - 1);
+     }
+}
+
+/* The oldest epoch still seen by an active reader. */
+static unsigned long oldest_epoch(void) {
+     unsigned long result = load(&global_epoch), epoch;
+     reader_t *reader;
+     for (reader = load(&readers); reader != NULL; reader = reader->next) {
+          if (load(&(reader->depth)) != 0) {
+               epoch = load(&(reader->epoch));
+               if (epoch < result) {
+                    result = epoch;
+               }
+          }
+     }
+     return result;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+     retired_node, retired_node_and_key, retired_table,
+} retired_kind_t;
+
+typedef struct retired {
+     struct retired *next;
+     unsigned long epoch;
+     retired_kind_t kind;
+} retired_t;
+
+typedef struct node {
+     retired_t retired;
+     const void *key;
+     unsigned int hash;
+     void *value;
+} node_t;
+
+typedef struct ctable {
+     retired_t retired;
+     unsigned int capacity; /* a power of two */
+     node_t *slots[];
+} ctable_t;
+
+static node_t tombstone;
+#define TOMBSTONE (&tombstone)
+
+typedef struct shard {
+     pthread_mutex_t lock;
+     ctable_t *table;
+     unsigned int count;
+     unsigned int used; /* nodes and tombstones */
+     retired_t *retired;
+     unsigned int retired_count;
+     unsigned int grows;
+     unsigned int rehashes;
+     char padding[64];  /* keep the shards' locks on different cache lines */
+} shard_t;
+
+struct cad_concurrent_hash_impl {
+     cad_hash_t fn;
+     cad_memory_t memory;
+     cad_hash_keys_t keys;
+     hash_seed_t seed;
+     unsigned int shard_bits;
+     shard_t *shards;
+};
+
+static shard_t *shard_of(struct cad_concurrent_hash_impl *this, unsigned int hash) {
+     if (this->shard_bits == 0) {
+          return this->shards;
+     }
+     return this->shards + ((hash * 0x9e3779b9U) >> (32 - this->shard_bits));
+}
+
+static void free_retired(struct cad_concurrent_hash_impl *this, retired_t *retired) {
+     if (retired->kind == retired_node_and_key) {
+          free_hash_key(this->memory, &(this->keys), ((node_t*)retired)->key);
+     }
+     this->memory.free(retired);
+}
+
+static void reclaim(struct cad_concurrent_hash_impl *this, shard_t *shard) {
+     unsigned long oldest = oldest_epoch();
+     retired_t **retired = &(shard->retired), *item;
+     while (*retired != NULL) {
+          item = *retired;
+          if (item->epoch < oldest) {
+               *retired = item->next;
+               free_retired(this, item);
+               shard->retired_count--;
+          } else {
+               retired = &(item->next);
+          }
+     }
+}
+
+/* Called with the shard lock held, after the object was unlinked. */
+static void retire(struct cad_concurrent_hash_impl *this, shard_t *shard, retired_t *retired, retired_kind_t kind) {
+     retired->kind  = kind;
+     retired->epoch = __sync_fetch_and_add(&global_epoch, 1);
+     retired->next  = shard->retired;
+     shard->retired = retired;
+     if (++shard->retired_count >= RECLAIM_THRESHOLD) {
+          reclaim(this, shard);
+     }
+}
+
+static ctable_t *new_table(struct cad_concurrent_hash_impl *this, unsigned int capacity) {
+     ctable_t *result = this->memory.malloc(sizeof(ctable_t) + capacity * sizeof(node_t*));
+     if (result != NULL) {
+          result->capacity = capacity;
+          memset(result->slots, 0, capacity * sizeof(node_t*));
+     }
+     return result;
+}
+
+/* The smallest capacity that holds `count` keys at half load, 0 if too big. */
+static unsigned int capacity_for(unsigned int count) {
+     unsigned int result = MIN_CAPACITY;
+     while (result / 2 < count) {
+          result <<= 1;
+          if (result == 0) {
+               break;
+          }
+     }
+     return result;
+}
+
+/* Readers: returns the node of the key, or NULL if not found. */
+static node_t *find(struct cad_concurrent_hash_impl *this, ctable_t *table, const void *key, unsigned int hash) {
+     unsigned int mask = table->capacity - 1;
+     unsigned int i = hash & mask;
+     node_t *node;
+     for (;;) {
+          node = load(&(table->slots[i]));
+          if (node == NULL) {
+               return NULL;
+          }
+          if (node != TOMBSTONE && node->hash == hash && !this->keys.compare(key, node->key)) {
+               return node;
+          }
+          i = (i + 1) & mask;
+     }
+}
+
+/* Writers: returns the slot of the key, or -1 if not found; `free_slot` is the first reusable slot. */
+static int index_of(struct cad_concurrent_hash_impl *this, ctable_t *table, const void *key, unsigned int hash, int *free_slot) {
+     unsigned int mask = table->capacity - 1;
+     unsigned int i = hash & mask;
+     node_t *node;
+     *free_slot = -1;
+     for (;;) {
+          node = table->slots[i];
+          if (node == NULL) {
+               if (*free_slot < 0) {
+                    *free_slot = i;
+               }
+               return -1;
+          }
+          if (node == TOMBSTONE) {
+               if (*free_slot < 0) {
+                    *free_slot = i;
+               }
+          } else if (node->hash == hash && !this->keys.compare(key, node->key)) {
+               return i;
+          }
+          i = (i + 1) & mask;
+     }
+}
+
+/* Called with the shard lock held. */
+static int resize(struct cad_concurrent_hash_impl *this, shard_t *shard, unsigned int capacity) {
+     ctable_t *old = shard->table, *table = new_table(this, capacity);
+     unsigned int i, j, mask = capacity - 1;
+     node_t *node;
+     if (table == NULL) {
+          return 0;
+     }
+     for (i = 0; i < old->capacity; i++) {
+          node = old->slots[i];
+          if (node != NULL && node != TOMBSTONE) {
+               for (j = node->hash & mask; table->slots[j] != NULL; j = (j + 1) & mask) {
+                    /* look for an empty slot */
+               }
+               table->slots[j] = node;
+          }
+     }
+     if (capacity > old->capacity) {
+          shard->grows++;
+     } else {
+          shard->rehashes++;
+     }
+     store(&(shard->table), table);
+     shard->used = shard->count;
+     retire(this, shard, &(old->retired), retired_table);
+     return 1;
+}
+
+static unsigned int count(struct cad_concurrent_hash_impl *this) {
+     unsigned int result = 0, i;
+     for (i = 0; i < (1U << this->shard_bits); i++) {
+          result += load(&(this->shards[i].count));
+     }
+     return result;
+}
+
+static void iterate(struct cad_concurrent_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
+     reader_t *reader = enter();
+     ctable_t *table;
+     node_t *node;
+     unsigned int i, j;
+     int index = 0;
+     for (i = 0; i < (1U << this->shard_bits); i++) {
+          table = load(&(this->shards[i].table));
+          for (j = 0; j < table->capacity; j++) {
+               node = load(&(table->slots[j]));
+               if (node != NULL && node != TOMBSTONE) {
+                    iterator(this, index++, node->key, load(&(node->value)), data);
+               }
+          }
+     }
+     leave(reader);
+}
+
+/* The cursor position is a slot in the shard at `end`. */
+static int cursor_next(cad_hash_cursor_t *cursor) {
+     struct cad_concurrent_hash_impl *this = (struct cad_concurrent_hash_impl *)cursor->hash;
+     shard_t *shard;
+     node_t *node;
+     while (cursor->end < (1U << this->shard_bits)) {
+          shard = this->shards + cursor->end;
+          if (0 == pthread_mutex_lock(&(shard->lock))) {
+               while (++cursor->position < shard->table->capacity) {
+                    node = shard->table->slots[cursor->position];
+                    if (node != NULL && node != TOMBSTONE) {
+                         cursor->key   = node->key;
+                         cursor->value = node->value;
+                         pthread_mutex_unlock(&(shard->lock));
+                         return 1;
+                    }
+               }
+               pthread_mutex_unlock(&(shard->lock));
+          }
+          cursor->end++;
+          cursor->position = (unsigned int)-1;
+     }
+     return 0;
+}
+
+static int first(struct cad_concurrent_hash_impl *this, cad_hash_cursor_t *cursor) {
+     cursor->hash     = (cad_hash_t*)this;
+     cursor->entries  = NULL;
+     cursor->position = (unsigned int)-1;
+     cursor->end      = 0;
+     cursor->next     = cursor_next;
+     return cursor_next(cursor);
+}
+
+static void *get(struct cad_concurrent_hash_impl *this, const void *key) {
+     unsigned int hash = hash_key(&(this->keys), &(this->seed), key);
+     shard_t *shard = shard_of(this, hash);
+     reader_t *reader = enter();
+     void *result = NULL;
+     node_t *node;
+     if (reader == NULL) {
+          /* cannot read safely without a reader record */
+          if (0 == pthread_mutex_lock(&(shard->lock))) {
+               node = find(this, shard->table, key, hash);
+               if (node != NULL) {
+                    result = node->value;
+               }
+               pthread_mutex_unlock(&(shard->lock));
+          }
+          return result;
+     }
+     node = find(this, load(&(shard->table)), key, hash);
+     if (node != NULL) {
+          result = load(&(node->value));
+     }
+     leave(reader);
+     return result;
+}
+
+static void *set(struct cad_concurrent_hash_impl *this, const void *key, void *value) {
+     unsigned int hash = hash_key(&(this->keys), &(this->seed), key);
+     shard_t *shard = shard_of(this, hash);
+     void *result = NULL;
+     node_t *node;
+     int index, free_slot;
+     if (0 == pthread_mutex_lock(&(shard->lock))) {
+          index = index_of(this, shard->table, key, hash, &free_slot);
+          if (index >= 0) {
+               node = shard->table->slots[index];
+               result = node->value;
+               store(&(node->value), value);
+          } else {
+               node = this->memory.malloc(sizeof(node_t));
+               if (node != NULL) {
+                    node->key = clone_hash_key(this->memory, &(this->keys), key);
+                    if (node->key == NULL && key != NULL) {
+                         this->memory.free(node);
+                    } else {
+                         node->hash  = hash;
+                         node->value = value;
+                         if (shard->table->slots[free_slot] == NULL && shard->used + 1 > MAX_LOAD(shard->table->capacity)) {
+                              if (resize(this, shard, capacity_for(shard->count + 1))) {
+                                   index_of(this, shard->table, key, hash, &free_slot);
+                              } else if (shard->used + 1 >= shard->table->capacity) {
+                                   /* keep at least one empty slot */
+                                   free_hash_key(this->memory, &(this->keys), node->key);
+                                   this->memory.free(node);
+                                   node = NULL;
+                              }
+                         }
+                         if (node != NULL) {
+                              if (shard->table->slots[free_slot] == NULL) {
+                                   shard->used++;
+                              }
+                              store(&(shard->table->slots[free_slot]), node);
+                              store(&(shard->count), shard->count + 1);
+                         }
+                    }
+               }
+          }
+          pthread_mutex_unlock(&(shard->lock));
+     }
+     return result;
+}
+
+static void *del(struct cad_concurrent_hash_impl *this, const void *key) {
+     unsigned int hash = hash_key(&(this->keys), &(this->seed), key);
+     shard_t *shard = shard_of(this, hash);
+     void *result = NULL;
+     node_t *node;
+     int index, free_slot;
+     if (0 == pthread_mutex_lock(&(shard->lock))) {
+          index = index_of(this, shard->table, key, hash, &free_slot);
+          if (index >= 0) {
+               node = shard->table->slots[index];
+               result = node->value;
+               store(&(shard->table->slots[index]), TOMBSTONE);
+               store(&(shard->count), shard->count - 1);
+               retire(this, shard, &(node->retired), retired_node_and_key);
+          }
+          pthread_mutex_unlock(&(shard->lock));
+     }
+     return result;
+}
+
+static void get_many(struct cad_concurrent_hash_impl *this, const void *const *keys, unsigned int count, void **values) {
+     unsigned int i;
+     for (i = 0; i < count; i++) {
+          values[i] = get(this, keys[i]);
+     }
+}
+
+static void set_many(struct cad_concurrent_hash_impl *this, const void *const *keys, void *const *values, unsigned int count, void **old_values) {
+     unsigned int i;
+     void *old;
+     for (i = 0; i < count; i++) {
+          old = set(this, keys[i], values[i]);
+          if (old_values != NULL) {
+               old_values[i] = old;
+          }
+     }
+}
+
+static void clean(struct cad_concurrent_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
+     ctable_t *table, *empty;
+     node_t *node;
+     unsigned int i, j;
+     int index = 0;
+     shard_t *shard;
+     for (i = 0; i < (1U << this->shard_bits); i++) {
+          shard = this->shards + i;
+          empty = new_table(this, MIN_CAPACITY);
+          if (empty == NULL || 0 != pthread_mutex_lock(&(shard->lock))) {
+               this->memory.free(empty);
+               continue;
+          }
+          table = shard->table;
+          store(&(shard->table), empty);
+          store(&(shard->count), 0);
+          shard->used = 0;
+          pthread_mutex_unlock(&(shard->lock));
+
+          /* the detached nodes are not retired yet: they cannot be freed under our feet */
+          for (j = 0; j < table->capacity; j++) {
+               node = table->slots[j];
+               if (node != NULL && node != TOMBSTONE) {
+                    iterator(this, index++, node->key, node->value, data);
+               }
+          }
+
+          if (0 == pthread_mutex_lock(&(shard->lock))) {
+               for (j = 0; j < table->capacity; j++) {
+                    node = table->slots[j];
+                    if (node != NULL && node != TOMBSTONE) {
+                         retire(this, shard, &(node->retired), retired_node_and_key);
+                    }
+               }
+               retire(this, shard, &(table->retired), retired_table);
+               pthread_mutex_unlock(&(shard->lock));
+          }
+     }
+}
+
+static int reserve(struct cad_concurrent_hash_impl *this, unsigned int count) {
+     unsigned int shards = 1U << this->shard_bits;
+     unsigned int capacity = capacity_for(count / shards + 1), i;
+     int result = 0;
+     shard_t *shard;
+     if (capacity == 0) {
+          return -1;
+     }
+     for (i = 0; i < shards; i++) {
+          shard = this->shards + i;
+          if (0 == pthread_mutex_lock(&(shard->lock))) {
+               if (capacity > shard->table->capacity && !resize(this, shard, capacity)) {
+                    result = -1;
+               }
+               pthread_mutex_unlock(&(shard->lock));
+          }
+     }
+     return result;
+}
+
+static int shrink_to_fit(struct cad_concurrent_hash_impl *this) {
+     unsigned int i, capacity;
+     int result = 0;
+     shard_t *shard;
+     for (i = 0; i < (1U << this->shard_bits); i++) {
+          shard = this->shards + i;
+          if (0 == pthread_mutex_lock(&(shard->lock))) {
+               capacity = capacity_for(shard->count);
+               if ((capacity < shard->table->capacity || shard->used > shard->count) && !resize(this, shard, capacity)) {
+                    result = -1;
+               }
+               reclaim(this, shard);
+               pthread_mutex_unlock(&(shard->lock));
+          }
+     }
+     return result;
+}
+
+/* No reader nor writer may use the hash table any more. */
+static void free_(struct cad_concurrent_hash_impl *this) {
+     unsigned int i, j;
+     retired_t *retired, *next;
+     node_t *node;
+     shard_t *shard;
+     for (i = 0; i < (1U << this->shard_bits); i++) {
+          shard = this->shards + i;
+          for (j = 0; j < shard->table->capacity; j++) {
+               node = shard->table->slots[j];
+               if (node != NULL && node != TOMBSTONE) {
+                    free_hash_key(this->memory, &(this->keys), node->key);
+                    this->memory.free(node);
+               }
+          }
+          this->memory.free(shard->table);
+          for (retired = shard->retired; retired != NULL; retired = next) {
+               next = retired->next;
+               free_retired(this, retired);
+          }
+          pthread_mutex_destroy(&(shard->lock));
+     }
+     this->memory.free(this->shards);
+     this->memory.free(this);
+}
+
+/* Takes each shard lock in turn: the statistics are not a snapshot of the whole table. */
+static int stats(struct cad_concurrent_hash_impl *this, cad_hash_stats_t *stats) {
+     unsigned long long total = 0;
+     unsigned int i, j, length, mask;
+     shard_t *shard;
+     node_t *node;
+     memset(stats, 0, sizeof(cad_hash_stats_t));
+     for (i = 0; i < (1U << this->shard_bits); i++) {
+          shard = this->shards + i;
+          if (pthread_mutex_lock(&(shard->lock))) {
+               return -1;
+          }
+          mask = shard->table->capacity - 1;
+          for (j = 0; j < shard->table->capacity; j++) {
+               node = shard->table->slots[j];
+               if (node != NULL && node != TOMBSTONE) {
+                    length = ((j - node->hash) & mask) + 1;
+                    count_probe(stats, length);
+                    total += length;
+               }
+          }
+          stats->capacity += shard->table->capacity;
+          stats->count    += shard->count;
+          stats->grows    += shard->grows;
+          stats->rehashes += shard->rehashes;
+          pthread_mutex_unlock(&(shard->lock));
+     }
+     finish_stats(stats, total);
+     return 0;
+}
+
+static cad_hash_t fn = {
+     (cad_hash_free_fn         )free_        ,
+     (cad_hash_count_fn        )count        ,
+     (cad_hash_iterate_fn      )iterate      ,
+     (cad_hash_get_fn          )get          ,
+     (cad_hash_set_fn          )set          ,
+     (cad_hash_del_fn          )del          ,
+     (cad_hash_clean_fn        )clean        ,
+     (cad_hash_reserve_fn      )reserve      ,
+     (cad_hash_shrink_to_fit_fn)shrink_to_fit,
+     (cad_hash_first_fn        )first        ,
+     (cad_hash_get_many_fn     )get_many     ,
+     (cad_hash_set_many_fn     )set_many     ,
+     (cad_hash_stats_fn        )stats        ,
+};
+
+__PUBLIC__ cad_hash_t *cad_new_concurrent_hash(cad_memory_t memory, cad_hash_keys_t keys, unsigned int shards) {
+     struct cad_concurrent_hash_impl *result;
+     unsigned int i, bits = 0;
+     while ((1U << bits) < shards && bits < 16) {
+          bits++;
+     }
+     result = (struct cad_concurrent_hash_impl *)memory.malloc(sizeof(struct cad_concurrent_hash_impl));
+     if (!result) return NULL;
+     result->fn         = fn;
+     result->memory     = memory;
+     result->keys       = keys;
+     result->shard_bits = bits;
+     init_hash_seed(&(result->seed));
+     result->shards = memory.malloc((1U << bits) * sizeof(shard_t));
+     if (result->shards == NULL) {
+          memory.free(result);
+          return NULL;
+     }
+     for (i = 0; i < (1U << bits); i++) {
+          result->shards[i].table = new_table(result, MIN_CAPACITY);
+          if (result->shards[i].table == NULL) {
+               while (i-- > 0) {
+                    memory.free(result->shards[i].table);
+                    pthread_mutex_destroy(&(result->shards[i].lock));
+               }
+               memory.free(result->shards);
+               memory.free(result);
+               return NULL;
+          }
+          pthread_mutex_init(&(result->shards[i].lock), NULL);
+          result->shards[i].count         = 0;
+          result->shards[i].used          = 0;
+          result->shards[i].retired       = NULL;
+          result->shards[i].retired_count = 0;
+          result->shards[i].grows         = 0;
+          result->shards[i].rehashes      = 0;
+     }
+     return (cad_hash_t*)result;
+}
@@ -0,0 +1,886 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the implementation of frozen hash tables: built
+ * once from another hash table, then only read.
+ *
+ * The layout is a minimal perfect hash, built with the CHD ("hash,
+ * displace and compress") algorithm: the keys are spread into small
+ * buckets, and each bucket gets a displacement, mixed into the hash of
+ * its keys, that sends all of them to free slots. There are exactly as
+ * many slots as keys, and get() reads the displacement of the key's
+ * bucket, then one slot.
+ *
+ * A perfect hash cannot tell apart keys with the same hash. Those
+ * "twins" are kept after the other slots, sorted by hash, and the slot
+ * of their hash points to them.
+ *
+ * A frozen table may also be written to a file and mapped back: the
+ * file holds the same layout, with offsets instead of pointers, and
+ * get() reads straight from the mapped pages.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cad_hash_internal.h"
+
+#define BUCKET_SIZE     4  /* average number of keys per bucket */
+#define MAX_BUCKET_SIZE 64 /* bigger buckets are not expected: retry if found */
+#define MAX_ATTEMPTS    8
+
+typedef struct slot {
+     const void *key;
+     unsigned int hash;
+     unsigned int twins; /* the first slot of the twins, 0 if none */
+     void *value;
+} slot_t;
+
+/* The perfect hash function, shared by frozen and mapped tables. */
+typedef struct perfect {
+     unsigned int attempt;  /* mixed in the derived hashes, changed when the build fails */
+     unsigned int distinct; /* the number of slots reached by the perfect hash */
+     unsigned int buckets;
+     unsigned int *displacements;
+} perfect_t;
+
+struct cad_frozen_hash_impl {
+     cad_hash_t fn;
+     cad_memory_t memory;
+     cad_hash_keys_t keys;
+     hash_seed_t seed;
+     perfect_t perfect;
+     unsigned int count;    /* also the number of slots */
+     char *packed_keys;     /* all the keys, if packed */
+     slot_t *slots;
+};
+
+static const char hole; /* never found in the slots: they are all full */
+
+/* MurmurHash3 finalizer */
+static unsigned int mix(unsigned int h) {
+     h ^= h >> 16;
+     h *= 0x85ebca6b;
+     h ^= h >> 13;
+     h *= 0xc2b2ae35;
+     h ^= h >> 16;
+     return h;
+}
+
+/* Maps a hash to [0, n) without a division. */
+#define range(hash, n) ((unsigned int)(((unsigned long long)(hash) * (n)) >> 32))
+
+static unsigned int bucket_of(const perfect_t *perfect, unsigned int hash) {
+     return range(mix(hash ^ (0x9e3779b9U * (2 * perfect->attempt + 1))), perfect->buckets);
+}
+
+static unsigned int pilot_of(const perfect_t *perfect, unsigned int hash) {
+     return mix(hash ^ (0x9e3779b9U * (2 * perfect->attempt + 2)));
+}
+
+static unsigned int displace(const perfect_t *perfect, unsigned int pilot, unsigned int displacement) {
+     return range(mix(pilot ^ (0x7feb352dU * displacement)), perfect->distinct);
+}
+
+static unsigned int position_of(const perfect_t *perfect, unsigned int hash) {
+     return displace(perfect, pilot_of(perfect, hash), perfect->displacements[bucket_of(perfect, hash)]);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* Build */
+
+typedef struct build_key {
+     unsigned int hash;
+     unsigned int pilot;
+     unsigned int bucket;
+     const void *key;
+     void *value;
+} build_key_t;
+
+typedef struct build_bucket {
+     unsigned int bucket;
+     unsigned int start; /* in the keys sorted by bucket */
+     unsigned int size;
+} build_bucket_t;
+
+static int compare_hashes(const void *a, const void *b) {
+     const build_key_t *ka = a, *kb = b;
+     return ka->hash < kb->hash ? -1 : ka->hash > kb->hash;
+}
+
+static int compare_keys(const void *a, const void *b) {
+     const build_key_t *ka = a, *kb = b;
+     return ka->bucket < kb->bucket ? -1 : ka->bucket > kb->bucket;
+}
+
+static int compare_buckets(const void *a, const void *b) {
+     const build_bucket_t *ba = a, *bb = b;
+     if (ba->size != bb->size) {
+          return ba->size < bb->size ? 1 : -1;
+     }
+     return ba->bucket < bb->bucket ? -1 : ba->bucket > bb->bucket;
+}
+
+/*
+ * Places the distinct keys, biggest buckets first. Returns 0 if some
+ * bucket cannot be placed: the caller then tries other derived hashes.
+ */
+static int place(struct cad_frozen_hash_impl *this, perfect_t *perfect, build_key_t *keys, build_bucket_t *buckets, unsigned char *taken) {
+     unsigned int n = perfect->distinct;
+     unsigned int positions[MAX_BUCKET_SIZE];
+     unsigned int b, i, j, k, d;
+     build_key_t *bucket_keys;
+     int ok;
+
+     for (i = 0; i < n; i++) {
+          keys[i].pilot  = pilot_of(perfect, keys[i].hash);
+          keys[i].bucket = bucket_of(perfect, keys[i].hash);
+     }
+     qsort(keys, n, sizeof(build_key_t), compare_keys);
+     memset(buckets, 0, perfect->buckets * sizeof(build_bucket_t));
+     for (b = 0; b < perfect->buckets; b++) {
+          buckets[b].bucket = b;
+     }
+     for (i = n; i-- > 0; ) {
+          buckets[keys[i].bucket].start = i;
+          if (++buckets[keys[i].bucket].size > MAX_BUCKET_SIZE) {
+               return 0;
+          }
+     }
+     for (b = 0; b < perfect->buckets; b++) {
+          /* keys with the same pilot would never be displaced apart */
+          bucket_keys = keys + buckets[b].start;
+          for (j = 1; j < buckets[b].size; j++) {
+               for (k = 0; k < j; k++) {
+                    if (bucket_keys[j].pilot == bucket_keys[k].pilot) {
+                         return 0;
+                    }
+               }
+          }
+     }
+     qsort(buckets, perfect->buckets, sizeof(build_bucket_t), compare_buckets);
+
+     memset(taken, 0, n);
+     for (b = 0; b < perfect->buckets && buckets[b].size > 0; b++) {
+          bucket_keys = keys + buckets[b].start;
+          d = 0;
+          do {
+               ok = 1;
+               for (j = 0; ok && j < buckets[b].size; j++) {
+                    positions[j] = displace(perfect, bucket_keys[j].pilot, d);
+                    ok = !taken[positions[j]];
+                    for (k = 0; ok && k < j; k++) {
+                         ok = positions[k] != positions[j];
+                    }
+               }
+          } while (!ok && ++d != 0);
+          if (!ok) {
+               return 0;
+          }
+          perfect->displacements[buckets[b].bucket] = d;
+          for (j = 0; j < buckets[b].size; j++) {
+               taken[positions[j]] = 1;
+               this->slots[positions[j]].key   = bucket_keys[j].key;
+               this->slots[positions[j]].hash  = bucket_keys[j].hash;
+               this->slots[positions[j]].twins = 0;
+               this->slots[positions[j]].value = bucket_keys[j].value;
+          }
+     }
+     return 1;
+}
+
+static int build(struct cad_frozen_hash_impl *this, cad_hash_t *source) {
+     perfect_t *perfect = &(this->perfect);
+     unsigned int n = this->count, i, t;
+     build_key_t *keys = this->memory.malloc(n * sizeof(build_key_t));
+     build_bucket_t *buckets = NULL;
+     unsigned char *taken = NULL;
+     slot_t *twin, swap;
+     cad_hash_cursor_t cursor;
+     int more, result = 0;
+
+     if (keys == NULL) {
+          return 0;
+     }
+     i = 0;
+     for (more = source->first(source, &cursor); more; more = cad_hash_next(&cursor)) {
+          keys[i].key   = cad_hash_key(&cursor);
+          keys[i].value = cad_hash_value(&cursor);
+          keys[i].hash  = hash_key(&(this->keys), &(this->seed), keys[i].key);
+          i++;
+     }
+
+     /* the twins go to the last slots, the other keys stay in front */
+     qsort(keys, n, sizeof(build_key_t), compare_hashes);
+     perfect->distinct = 0;
+     t = n;
+     for (i = 0; i < n; i++) {
+          if (i > 0 && keys[i].hash == keys[i - 1].hash) {
+               twin = this->slots + --t;
+               twin->key   = keys[i].key;
+               twin->hash  = keys[i].hash;
+               twin->twins = 0;
+               twin->value = keys[i].value;
+          } else {
+               keys[perfect->distinct++] = keys[i];
+          }
+     }
+
+     perfect->buckets = (perfect->distinct + BUCKET_SIZE - 1) / BUCKET_SIZE;
+     buckets = this->memory.malloc(perfect->buckets * sizeof(build_bucket_t));
+     taken = this->memory.malloc(perfect->distinct);
+     if (buckets != NULL && taken != NULL) {
+          for (perfect->attempt = 0; !result && perfect->attempt < MAX_ATTEMPTS; perfect->attempt++) {
+               result = place(this, perfect, keys, buckets, taken);
+          }
+          perfect->attempt--;
+     }
+
+     if (result) {
+          /* the twins were stored backwards */
+          for (i = perfect->distinct, t = n - 1; i < t; i++, t--) {
+               swap = this->slots[i];
+               this->slots[i] = this->slots[t];
+               this->slots[t] = swap;
+          }
+          for (i = perfect->distinct; i < n; i++) {
+               if (i == perfect->distinct || this->slots[i].hash != this->slots[i - 1].hash) {
+                    this->slots[position_of(perfect, this->slots[i].hash)].twins = i;
+               }
+          }
+     }
+
+     this->memory.free(taken);
+     this->memory.free(buckets);
+     this->memory.free(keys);
+     return result;
+}
+
+/* Copies the keys like cad_new_hash() would: cloned, packed or borrowed. */
+static int copy_keys(struct cad_frozen_hash_impl *this) {
+     size_t size = 0, key_size;
+     unsigned int i;
+     char *ptr;
+     if (this->keys.clone != NULL) {
+          for (i = 0; i < this->count; i++) {
+               this->slots[i].key = this->keys.clone(this->slots[i].key);
+               if (this->slots[i].key == NULL) {
+                    while (i-- > 0) {
+                         this->keys.free((void*)this->slots[i].key);
+                    }
+                    return 0;
+               }
+          }
+     } else if (this->keys.size != NULL) {
+          for (i = 0; i < this->count; i++) {
+               size += this->keys.size(this->slots[i].key);
+          }
+          this->packed_keys = ptr = this->memory.malloc(size);
+          if (ptr == NULL && size > 0) {
+               return 0;
+          }
+          for (i = 0; i < this->count; i++) {
+               key_size = this->keys.size(this->slots[i].key);
+               memcpy(ptr, this->slots[i].key, key_size);
+               this->slots[i].key = ptr;
+               ptr += key_size;
+          }
+     }
+     return 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void free_(struct cad_frozen_hash_impl *this) {
+     unsigned int i;
+     if (this->keys.clone != NULL) {
+          for (i = 0; i < this->count; i++) {
+               this->keys.free((void*)this->slots[i].key);
+          }
+     }
+     this->memory.free(this->packed_keys);
+     this->memory.free(this);
+}
+
+static unsigned int count(struct cad_frozen_hash_impl *this) {
+     return this->count;
+}
+
+static void iterate(struct cad_frozen_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
+     unsigned int i;
+     for (i = 0; i < this->count; i++) {
+          iterator(this, i, this->slots[i].key, this->slots[i].value, data);
+     }
+}
+
+static void *find(struct cad_frozen_hash_impl *this, slot_t *slot, unsigned int hash, const void *key) {
+     slot_t *end;
+     if (slot->hash != hash) {
+          return NULL;
+     }
+     if (!this->keys.compare(key, slot->key)) {
+          return slot->value;
+     }
+     if (slot->twins != 0) {
+          end = this->slots + this->count;
+          for (slot = this->slots + slot->twins; slot < end && slot->hash == hash; slot++) {
+               if (!this->keys.compare(key, slot->key)) {
+                    return slot->value;
+               }
+          }
+     }
+     return NULL;
+}
+
+static void *get(struct cad_frozen_hash_impl *this, const void *key) {
+     unsigned int hash;
+     if (this->count == 0) {
+          return NULL;
+     }
+     hash = hash_key(&(this->keys), &(this->seed), key);
+     return find(this, this->slots + position_of(&(this->perfect), hash), hash, key);
+}
+
+static void *set(struct cad_frozen_hash_impl *this, const void *key, void *value) {
+     return NULL;
+}
+
+static void *del(struct cad_frozen_hash_impl *this, const void *key) {
+     return NULL;
+}
+
+static void clean(struct cad_frozen_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
+     /* read-only */
+}
+
+static int reserve(struct cad_frozen_hash_impl *this, unsigned int count) {
+     return count <= this->count ? 0 : -1;
+}
+
+static int shrink_to_fit(struct cad_frozen_hash_impl *this) {
+     return 0;
+}
+
+static int first(struct cad_frozen_hash_impl *this, cad_hash_cursor_t *cursor) {
+     cursor->hash         = (cad_hash_t*)this;
+     cursor->entries      = (const char*)this->slots;
+     cursor->stride       = sizeof(slot_t);
+     cursor->value_offset = offsetof(slot_t, value);
+     cursor->hole         = &hole;
+     cursor->position     = (unsigned int)-1;
+     cursor->end          = this->count;
+     cursor->next         = NULL;
+     return cad_hash_next(cursor);
+}
+
+#define BATCH_SIZE 16
+
+/* Same passes as cad_hash: each one prefetches what the next one needs. */
+static void get_many(struct cad_frozen_hash_impl *this, const void *const *keys, unsigned int count, void **values) {
+     unsigned int hashes[BATCH_SIZE];
+     slot_t *slots[BATCH_SIZE];
+     unsigned int i, j, n;
+     if (this->count == 0) {
+          memset(values, 0, count * sizeof(void*));
+          return;
+     }
+     for (i = 0; i < count; i += n) {
+          n = count - i < BATCH_SIZE ? count - i : BATCH_SIZE;
+          for (j = 0; j < n; j++) {
+               hashes[j] = hash_key(&(this->keys), &(this->seed), keys[i + j]);
+               __builtin_prefetch(this->perfect.displacements + bucket_of(&(this->perfect), hashes[j]));
+          }
+          for (j = 0; j < n; j++) {
+               slots[j] = this->slots + position_of(&(this->perfect), hashes[j]);
+               __builtin_prefetch(slots[j]);
+          }
+          for (j = 0; j < n; j++) {
+               __builtin_prefetch(slots[j]->key);
+          }
+          for (j = 0; j < n; j++) {
+               values[i + j] = find(this, slots[j], hashes[j], keys[i + j]);
+          }
+     }
+}
+
+static void set_many(struct cad_frozen_hash_impl *this, const void *const *keys, void *const *values, unsigned int count, void **old_values) {
+     if (old_values != NULL) {
+          memset(old_values, 0, count * sizeof(void*));
+     }
+}
+
+/*
+ * A key is found at the first probe, unless it is a twin: then the
+ * main slot and the twins before it are read too. `hashes` points to
+ * the hash of the first slot, and slots are `stride` bytes apart.
+ */
+static void stats_of(const char *hashes, size_t stride, unsigned int count, unsigned int distinct, cad_hash_stats_t *stats) {
+     unsigned long long total = 0;
+     unsigned int i, length = 1, hash, previous = 0;
+     memset(stats, 0, sizeof(cad_hash_stats_t));
+     stats->capacity = count;
+     stats->count    = count;
+     for (i = 0; i < count; i++) {
+          hash = *(const unsigned int*)(hashes + i * stride);
+          if (i < distinct) {
+               length = 1;
+          } else if (i == distinct || hash != previous) {
+               length = 2;
+          } else {
+               length++;
+          }
+          previous = hash;
+          count_probe(stats, length);
+          total += length;
+     }
+     finish_stats(stats, total);
+}
+
+static int stats(struct cad_frozen_hash_impl *this, cad_hash_stats_t *stats) {
+     stats_of((const char*)&(this->slots[0].hash), sizeof(slot_t), this->count, this->perfect.distinct, stats);
+     return 0;
+}
+
+static cad_hash_t fn = {
+     (cad_hash_free_fn         )free_        ,
+     (cad_hash_count_fn        )count        ,
+     (cad_hash_iterate_fn      )iterate      ,
+     (cad_hash_get_fn          )get          ,
+     (cad_hash_set_fn          )set          ,
+     (cad_hash_del_fn          )del          ,
+     (cad_hash_clean_fn        )clean        ,
+     (cad_hash_reserve_fn      )reserve      ,
+     (cad_hash_shrink_to_fit_fn)shrink_to_fit,
+     (cad_hash_first_fn        )first        ,
+     (cad_hash_get_many_fn     )get_many     ,
+     (cad_hash_set_many_fn     )set_many     ,
+     (cad_hash_stats_fn        )stats        ,
+};
+
+__PUBLIC__ cad_hash_t *cad_new_frozen_hash(cad_memory_t memory, cad_hash_keys_t keys, cad_hash_t *source) {
+     struct cad_frozen_hash_impl *result;
+     unsigned int n = source->count(source);
+     size_t size = sizeof(struct cad_frozen_hash_impl) + (n + BUCKET_SIZE - 1) / BUCKET_SIZE * sizeof(unsigned int);
+
+     /* one block: the header, the displacements, then the slots */
+     size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+     result = (struct cad_frozen_hash_impl *)memory.malloc(size + n * sizeof(slot_t));
+     if (!result) return NULL;
+     result->fn            = fn;
+     result->memory        = memory;
+     result->keys          = keys;
+     result->count         = n;
+     result->packed_keys   = NULL;
+     result->slots         = (slot_t*)((char*)result + size);
+     memset(&(result->perfect), 0, sizeof(perfect_t));
+     result->perfect.displacements = (unsigned int*)(result + 1);
+     init_hash_seed(&(result->seed));
+     if (n > 0 && (!build(result, source) || !copy_keys(result))) {
+          memory.free(result);
+          return NULL;
+     }
+     return (cad_hash_t*)result;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* Mapped files */
+
+/*
+ * File layout: the header, the displacements, the slots, then the
+ * keys and values. Offsets are counted from the start of the file.
+ * The file uses the native byte order and word size.
+ */
+
+#define MAPPED_MAGIC      "libcadH1"
+#define MAPPED_BYTE_ORDER 0x01020304U
+#define MAPPED_RAW_VALUES 1 /* the values are stored in the slots, not in the file */
+#define MAPPED_VALUE_ALIGN 16
+
+typedef struct mapped_header {
+     char magic[8];
+     unsigned int byte_order;
+     unsigned int flags;
+     unsigned int count;
+     unsigned int distinct;
+     unsigned int buckets;
+     unsigned int attempt;
+     int salt;
+     unsigned int pad;
+     unsigned long long seed[2];
+     unsigned long long size; /* of the whole file */
+} mapped_header_t;
+
+typedef struct mapped_slot {
+     unsigned long long key;   /* offset */
+     unsigned int hash;
+     unsigned int twins;
+     unsigned long long value; /* offset, or the value itself */
+} mapped_slot_t;
+
+#define MAPPED_SLOTS(buckets) ((sizeof(mapped_header_t) + (buckets) * sizeof(unsigned int) + 7) & ~(size_t)7)
+
+struct cad_mapped_hash_impl {
+     cad_hash_t fn;
+     cad_memory_t memory;
+     cad_hash_keys_t keys;
+     hash_seed_t seed;
+     perfect_t perfect;
+     unsigned int count;
+     int raw_values;
+     const char *base;
+     size_t size;
+     const mapped_slot_t *slots;
+};
+
+#define ALIGN_VALUE(offset) (((offset) + MAPPED_VALUE_ALIGN - 1) & ~(unsigned long long)(MAPPED_VALUE_ALIGN - 1))
+
+/*
+ * Walks the keys and values in the file order, from `offset`; writes
+ * them if `file` is not NULL. Returns the offset of the end, 0 on
+ * error.
+ */
+static unsigned long long write_data(FILE *file, struct cad_frozen_hash_impl *frozen, cad_hash_keys_t keys, cad_hash_value_size_fn value_size, unsigned long long offset, mapped_slot_t *slots) {
+     static const char zero[MAPPED_VALUE_ALIGN] = { 0 };
+     size_t size, pad;
+     unsigned int i;
+     for (i = 0; i < frozen->count; i++) {
+          size = keys.size(frozen->slots[i].key);
+          if (slots != NULL) {
+               slots[i].key = offset;
+          }
+          if (file != NULL && fwrite(frozen->slots[i].key, 1, size, file) != size) {
+               return 0;
+          }
+          offset += size;
+          if (value_size != NULL) {
+               pad = ALIGN_VALUE(offset) - offset;
+               size = value_size(frozen->slots[i].value);
+               if (slots != NULL) {
+                    slots[i].value = offset + pad;
+               }
+               if (file != NULL && (fwrite(zero, 1, pad, file) != pad || fwrite(frozen->slots[i].value, 1, size, file) != size)) {
+                    return 0;
+               }
+               offset += pad + size;
+          }
+     }
+     return offset;
+}
+
+static int write_mapped(FILE *file, struct cad_frozen_hash_impl *frozen, cad_hash_keys_t keys, cad_hash_value_size_fn value_size) {
+     static const char zero[8] = { 0 };
+     mapped_header_t header;
+     mapped_slot_t *slots;
+     size_t pad;
+     unsigned long long data = MAPPED_SLOTS(frozen->perfect.buckets) + (unsigned long long)frozen->count * sizeof(mapped_slot_t);
+     unsigned int i;
+     int result = 0;
+
+     slots = malloc(frozen->count * sizeof(mapped_slot_t) + 1);
+     if (slots == NULL) {
+          return 0;
+     }
+     for (i = 0; i < frozen->count; i++) {
+          slots[i].hash  = frozen->slots[i].hash;
+          slots[i].twins = frozen->slots[i].twins;
+          slots[i].value = (unsigned long long)(size_t)frozen->slots[i].value;
+     }
+
+     memset(&header, 0, sizeof(mapped_header_t));
+     memcpy(header.magic, MAPPED_MAGIC, sizeof(header.magic));
+     header.byte_order = MAPPED_BYTE_ORDER;
+     header.flags      = value_size == NULL ? MAPPED_RAW_VALUES : 0;
+     header.count      = frozen->count;
+     header.distinct   = frozen->perfect.distinct;
+     header.buckets    = frozen->perfect.buckets;
+     header.attempt    = frozen->perfect.attempt;
+     header.salt       = frozen->seed.salt;
+     header.seed[0]    = frozen->seed.key[0];
+     header.seed[1]    = frozen->seed.key[1];
+     header.size       = write_data(NULL, frozen, keys, value_size, data, slots);
+
+     pad = MAPPED_SLOTS(header.buckets) - sizeof(mapped_header_t) - header.buckets * sizeof(unsigned int);
+     result = fwrite(&header, sizeof(mapped_header_t), 1, file) == 1
+          && fwrite(frozen->perfect.displacements, sizeof(unsigned int), header.buckets, file) == header.buckets
+          && fwrite(zero, 1, pad, file) == pad
+          && fwrite(slots, sizeof(mapped_slot_t), header.count, file) == header.count
+          && write_data(file, frozen, keys, value_size, data, NULL) == header.size;
+     free(slots);
+     return result;
+}
+
+__PUBLIC__ int cad_hash_write_mapped(cad_hash_t *hash, cad_hash_keys_t keys, cad_hash_value_size_fn value_size, const char *path) {
+     struct cad_frozen_hash_impl *frozen;
+     size_t length = strlen(path);
+     char *tmp;
+     FILE *file;
+     int fd, ok = 0;
+
+     if (keys.size == NULL) {
+          return -1;
+     }
+     if (hash->free == (cad_hash_free_fn)free_) {
+          frozen = (struct cad_frozen_hash_impl *)hash;
+     } else {
+          frozen = (struct cad_frozen_hash_impl *)cad_new_frozen_hash(stdlib_memory, cad_hash_borrowed_keys(keys), hash);
+          if (frozen == NULL) {
+               return -1;
+          }
+     }
+
+     /* write aside then rename, so that processes mapping the old file
+      * keep it whole; the unique name keeps concurrent writers apart
+      * (mkstemp() makes the file private, hence the fchmod()) */
+     tmp = malloc(length + 8);
+     if (tmp != NULL) {
+          memcpy(tmp, path, length);
+          memcpy(tmp + length, ".XXXXXX", 8);
+          fd = mkstemp(tmp);
+          if (fd != -1) {
+               file = fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) ? NULL : fdopen(fd, "wb");
+               if (file != NULL) {
+                    ok = write_mapped(file, frozen, keys, value_size);
+                    ok = !fclose(file) && ok;
+                    ok = ok && !rename(tmp, path);
+               } else {
+                    close(fd);
+               }
+               if (!ok) {
+                    unlink(tmp);
+               }
+          }
+          free(tmp);
+     }
+
+     if (frozen != (struct cad_frozen_hash_impl *)hash) {
+          free_(frozen);
+     }
+     return ok ? 0 : -1;
+}
+
+static void mapped_free(struct cad_mapped_hash_impl *this) {
+     munmap((void*)this->base, this->size);
+     this->memory.free(this);
+}
+
+static unsigned int mapped_count(struct cad_mapped_hash_impl *this) {
+     return this->count;
+}
+
+static void *mapped_value(struct cad_mapped_hash_impl *this, const mapped_slot_t *slot) {
+     return this->raw_values ? (void*)(size_t)slot->value : (void*)(this->base + slot->value);
+}
+
+static void mapped_iterate(struct cad_mapped_hash_impl *this, cad_hash_iterator_fn iterator, void *data) {
+     unsigned int i;
+     for (i = 0; i < this->count; i++) {
+          iterator(this, i, this->base + this->slots[i].key, mapped_value(this, this->slots + i), data);
+     }
+}
+
+static void *mapped_find(struct cad_mapped_hash_impl *this, const mapped_slot_t *slot, unsigned int hash, const void *key) {
+     const mapped_slot_t *end;
+     if (slot->hash != hash) {
+          return NULL;
+     }
+     if (!this->keys.compare(key, this->base + slot->key)) {
+          return mapped_value(this, slot);
+     }
+     if (slot->twins != 0) {
+          end = this->slots + this->count;
+          for (slot = this->slots + slot->twins; slot < end && slot->hash == hash; slot++) {
+               if (!this->keys.compare(key, this->base + slot->key)) {
+                    return mapped_value(this, slot);
+               }
+          }
+     }
+     return NULL;
+}
+
+static void *mapped_get(struct cad_mapped_hash_impl *this, const void *key) {
+     unsigned int hash;
+     if (this->count == 0) {
+          return NULL;
+     }
+     hash = hash_key(&(this->keys), &(this->seed), key);
+     return mapped_find(this, this->slots + position_of(&(this->perfect), hash), hash, key);
+}
+
+static int mapped_reserve(struct cad_mapped_hash_impl *this, unsigned int count) {
+     return count <= this->count ? 0 : -1;
+}
+
+static int mapped_next(cad_hash_cursor_t *cursor) {
+     struct cad_mapped_hash_impl *this = (struct cad_mapped_hash_impl *)cursor->hash;
+     if (++cursor->position < cursor->end) {
+          cursor->key   = this->base + this->slots[cursor->position].key;
+          cursor->value = mapped_value(this, this->slots + cursor->position);
+          return 1;
+     }
+     return 0;
+}
+
+static int mapped_first(struct cad_mapped_hash_impl *this, cad_hash_cursor_t *cursor) {
+     cursor->hash     = (cad_hash_t*)this;
+     cursor->entries  = NULL;
+     cursor->position = (unsigned int)-1;
+     cursor->end      = this->count;
+     cursor->next     = mapped_next;
+     return mapped_next(cursor);
+}
+
+static void mapped_get_many(struct cad_mapped_hash_impl *this, const void *const *keys, unsigned int count, void **values) {
+     unsigned int hashes[BATCH_SIZE];
+     const mapped_slot_t *slots[BATCH_SIZE];
+     unsigned int i, j, n;
+     if (this->count == 0) {
+          memset(values, 0, count * sizeof(void*));
+          return;
+     }
+     for (i = 0; i < count; i += n) {
+          n = count - i < BATCH_SIZE ? count - i : BATCH_SIZE;
+          for (j = 0; j < n; j++) {
+               hashes[j] = hash_key(&(this->keys), &(this->seed), keys[i + j]);
+               __builtin_prefetch(this->perfect.displacements + bucket_of(&(this->perfect), hashes[j]));
+          }
+          for (j = 0; j < n; j++) {
+               slots[j] = this->slots + position_of(&(this->perfect), hashes[j]);
+               __builtin_prefetch(slots[j]);
+          }
+          for (j = 0; j < n; j++) {
+               __builtin_prefetch(this->base + slots[j]->key);
+          }
+          for (j = 0; j < n; j++) {
+               values[i + j] = mapped_find(this, slots[j], hashes[j], keys[i + j]);
+          }
+     }
+}
+
+static int mapped_stats(struct cad_mapped_hash_impl *this, cad_hash_stats_t *stats) {
+     stats_of((const char*)&(this->slots[0].hash), sizeof(mapped_slot_t), this->count, this->perfect.distinct, stats);
+     return 0;
+}
+
+static cad_hash_t mapped_fn = {
+     (cad_hash_free_fn         )mapped_free    ,
+     (cad_hash_count_fn        )mapped_count   ,
+     (cad_hash_iterate_fn      )mapped_iterate ,
+     (cad_hash_get_fn          )mapped_get     ,
+     (cad_hash_set_fn          )set            ,
+     (cad_hash_del_fn          )del            ,
+     (cad_hash_clean_fn        )clean          ,
+     (cad_hash_reserve_fn      )mapped_reserve ,
+     (cad_hash_shrink_to_fit_fn)shrink_to_fit  ,
+     (cad_hash_first_fn        )mapped_first   ,
+     (cad_hash_get_many_fn     )mapped_get_many,
+     (cad_hash_set_many_fn     )set_many       ,
+     (cad_hash_stats_fn        )mapped_stats   ,
+};
+
+static int check_header(const mapped_header_t *header, size_t size) {
+     return size >= sizeof(mapped_header_t)
+          && !memcmp(header->magic, MAPPED_MAGIC, sizeof(header->magic))
+          && header->byte_order == MAPPED_BYTE_ORDER
+          && header->size == size
+          && header->distinct <= header->count
+          && header->buckets == (header->distinct + BUCKET_SIZE - 1) / BUCKET_SIZE
+          && (header->count == 0 || header->distinct > 0)
+          && MAPPED_SLOTS(header->buckets) + (unsigned long long)header->count * sizeof(mapped_slot_t) <= size;
+}
+
+/*
+ * One pass over the slots, without reading the keys: the keys and
+ * values must lie in the data part of the file, in the order they
+ * were written, and the twins must be slots. Only the extent of the
+ * last key or value cannot be checked.
+ */
+static int check_slots(const mapped_header_t *header, const mapped_slot_t *slots, size_t size) {
+     unsigned long long offset = MAPPED_SLOTS(header->buckets) + (unsigned long long)header->count * sizeof(mapped_slot_t);
+     int raw_values = header->flags & MAPPED_RAW_VALUES;
+     unsigned int i;
+     for (i = 0; i < header->count; i++) {
+          if (slots[i].key < offset || slots[i].key >= size || slots[i].twins >= header->count) {
+               return 0;
+          }
+          offset = slots[i].key;
+          if (!raw_values) {
+               if (slots[i].value < offset || slots[i].value > size) {
+                    return 0;
+               }
+               offset = slots[i].value;
+          }
+     }
+     return 1;
+}
+
+__PUBLIC__ cad_hash_t *cad_new_mapped_hash(cad_memory_t memory, cad_hash_keys_t keys, const char *path) {
+     struct cad_mapped_hash_impl *result;
+     const mapped_header_t *header;
+     struct stat st;
+     void *base;
+     int fd;
+
+     fd = open(path, O_RDONLY);
+     if (fd < 0) {
+          return NULL;
+     }
+     if (fstat(fd, &st) || (size_t)st.st_size < sizeof(mapped_header_t)) {
+          close(fd);
+          return NULL;
+     }
+     base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+     close(fd);
+     if (base == MAP_FAILED) {
+          return NULL;
+     }
+     header = base;
+     if (!check_header(header, st.st_size) || !check_slots(header, (const mapped_slot_t*)((const char*)base + MAPPED_SLOTS(header->buckets)), st.st_size)) {
+          munmap(base, st.st_size);
+          return NULL;
+     }
+
+     result = (struct cad_mapped_hash_impl *)memory.malloc(sizeof(struct cad_mapped_hash_impl));
+     if (!result) {
+          munmap(base, st.st_size);
+          return NULL;
+     }
+     result->fn                     = mapped_fn;
+     result->memory                 = memory;
+     result->keys                   = keys;
+     result->seed.salt              = header->salt;
+     result->seed.key[0]            = header->seed[0];
+     result->seed.key[1]            = header->seed[1];
+     result->perfect.attempt        = header->attempt;
+     result->perfect.distinct       = header->distinct;
+     result->perfect.buckets        = header->buckets;
+     result->perfect.displacements  = (unsigned int*)(header + 1);
+     result->count                  = header->count;
+     result->raw_values             = header->flags & MAPPED_RAW_VALUES;
+     result->base                   = base;
+     result->size                   = st.st_size;
+     result->slots                  = (const mapped_slot_t*)((const char*)base + MAPPED_SLOTS(header->buckets));
+     return (cad_hash_t*)result;
+}
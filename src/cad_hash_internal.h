@@ -0,0 +1,181 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the internal header shared by the hash tables.
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cad_hash.h"
+#include "cad_memory.h"
+
+/**
+ * The salt of a hash table, and the same salt as a 128-bit key for
+ * the keyed hash functions.
+ */
+typedef struct hash_seed {
+     int salt;
+     unsigned long long key[2];
+} hash_seed_t;
+
+/**
+ * Draws a new salt (see set_hash_salt()).
+ */
+void init_hash_seed(hash_seed_t *seed);
+
+/**
+ * Hashes a key with the given seed. All the bits of the result are
+ * well spread, even if the keys' hash function is poor.
+ */
+unsigned int hash_key(const cad_hash_keys_t *keys, const hash_seed_t *seed, const void *key);
+
+/**
+ * Copies a key the way the keys manager says: cloned if it has a
+ * `clone` function, packed (copied in a block of `memory`) if it only
+ * has a `size` function, borrowed otherwise. Returns `NULL` on error,
+ * or if the key is `NULL` and borrowed.
+ *
+ * The hash tables pack their keys in chunks instead; the other
+ * containers use this function, so that all of them agree on the key
+ * modes.
+ */
+const void *clone_hash_key(cad_memory_t memory, const cad_hash_keys_t *keys, const void *key);
+
+/**
+ * Frees a key copied by clone_hash_key().
+ */
+void free_hash_key(cad_memory_t memory, const cad_hash_keys_t *keys, const void *key);
+
+/*
+ * Packed keys are copied in chunks allocated from the table's memory;
+ * the chunk in use is the first one. Also used by the string interning
+ * table for its atoms.
+ */
+typedef struct key_chunk {
+     struct key_chunk *next;
+     size_t capacity;
+     size_t used;
+} key_chunk_t;
+
+#define KEY_CHUNK_SIZE 4096
+#define KEY_ALIGN sizeof(void*)
+#define KEY_ALIGNED(size) (((size) + KEY_ALIGN - 1) & ~(KEY_ALIGN - 1))
+#define KEY_CHUNK_HEADER KEY_ALIGNED(sizeof(key_chunk_t))
+
+/**
+ * Copies the `size` bytes of `key` in the `chunks`, allocating a new
+ * chunk from `memory` if needed. Returns the copy, `NULL` on error.
+ */
+const void *pack_key(cad_memory_t memory, key_chunk_t **chunks, const void *key, size_t size);
+
+/**
+ * Frees all the `chunks` (`ex` is cad_memory_ex() of `memory`).
+ */
+void free_key_chunks(cad_memory_t memory, cad_memory_ex_t *ex, key_chunk_t *chunks);
+
+/**
+ * Counts a key found after `length` probes in the histogram and the
+ * maximum of `stats`.
+ */
+void count_probe(cad_hash_stats_t *stats, unsigned int length);
+
+/**
+ * Computes the load factor and the average probe length of `stats`,
+ * given the `total` of the probe lengths.
+ */
+void finish_stats(cad_hash_stats_t *stats, unsigned long long total);
+
+/*
+ * The "Swiss table" index primitives, shared by the hash tables and
+ * the hash sets: one control byte per slot, probed by groups of
+ * GROUP_SIZE slots.
+ */
+
+#define GROUP_SIZE 16
+
+#define CTRL_EMPTY   ((unsigned char)0x80)
+#define CTRL_DELETED ((unsigned char)0xfe)
+
+#define is_full(ctrl) (((ctrl) & 0x80) == 0)
+#define tag_of(hash) ((unsigned char)((hash) & 0x7f))
+#define group_of(hash) ((hash) >> 7)
+
+#ifdef __SSE2__
+
+static inline unsigned int match_tag(const unsigned char *group, unsigned char tag) {
+     __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+     return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+}
+
+static inline unsigned int match_free(const unsigned char *group) {
+     /* EMPTY and DELETED are the only control bytes with the high bit set */
+     return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+}
+
+#else
+
+static inline unsigned int match_tag(const unsigned char *group, unsigned char tag) {
+     unsigned int result = 0;
+     int i;
+     for (i = 0; i < GROUP_SIZE; i++) {
+          if (group[i] == tag) {
+               result |= 1U << i;
+          }
+     }
+     return result;
+}
+
+static inline unsigned int match_free(const unsigned char *group) {
+     unsigned int result = 0;
+     int i;
+     for (i = 0; i < GROUP_SIZE; i++) {
+          if (!is_full(group[i])) {
+               result |= 1U << i;
+          }
+     }
+     return result;
+}
+
+#endif
+
+#define match_empty(group) match_tag((group), CTRL_EMPTY)
+
+/*
+ * The probe sequence visits groups in triangular order, which covers
+ * all the groups when their number is a power of two.
+ */
+typedef struct probe {
+     unsigned int mask;
+     unsigned int group;
+     unsigned int step;
+} probe_t;
+
+static inline void start_probe(probe_t *probe, unsigned int capacity, unsigned int hash) {
+     probe->mask  = capacity / GROUP_SIZE - 1;
+     probe->group = group_of(hash) & probe->mask;
+     probe->step  = 0;
+}
+
+static inline void next_probe(probe_t *probe) {
+     probe->step++;
+     probe->group = (probe->group + probe->step) & probe->mask;
+}
@@ -0,0 +1,182 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the string hash functions of the
+ * cad_hash_strings_fast and cad_hash_strings_siphash keys managers.
+ *
+ * Both read the string eight bytes at a time once its length is
+ * known (`strlen` is itself vectorized by the libc).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cad_hash.h"
+
+static const unsigned long long zero_seed[2] = { 0, 0 };
+
+static uint64_t read64(const unsigned char *p) {
+     uint64_t result;
+     memcpy(&result, p, 8);
+     return result;
+}
+
+static uint64_t read32(const unsigned char *p) {
+     uint32_t result;
+     memcpy(&result, p, 4);
+     return result;
+}
+
+static size_t string_size(const char *key) {
+     return strlen(key) + 1;
+}
+
+static unsigned int fold(uint64_t h) {
+     return (unsigned int)(h ^ (h >> 32));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* wyhash (final version 4), by Wang Yi -- public domain */
+
+static const uint64_t wyp[4] = {
+     0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+};
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+     __uint128_t r = (__uint128_t)a * b;
+     return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static uint64_t wyhash(const unsigned char *p, size_t len, uint64_t seed) {
+     uint64_t a, b, see1, see2;
+     size_t i = len;
+     __uint128_t r;
+
+     seed ^= wymix(seed ^ wyp[0], wyp[1]);
+     if (len <= 16) {
+          if (len >= 4) {
+               a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+               b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+          } else if (len > 0) {
+               a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+               b = 0;
+          } else {
+               a = b = 0;
+          }
+     } else {
+          if (i > 48) {
+               see1 = see2 = seed;
+               do {
+                    seed = wymix(read64(p) ^ wyp[1], read64(p + 8) ^ seed);
+                    see1 = wymix(read64(p + 16) ^ wyp[2], read64(p + 24) ^ see1);
+                    see2 = wymix(read64(p + 32) ^ wyp[3], read64(p + 40) ^ see2);
+                    p += 48;
+                    i -= 48;
+               } while (i > 48);
+               seed ^= see1 ^ see2;
+          }
+          while (i > 16) {
+               seed = wymix(read64(p) ^ wyp[1], read64(p + 8) ^ seed);
+               p += 16;
+               i -= 16;
+          }
+          a = read64(p + i - 16);
+          b = read64(p + i - 8);
+     }
+     r = (__uint128_t)(a ^ wyp[1]) * (b ^ seed);
+     return wymix((uint64_t)r ^ wyp[0] ^ len, (uint64_t)(r >> 64) ^ wyp[1]);
+}
+
+static unsigned int fast_salted_hash(const char *key, const unsigned long long seed[2]) {
+     return fold(wyhash((const unsigned char *)key, strlen(key), seed[0] ^ seed[1]));
+}
+
+static unsigned int fast_hash(const char *key) {
+     return fast_salted_hash(key, zero_seed);
+}
+
+__PUBLIC__ cad_hash_keys_t cad_hash_strings_fast = {
+     (cad_hash_keys_hash_fn)fast_hash,
+     (cad_hash_keys_compare_fn)strcmp,
+     (cad_hash_keys_clone_fn)strdup,
+     (cad_hash_keys_free_fn)free,
+     (cad_hash_keys_salted_hash_fn)fast_salted_hash,
+     (cad_hash_keys_size_fn)string_size,
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* SipHash-2-4, by Jean-Philippe Aumasson and Daniel J. Bernstein */
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3) do {                                   \
+          v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);     \
+          v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                        \
+          v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                        \
+          v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);     \
+     } while (0)
+
+static uint64_t siphash(const unsigned char *p, size_t len, uint64_t k0, uint64_t k1) {
+     uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+     uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+     uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+     uint64_t v3 = 0x7465646279746573ULL ^ k1;
+     uint64_t m, last = (uint64_t)len << 56;
+     const unsigned char *end = p + (len & ~(size_t)7);
+     int i;
+
+     for (; p != end; p += 8) {
+          m = read64(p);
+          v3 ^= m;
+          SIPROUND(v0, v1, v2, v3);
+          SIPROUND(v0, v1, v2, v3);
+          v0 ^= m;
+     }
+     for (i = len & 7; i > 0; i--) {
+          last |= (uint64_t)p[i - 1] << (8 * (i - 1));
+     }
+     v3 ^= last;
+     SIPROUND(v0, v1, v2, v3);
+     SIPROUND(v0, v1, v2, v3);
+     v0 ^= last;
+     v2 ^= 0xff;
+     SIPROUND(v0, v1, v2, v3);
+     SIPROUND(v0, v1, v2, v3);
+     SIPROUND(v0, v1, v2, v3);
+     SIPROUND(v0, v1, v2, v3);
+     return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static unsigned int siphash_salted_hash(const char *key, const unsigned long long seed[2]) {
+     return fold(siphash((const unsigned char *)key, strlen(key), seed[0], seed[1]));
+}
+
+static unsigned int siphash_hash(const char *key) {
+     return siphash_salted_hash(key, zero_seed);
+}
+
+__PUBLIC__ cad_hash_keys_t cad_hash_strings_siphash = {
+     (cad_hash_keys_hash_fn)siphash_hash,
+     (cad_hash_keys_compare_fn)strcmp,
+     (cad_hash_keys_clone_fn)strdup,
+     (cad_hash_keys_free_fn)free,
+     (cad_hash_keys_salted_hash_fn)siphash_salted_hash,
+     (cad_hash_keys_size_fn)string_size,
+};
@@ -0,0 +1,89 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the implementation of the string interning
+ * table.
+ *
+ * The atoms are packed in chunks allocated from the table's memory
+ * manager, the same way as the packed keys of the hash tables, and
+ * indexed by a hash table that borrows them as keys (and stores them
+ * as values, so that get() returns the atom).
+ */
+
+#include <string.h>
+
+#include "cad_hash_internal.h"
+#include "cad_intern.h"
+#include "cad_memory.h"
+
+struct cad_intern_impl {
+     cad_intern_t fn;
+     cad_memory_t memory;
+     cad_memory_ex_t *ex;
+     cad_hash_t *atoms;
+     key_chunk_t *chunks;
+};
+
+static void free_(struct cad_intern_impl *this) {
+     free_key_chunks(this->memory, this->ex, this->chunks);
+     this->atoms->free(this->atoms);
+     this->memory.free(this);
+}
+
+static unsigned int count(struct cad_intern_impl *this) {
+     return this->atoms->count(this->atoms);
+}
+
+static const char *lookup(struct cad_intern_impl *this, const char *string) {
+     return this->atoms->get(this->atoms, string);
+}
+
+static const char *intern(struct cad_intern_impl *this, const char *string) {
+     const char *result = this->atoms->get(this->atoms, string);
+     if (result == NULL) {
+          result = pack_key(this->memory, &(this->chunks), string, strlen(string) + 1);
+          if (result != NULL) {
+               this->atoms->set(this->atoms, result, (void*)result);
+          }
+     }
+     return result;
+}
+
+static cad_intern_t fn = {
+     (cad_intern_free_fn  )free_ ,
+     (cad_intern_count_fn )count ,
+     (cad_intern_intern_fn)intern,
+     (cad_intern_lookup_fn)lookup,
+};
+
+__PUBLIC__ cad_intern_t *cad_new_intern(cad_memory_t memory) {
+     struct cad_intern_impl *result = (struct cad_intern_impl *)memory.malloc(sizeof(struct cad_intern_impl));
+     if (!result) return NULL;
+     result->fn     = fn;
+     result->memory = memory;
+     result->ex     = cad_memory_ex(memory);
+     result->chunks = NULL;
+     result->atoms  = cad_new_hash(memory, cad_hash_borrowed_keys(cad_hash_strings_fast));
+     if (result->atoms == NULL) {
+          memory.free(result);
+          return NULL;
+     }
+     return (cad_intern_t*)result;
+}
@@ -0,0 +1,245 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the implementation of LRU caches.
+ *
+ * Each key has an entry, linked in a circular recency list (most
+ * recently used first) and indexed by a hash table that borrows the
+ * entries' keys. A hit only relinks its entry; evicted entries are
+ * kept in a free list and reused by the next insertions, so that a
+ * full cache does not allocate entries any more.
+ */
+
+#include "cad_hash_internal.h"
+#include "cad_lru.h"
+#include "cad_memory.h"
+
+typedef struct entry {
+     struct entry *prev;
+     struct entry *next; /* also links the free list */
+     const void *key;
+     void *value;
+     size_t size;
+} entry_t;
+
+struct cad_lru_impl {
+     cad_lru_t fn;
+     cad_memory_t memory;
+     cad_hash_keys_t keys;
+     cad_hash_t *index;
+     entry_t list;         /* the sentinel: `list.next` is the most recently used */
+     entry_t *free_entries;
+     cad_lru_evict_fn evict;
+     void *data;
+
+     size_t capacity;
+     size_t size;
+     unsigned int count;
+     unsigned long long hits;
+     unsigned long long misses;
+     unsigned long long evictions;
+};
+
+static void unlink_entry(entry_t *entry) {
+     entry->prev->next = entry->next;
+     entry->next->prev = entry->prev;
+}
+
+static void link_first(struct cad_lru_impl *this, entry_t *entry) {
+     entry->prev = &(this->list);
+     entry->next = this->list.next;
+     this->list.next->prev = entry;
+     this->list.next = entry;
+}
+
+/* Removes the entry from the index and the list, and frees its key. */
+static void drop(struct cad_lru_impl *this, entry_t *entry, int evict) {
+     unlink_entry(entry);
+     this->index->del(this->index, entry->key);
+     if (evict && this->evict != NULL) {
+          this->evict(this, entry->key, entry->value, this->data);
+     }
+     free_hash_key(this->memory, &(this->keys), entry->key);
+     this->size -= entry->size;
+     this->count--;
+     entry->next = this->free_entries;
+     this->free_entries = entry;
+}
+
+static void make_room(struct cad_lru_impl *this, size_t size) {
+     while (this->size + size > this->capacity && this->list.prev != &(this->list)) {
+          drop(this, this->list.prev, 1);
+          this->evictions++;
+     }
+}
+
+static void free_(struct cad_lru_impl *this) {
+     entry_t *entry, *next;
+     for (entry = this->list.next; entry != &(this->list); entry = next) {
+          next = entry->next;
+          free_hash_key(this->memory, &(this->keys), entry->key);
+          this->memory.free(entry);
+     }
+     for (entry = this->free_entries; entry != NULL; entry = next) {
+          next = entry->next;
+          this->memory.free(entry);
+     }
+     this->index->free(this->index);
+     this->memory.free(this);
+}
+
+static unsigned int count(struct cad_lru_impl *this) {
+     return this->count;
+}
+
+static void *get(struct cad_lru_impl *this, const void *key) {
+     entry_t *entry = this->index->get(this->index, key);
+     if (entry == NULL) {
+          this->misses++;
+          return NULL;
+     }
+     this->hits++;
+     if (entry->prev != &(this->list)) {
+          unlink_entry(entry);
+          link_first(this, entry);
+     }
+     return entry->value;
+}
+
+static int put(struct cad_lru_impl *this, const void *key, void *value, size_t size) {
+     entry_t *entry;
+     void *old;
+
+     if (size > this->capacity) {
+          return -1;
+     }
+
+     entry = this->index->get(this->index, key);
+     if (entry != NULL) {
+          unlink_entry(entry);
+          link_first(this, entry);
+          old = entry->value;
+          this->size -= entry->size;
+          entry->value = value;
+          entry->size  = size;
+          if (this->evict != NULL && old != value) {
+               this->evict(this, entry->key, old, this->data);
+          }
+          /* the entry is not counted in the size any more: it is never
+           * evicted, since the size is 0 once it is alone */
+          make_room(this, size);
+          this->size += size;
+          return 0;
+     }
+
+     /* allocate first: a failed put must not evict anything */
+     entry = this->free_entries;
+     if (entry != NULL) {
+          this->free_entries = entry->next;
+     } else {
+          entry = this->memory.malloc(sizeof(entry_t));
+          if (entry == NULL) {
+               return -1;
+          }
+     }
+     entry->key = clone_hash_key(this->memory, &(this->keys), key);
+     if (entry->key == NULL && key != NULL) {
+          goto error;
+     }
+     this->index->set(this->index, entry->key, entry);
+     if (this->index->count(this->index) == this->count) {
+          /* the key was not added */
+          free_hash_key(this->memory, &(this->keys), entry->key);
+          goto error;
+     }
+     entry->value = value;
+     entry->size  = size;
+     make_room(this, size); /* the entry is not linked yet: never evicted */
+     link_first(this, entry);
+     this->size += size;
+     this->count++;
+     return 0;
+
+error:
+     entry->next = this->free_entries;
+     this->free_entries = entry;
+     return -1;
+}
+
+static void *del(struct cad_lru_impl *this, const void *key) {
+     entry_t *entry = this->index->get(this->index, key);
+     void *result;
+     if (entry == NULL) {
+          return NULL;
+     }
+     result = entry->value;
+     drop(this, entry, 0);
+     return result;
+}
+
+static void clean(struct cad_lru_impl *this) {
+     while (this->list.next != &(this->list)) {
+          drop(this, this->list.next, 1);
+     }
+}
+
+static void stats(struct cad_lru_impl *this, cad_lru_stats_t *stats) {
+     stats->capacity  = this->capacity;
+     stats->size      = this->size;
+     stats->count     = this->count;
+     stats->hits      = this->hits;
+     stats->misses    = this->misses;
+     stats->evictions = this->evictions;
+}
+
+static cad_lru_t fn = {
+     (cad_lru_free_fn )free_,
+     (cad_lru_count_fn)count,
+     (cad_lru_get_fn  )get  ,
+     (cad_lru_put_fn  )put  ,
+     (cad_lru_del_fn  )del  ,
+     (cad_lru_clean_fn)clean,
+     (cad_lru_stats_fn)stats,
+};
+
+__PUBLIC__ cad_lru_t *cad_new_lru(cad_memory_t memory, cad_hash_keys_t keys, size_t capacity, cad_lru_evict_fn evict, void *data) {
+     struct cad_lru_impl *result = memory.malloc(sizeof(struct cad_lru_impl));
+     if (!result) return NULL;
+     result->index = cad_new_hash(memory, cad_hash_borrowed_keys(keys));
+     if (result->index == NULL) {
+          memory.free(result);
+          return NULL;
+     }
+     result->fn           = fn;
+     result->memory       = memory;
+     result->keys         = keys;
+     result->list.prev    = &(result->list);
+     result->list.next    = &(result->list);
+     result->free_entries = NULL;
+     result->evict        = evict;
+     result->data         = data;
+     result->capacity     = capacity;
+     result->size         = 0;
+     result->count        = 0;
+     result->hits         = 0;
+     result->misses       = 0;
+     result->evictions    = 0;
+     return (cad_lru_t*)result;
+}
@@ -0,0 +1,181 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * This file contains the common plumbing of the memory managers.
+ *
+ * A `cad_memory_t` is only made of function pointers, without any
+ * user data. Stateful memory managers are therefore bound to a slot:
+ * each slot has its own set of functions that forward to the slot's
+ * operations and data.
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+
+#include "cad_memory_internal.h"
+
+typedef struct slot {
+     const memory_ops_t *ops;
+     void *data;
+     cad_memory_ex_t *ex;
+} slot_t;
+
+static slot_t slots[CAD_MEMORY_SLOTS];
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define SLOT(n)                                                         \
+     static void *malloc_##n(size_t size) {                             \
+          return slots[n].ops->malloc(slots[n].data, size);             \
+     }                                                                  \
+     static void *realloc_##n(void *ptr, size_t size) {                 \
+          return slots[n].ops->realloc(slots[n].data, ptr, size);       \
+     }                                                                  \
+     static void free_##n(void *ptr) {                                  \
+          slots[n].ops->free(slots[n].data, ptr);                       \
+     }
+
+#define SLOT_FN(n) { malloc_##n, realloc_##n, free_##n }
+
+SLOT(0)  SLOT(1)  SLOT(2)  SLOT(3)  SLOT(4)  SLOT(5)  SLOT(6)  SLOT(7)
+SLOT(8)  SLOT(9)  SLOT(10) SLOT(11) SLOT(12) SLOT(13) SLOT(14) SLOT(15)
+SLOT(16) SLOT(17) SLOT(18) SLOT(19) SLOT(20) SLOT(21) SLOT(22) SLOT(23)
+SLOT(24) SLOT(25) SLOT(26) SLOT(27) SLOT(28) SLOT(29) SLOT(30) SLOT(31)
+
+static const cad_memory_t slot_fn[CAD_MEMORY_SLOTS] = {
+     SLOT_FN(0),  SLOT_FN(1),  SLOT_FN(2),  SLOT_FN(3),  SLOT_FN(4),  SLOT_FN(5),  SLOT_FN(6),  SLOT_FN(7),
+     SLOT_FN(8),  SLOT_FN(9),  SLOT_FN(10), SLOT_FN(11), SLOT_FN(12), SLOT_FN(13), SLOT_FN(14), SLOT_FN(15),
+     SLOT_FN(16), SLOT_FN(17), SLOT_FN(18), SLOT_FN(19), SLOT_FN(20), SLOT_FN(21), SLOT_FN(22), SLOT_FN(23),
+     SLOT_FN(24), SLOT_FN(25), SLOT_FN(26), SLOT_FN(27), SLOT_FN(28), SLOT_FN(29), SLOT_FN(30), SLOT_FN(31),
+};
+
+static int slot_of(cad_memory_t memory) {
+     int i;
+     for (i = 0; i < CAD_MEMORY_SLOTS; i++) {
+          if (slot_fn[i].malloc == memory.malloc) {
+               return i;
+          }
+     }
+     return -1;
+}
+
+cad_memory_t bind_memory(const memory_ops_t *ops, void *data, cad_memory_ex_t *ex) {
+     cad_memory_t result = { NULL, NULL, NULL };
+     int i;
+     if (0 == pthread_mutex_lock(&slots_lock)) {
+          for (i = 0; i < CAD_MEMORY_SLOTS && slots[i].ops != NULL; i++) {
+               /* look for a free slot */
+          }
+          if (i < CAD_MEMORY_SLOTS) {
+               slots[i].ops  = ops;
+               slots[i].data = data;
+               slots[i].ex   = ex;
+               result = slot_fn[i];
+          }
+          pthread_mutex_unlock(&slots_lock);
+     }
+     return result;
+}
+
+void *memory_data(cad_memory_t memory, const memory_ops_t *ops) {
+     void *result = NULL;
+     int i = slot_of(memory);
+     if (i >= 0 && slots[i].ops == ops) {
+          result = slots[i].data;
+     }
+     return result;
+}
+
+void memory_free_sized(cad_memory_t memory, cad_memory_ex_t *ex, void *ptr, size_t size) {
+     if (ex != NULL) {
+          ex->free_sized(ex, ptr, size);
+     } else {
+          memory.free(ptr);
+     }
+}
+
+static void stdlib_free_sized(cad_memory_ex_t *this, void *ptr, size_t size) {
+     free(ptr);
+}
+
+static void *stdlib_realloc_sized(cad_memory_ex_t *this, void *ptr, size_t old_size, size_t size) {
+     return realloc(ptr, size);
+}
+
+static size_t stdlib_usable_size(cad_memory_ex_t *this, void *ptr) {
+     return malloc_usable_size(ptr);
+}
+
+static void *stdlib_aligned_malloc(cad_memory_ex_t *this, size_t alignment, size_t size) {
+     void *result = NULL;
+     if (alignment < sizeof(void*)) {
+          alignment = sizeof(void*);
+     }
+     if (posix_memalign(&result, alignment, size)) {
+          result = NULL;
+     }
+     return result;
+}
+
+static cad_memory_ex_t stdlib_ex = {
+     stdlib_free_sized    ,
+     stdlib_realloc_sized ,
+     stdlib_usable_size   ,
+     stdlib_aligned_malloc,
+};
+
+__PUBLIC__ cad_memory_ex_t *cad_memory_ex(cad_memory_t memory) {
+     cad_memory_ex_t *result = NULL;
+     int i;
+     if (memory.malloc == malloc && memory.realloc == realloc && memory.free == free) {
+          result = &stdlib_ex;
+     } else {
+          i = slot_of(memory);
+          if (i >= 0) {
+               result = slots[i].ex;
+          }
+     }
+     return result;
+}
+
+__PUBLIC__ int cad_reset_memory(cad_memory_t memory) {
+     int result = -1;
+     int i = slot_of(memory);
+     if (i >= 0 && slots[i].ops != NULL && slots[i].ops->reset != NULL) {
+          result = slots[i].ops->reset(slots[i].data);
+     }
+     return result;
+}
+
+__PUBLIC__ void cad_free_memory(cad_memory_t memory) {
+     const memory_ops_t *ops = NULL;
+     void *data = NULL;
+     int i = slot_of(memory);
+     if (i >= 0 && 0 == pthread_mutex_lock(&slots_lock)) {
+          ops  = slots[i].ops;
+          data = slots[i].data;
+          slots[i].ops  = NULL;
+          slots[i].data = NULL;
+          slots[i].ex   = NULL;
+          pthread_mutex_unlock(&slots_lock);
+     }
+     if (ops != NULL && ops->destroy != NULL) {
+          ops->destroy(data);
+     }
+}
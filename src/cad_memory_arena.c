@@ -0,0 +1,204 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * This file contains the implementation of the arena memory manager.
+ *
+ * Blocks are bump-allocated from a list of chunks. Each block is
+ * preceded by a small header that keeps its size, needed by realloc.
+ * Chunks are never given back before the arena is freed; a reset
+ * only rewinds them.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cad_memory_internal.h"
+
+#define DEFAULT_CHUNK_SIZE 8192
+
+typedef struct chunk {
+     struct chunk *next;
+     size_t capacity;
+     size_t used;
+} chunk_t;
+
+#define CHUNK_HEADER MEMORY_ALIGNED(sizeof(chunk_t))
+#define BLOCK_HEADER MEMORY_ALIGNED(sizeof(size_t))
+
+#define chunk_data(chunk) ((char*)(chunk) + CHUNK_HEADER)
+#define block_size(ptr) (*(size_t*)((char*)(ptr) - BLOCK_HEADER))
+
+struct arena {
+     cad_memory_ex_t ex;
+     size_t chunk_size;
+     chunk_t *first;
+     chunk_t *current;
+     char *last;
+};
+
+static chunk_t *new_chunk(size_t capacity) {
+     chunk_t *result = malloc(CHUNK_HEADER + capacity);
+     if (result) {
+          result->next     = NULL;
+          result->capacity = capacity;
+          result->used     = 0;
+     }
+     return result;
+}
+
+static void *arena_malloc(struct arena *this, size_t size) {
+     size_t need = BLOCK_HEADER + MEMORY_ALIGNED(size);
+     chunk_t *chunk = this->current;
+     char *result;
+
+     while (chunk != NULL && chunk->used + need > chunk->capacity) {
+          chunk = chunk->next;
+     }
+     if (chunk == NULL) {
+          chunk = new_chunk(need > this->chunk_size ? need : this->chunk_size);
+          if (chunk == NULL) {
+               return NULL;
+          }
+          if (this->current == NULL) {
+               this->first = chunk;
+          } else {
+               chunk->next = this->current->next;
+               this->current->next = chunk;
+          }
+     }
+     this->current = chunk;
+
+     result = chunk_data(chunk) + chunk->used + BLOCK_HEADER;
+     chunk->used += need;
+     block_size(result) = size;
+     this->last = result;
+     return result;
+}
+
+static void *arena_realloc(struct arena *this, void *ptr, size_t size) {
+     void *result;
+     size_t old_size;
+     chunk_t *chunk;
+
+     if (ptr == NULL) {
+          return arena_malloc(this, size);
+     }
+
+     old_size = block_size(ptr);
+     if (ptr == this->last) {
+          chunk = this->current;
+          if (chunk->used - MEMORY_ALIGNED(old_size) + MEMORY_ALIGNED(size) <= chunk->capacity) {
+               chunk->used = chunk->used - MEMORY_ALIGNED(old_size) + MEMORY_ALIGNED(size);
+               block_size(ptr) = size;
+               return ptr;
+          }
+     } else if (size <= old_size) {
+          block_size(ptr) = size;
+          return ptr;
+     }
+
+     result = arena_malloc(this, size);
+     if (result != NULL) {
+          memcpy(result, ptr, old_size < size ? old_size : size);
+     }
+     return result;
+}
+
+static void arena_free(struct arena *this, void *ptr) {
+     /* do nothing: the memory is given back at reset */
+}
+
+static void arena_free_sized(struct arena *this, void *ptr, size_t size) {
+     /* do nothing: the memory is given back at reset */
+}
+
+static void *arena_realloc_sized(struct arena *this, void *ptr, size_t old_size, size_t size) {
+     return arena_realloc(this, ptr, size);
+}
+
+static size_t arena_usable_size(struct arena *this, void *ptr) {
+     return block_size(ptr);
+}
+
+static void *arena_aligned_malloc(struct arena *this, size_t alignment, size_t size) {
+     char *result;
+     if (alignment <= MEMORY_ALIGN) {
+          return arena_malloc(this, size);
+     }
+     result = arena_malloc(this, size + alignment);
+     if (result != NULL) {
+          result = (char*)(((uintptr_t)result + alignment - 1) & ~(uintptr_t)(alignment - 1));
+          block_size(result) = size;
+          this->last = NULL; /* the padding forbids growing in place */
+     }
+     return result;
+}
+
+static int arena_reset(struct arena *this) {
+     chunk_t *chunk;
+     for (chunk = this->first; chunk != NULL; chunk = chunk->next) {
+          chunk->used = 0;
+     }
+     this->current = this->first;
+     this->last = NULL;
+     return 0;
+}
+
+static void arena_destroy(struct arena *this) {
+     chunk_t *chunk = this->first, *next;
+     while (chunk != NULL) {
+          next = chunk->next;
+          free(chunk);
+          chunk = next;
+     }
+     free(this);
+}
+
+static cad_memory_ex_t arena_ex = {
+     (cad_memory_free_sized_fn    )arena_free_sized    ,
+     (cad_memory_realloc_sized_fn )arena_realloc_sized ,
+     (cad_memory_usable_size_fn   )arena_usable_size   ,
+     (cad_memory_aligned_malloc_fn)arena_aligned_malloc,
+};
+
+static memory_ops_t arena_ops = {
+     (void *(*)(void*, size_t)       )arena_malloc ,
+     (void *(*)(void*, void*, size_t))arena_realloc,
+     (void  (*)(void*, void*)        )arena_free   ,
+     (int   (*)(void*)               )arena_reset  ,
+     (void  (*)(void*)               )arena_destroy,
+};
+
+__PUBLIC__ cad_memory_t cad_new_arena_memory(size_t chunk_size) {
+     cad_memory_t result = { NULL, NULL, NULL };
+     struct arena *arena = malloc(sizeof(struct arena));
+     if (arena != NULL) {
+          arena->ex         = arena_ex;
+          arena->chunk_size = chunk_size == 0 ? DEFAULT_CHUNK_SIZE : MEMORY_ALIGNED(chunk_size);
+          arena->first      = NULL;
+          arena->current    = NULL;
+          arena->last       = NULL;
+          result = bind_memory(&arena_ops, arena, &(arena->ex));
+          if (result.malloc == NULL) {
+               free(arena);
+          }
+     }
+     return result;
+}
@@ -0,0 +1,309 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * This file contains the implementation of the thread cache memory
+ * manager.
+ *
+ * Each thread gets its own heap, with one free list (magazine) per
+ * size class. A block always belongs to the heap that carved it: when
+ * a block is freed by another thread, it is pushed on the owner's
+ * lock-free "remote" list, which the owner takes back in one atomic
+ * exchange when its magazine is empty. Blocks are never given back to
+ * libc before the memory manager is freed.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "cad_memory_internal.h"
+
+#define CLASSES    7 /* 16, 32, ..., 1024 */
+#define MAX_SMALL  1024
+#define RUN_BYTES  16384
+
+typedef struct heap heap_t;
+
+typedef struct header {
+     heap_t *owner; /* NULL for big blocks */
+     size_t size;   /* the class size, or the requested size of big blocks */
+} header_t;
+
+#define BLOCK_HEADER MEMORY_ALIGNED(sizeof(header_t))
+
+#define header_of(ptr) ((header_t*)((char*)(ptr) - BLOCK_HEADER))
+
+typedef struct block {
+     struct block *next;
+} block_t;
+
+typedef struct run {
+     struct run *next;
+} run_t;
+
+#define RUN_HEADER MEMORY_ALIGNED(sizeof(run_t))
+
+struct heap {
+     heap_t *next;
+     int orphan;
+     block_t *magazines[CLASSES];
+     block_t *remote;
+     run_t *runs;
+};
+
+struct cache {
+     cad_memory_ex_t ex;
+     pthread_key_t key;
+     pthread_mutex_t lock;
+     heap_t *heaps;
+};
+
+static int class_of(size_t size) {
+     int result = 0;
+     size_t limit = 16;
+     while (size > limit) {
+          limit <<= 1;
+          result++;
+     }
+     return result;
+}
+
+static void orphan_heap(heap_t *heap) {
+     ACCESS_ONCE(heap->orphan) = 1;
+}
+
+static heap_t *thread_heap(struct cache *this) {
+     heap_t *result = pthread_getspecific(this->key);
+     if (result == NULL) {
+          if (0 == pthread_mutex_lock(&(this->lock))) {
+               for (result = this->heaps; result != NULL && !result->orphan; result = result->next) {
+                    /* look for a heap left behind by a dead thread */
+               }
+               if (result != NULL) {
+                    result->orphan = 0;
+               } else {
+                    result = malloc(sizeof(heap_t));
+                    if (result != NULL) {
+                         memset(result, 0, sizeof(heap_t));
+                         result->next = this->heaps;
+                         this->heaps = result;
+                    }
+               }
+               pthread_mutex_unlock(&(this->lock));
+          }
+          if (result != NULL) {
+               pthread_setspecific(this->key, result);
+          }
+     }
+     return result;
+}
+
+static void take_back_remote(heap_t *heap) {
+     block_t *block = __sync_lock_test_and_set(&(heap->remote), NULL);
+     block_t *next;
+     int klass;
+     while (block != NULL) {
+          next = block->next;
+          klass = class_of(header_of(block)->size);
+          block->next = heap->magazines[klass];
+          heap->magazines[klass] = block;
+          block = next;
+     }
+}
+
+static int fill_magazine(heap_t *heap, int klass) {
+     size_t size = (size_t)16 << klass;
+     size_t step = BLOCK_HEADER + size;
+     int i, n = (RUN_BYTES - RUN_HEADER) / step;
+     run_t *run = malloc(RUN_BYTES);
+     char *ptr;
+     block_t *block;
+     if (run == NULL) {
+          return 0;
+     }
+     run->next = heap->runs;
+     heap->runs = run;
+     ptr = (char*)run + RUN_HEADER + BLOCK_HEADER;
+     for (i = 0; i < n; i++) {
+          header_of(ptr)->owner = heap;
+          header_of(ptr)->size  = size;
+          block = (block_t*)ptr;
+          block->next = heap->magazines[klass];
+          heap->magazines[klass] = block;
+          ptr += step;
+     }
+     return 1;
+}
+
+static void *cache_malloc(struct cache *this, size_t size) {
+     heap_t *heap;
+     header_t *header;
+     block_t *result;
+     int klass;
+
+     if (size > MAX_SMALL) {
+          header = malloc(BLOCK_HEADER + size);
+          if (header == NULL) {
+               return NULL;
+          }
+          header->owner = NULL;
+          header->size  = size;
+          return (char*)header + BLOCK_HEADER;
+     }
+
+     heap = thread_heap(this);
+     if (heap == NULL) {
+          return NULL;
+     }
+     klass = class_of(size);
+     if (heap->magazines[klass] == NULL) {
+          take_back_remote(heap);
+          if (heap->magazines[klass] == NULL && !fill_magazine(heap, klass)) {
+               return NULL;
+          }
+     }
+     result = heap->magazines[klass];
+     heap->magazines[klass] = result->next;
+     return result;
+}
+
+static void cache_free(struct cache *this, void *ptr) {
+     block_t *block = ptr;
+     heap_t *owner;
+     block_t *head;
+     int klass;
+
+     if (ptr == NULL) {
+          return;
+     }
+
+     owner = header_of(ptr)->owner;
+     if (owner == NULL) {
+          free(header_of(ptr));
+     } else if (owner == pthread_getspecific(this->key)) {
+          klass = class_of(header_of(ptr)->size);
+          block->next = owner->magazines[klass];
+          owner->magazines[klass] = block;
+     } else {
+          do {
+               head = ACCESS_ONCE(owner->remote);
+               block->next = head;
+          } while (!__sync_bool_compare_and_swap(&(owner->remote), head, block));
+     }
+}
+
+static void *cache_realloc(struct cache *this, void *ptr, size_t size) {
+     void *result;
+     header_t *header;
+     size_t old_size;
+
+     if (ptr == NULL) {
+          return cache_malloc(this, size);
+     }
+
+     old_size = header_of(ptr)->size;
+     if (header_of(ptr)->owner == NULL) {
+          if (size > MAX_SMALL) {
+               header = realloc(header_of(ptr), BLOCK_HEADER + size);
+               if (header == NULL) {
+                    return NULL;
+               }
+               header->size = size;
+               return (char*)header + BLOCK_HEADER;
+          }
+     } else if (size <= old_size) {
+          return ptr;
+     }
+
+     result = cache_malloc(this, size);
+     if (result != NULL) {
+          memcpy(result, ptr, old_size < size ? old_size : size);
+          cache_free(this, ptr);
+     }
+     return result;
+}
+
+static void cache_free_sized(struct cache *this, void *ptr, size_t size) {
+     cache_free(this, ptr);
+}
+
+static void *cache_realloc_sized(struct cache *this, void *ptr, size_t old_size, size_t size) {
+     return cache_realloc(this, ptr, size);
+}
+
+static size_t cache_usable_size(struct cache *this, void *ptr) {
+     return header_of(ptr)->size;
+}
+
+static void *cache_aligned_malloc(struct cache *this, size_t alignment, size_t size) {
+     return alignment <= MEMORY_ALIGN ? cache_malloc(this, size) : NULL;
+}
+
+static void cache_destroy(struct cache *this) {
+     heap_t *heap = this->heaps, *next_heap;
+     run_t *run, *next_run;
+     pthread_key_delete(this->key);
+     while (heap != NULL) {
+          next_heap = heap->next;
+          for (run = heap->runs; run != NULL; run = next_run) {
+               next_run = run->next;
+               free(run);
+          }
+          free(heap);
+          heap = next_heap;
+     }
+     pthread_mutex_destroy(&(this->lock));
+     free(this);
+}
+
+static cad_memory_ex_t cache_ex = {
+     (cad_memory_free_sized_fn    )cache_free_sized    ,
+     (cad_memory_realloc_sized_fn )cache_realloc_sized ,
+     (cad_memory_usable_size_fn   )cache_usable_size   ,
+     (cad_memory_aligned_malloc_fn)cache_aligned_malloc,
+};
+
+static memory_ops_t cache_ops = {
+     (void *(*)(void*, size_t)       )cache_malloc ,
+     (void *(*)(void*, void*, size_t))cache_realloc,
+     (void  (*)(void*, void*)        )cache_free   ,
+     NULL,
+     (void  (*)(void*)               )cache_destroy,
+};
+
+__PUBLIC__ cad_memory_t cad_new_thread_cache_memory(void) {
+     cad_memory_t result = { NULL, NULL, NULL };
+     struct cache *cache = malloc(sizeof(struct cache));
+     if (cache != NULL) {
+          if (pthread_key_create(&(cache->key), (void (*)(void*))orphan_heap)) {
+               free(cache);
+               return result;
+          }
+          cache->ex    = cache_ex;
+          cache->heaps = NULL;
+          pthread_mutex_init(&(cache->lock), NULL);
+          result = bind_memory(&cache_ops, cache, &(cache->ex));
+          if (result.malloc == NULL) {
+               pthread_key_delete(cache->key);
+               pthread_mutex_destroy(&(cache->lock));
+               free(cache);
+          }
+     }
+     return result;
+}
@@ -0,0 +1,223 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * This file contains the implementation of the counting memory
+ * manager, a decorator that keeps allocation statistics.
+ *
+ * Each block is preceded by a small header that keeps its size, so
+ * that free and realloc can update the live bytes counter, its
+ * offset in the inner block (non-trivial for aligned blocks) and its
+ * alignment: aligned blocks are moved by hand on realloc, as the inner
+ * manager would not keep their alignment.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cad_memory_internal.h"
+
+typedef struct header {
+     size_t size;
+     size_t offset; /* from the inner block to the user block */
+     size_t alignment;
+} header_t;
+
+#define BLOCK_HEADER MEMORY_ALIGNED(sizeof(header_t))
+
+#define header_of(ptr) ((header_t*)((char*)(ptr) - BLOCK_HEADER))
+#define base_of(ptr) ((char*)(ptr) - header_of(ptr)->offset)
+
+struct counting {
+     cad_memory_ex_t ex;
+     cad_memory_t inner;
+     cad_memory_stats_t stats;
+};
+
+static int bucket_of(size_t size) {
+     int result = 0;
+     size_t limit = 16;
+     while (size > limit && result < CAD_MEMORY_HISTOGRAM - 1) {
+          limit <<= 1;
+          result++;
+     }
+     return result;
+}
+
+static void count_in(struct counting *this, size_t size) {
+     size_t live = __sync_add_and_fetch(&(this->stats.live_bytes), size);
+     size_t peak = this->stats.peak_bytes;
+     while (live > peak && !__sync_bool_compare_and_swap(&(this->stats.peak_bytes), peak, live)) {
+          peak = this->stats.peak_bytes;
+     }
+     __sync_fetch_and_add(&(this->stats.histogram[bucket_of(size)]), 1);
+}
+
+static void count_out(struct counting *this, size_t size) {
+     __sync_fetch_and_sub(&(this->stats.live_bytes), size);
+}
+
+static void *place_block(struct counting *this, size_t alignment, size_t size) {
+     char *base, *result;
+     base = this->inner.malloc(alignment - MEMORY_ALIGN + BLOCK_HEADER + size);
+     if (base == NULL) {
+          return NULL;
+     }
+     result = (char*)(((uintptr_t)base + BLOCK_HEADER + alignment - 1) & ~(uintptr_t)(alignment - 1));
+     header_of(result)->size      = size;
+     header_of(result)->offset    = result - base;
+     header_of(result)->alignment = alignment;
+     return result;
+}
+
+static void *new_block(struct counting *this, size_t alignment, size_t size) {
+     char *result = place_block(this, alignment, size);
+     if (result == NULL) {
+          return NULL;
+     }
+     __sync_fetch_and_add(&(this->stats.allocations), 1);
+     count_in(this, size);
+     return result;
+}
+
+static void *counting_malloc(struct counting *this, size_t size) {
+     return new_block(this, MEMORY_ALIGN, size);
+}
+
+static void *counting_realloc(struct counting *this, void *ptr, size_t size) {
+     size_t old_size, offset;
+     char *base, *result;
+     if (ptr == NULL) {
+          return counting_malloc(this, size);
+     }
+     old_size = header_of(ptr)->size;
+     offset = header_of(ptr)->offset;
+     if (header_of(ptr)->alignment > MEMORY_ALIGN) {
+          result = place_block(this, header_of(ptr)->alignment, size);
+          if (result == NULL) {
+               return NULL;
+          }
+          memcpy(result, ptr, old_size < size ? old_size : size);
+          this->inner.free(base_of(ptr));
+     } else {
+          base = this->inner.realloc(base_of(ptr), offset + size);
+          if (base == NULL) {
+               return NULL;
+          }
+          result = base + offset;
+          header_of(result)->size = size;
+     }
+     __sync_fetch_and_add(&(this->stats.reallocations), 1);
+     count_out(this, old_size);
+     count_in(this, size);
+     return result;
+}
+
+static void counting_free(struct counting *this, void *ptr) {
+     if (ptr != NULL) {
+          __sync_fetch_and_add(&(this->stats.frees), 1);
+          count_out(this, header_of(ptr)->size);
+          this->inner.free(base_of(ptr));
+     }
+}
+
+static void counting_free_sized(struct counting *this, void *ptr, size_t size) {
+     counting_free(this, ptr);
+}
+
+static void *counting_realloc_sized(struct counting *this, void *ptr, size_t old_size, size_t size) {
+     return counting_realloc(this, ptr, size);
+}
+
+static size_t counting_usable_size(struct counting *this, void *ptr) {
+     return header_of(ptr)->size;
+}
+
+static void *counting_aligned_malloc(struct counting *this, size_t alignment, size_t size) {
+     return new_block(this, alignment < MEMORY_ALIGN ? MEMORY_ALIGN : alignment, size);
+}
+
+static void counting_destroy(struct counting *this) {
+     free(this);
+}
+
+static cad_memory_ex_t counting_ex = {
+     (cad_memory_free_sized_fn    )counting_free_sized    ,
+     (cad_memory_realloc_sized_fn )counting_realloc_sized ,
+     (cad_memory_usable_size_fn   )counting_usable_size   ,
+     (cad_memory_aligned_malloc_fn)counting_aligned_malloc,
+};
+
+static memory_ops_t counting_ops = {
+     (void *(*)(void*, size_t)       )counting_malloc ,
+     (void *(*)(void*, void*, size_t))counting_realloc,
+     (void  (*)(void*, void*)        )counting_free   ,
+     NULL,
+     (void  (*)(void*)               )counting_destroy,
+};
+
+__PUBLIC__ cad_memory_t cad_new_counting_memory(cad_memory_t inner) {
+     cad_memory_t result = { NULL, NULL, NULL };
+     struct counting *counting = malloc(sizeof(struct counting));
+     if (counting != NULL) {
+          memset(counting, 0, sizeof(struct counting));
+          counting->ex    = counting_ex;
+          counting->inner = inner;
+          result = bind_memory(&counting_ops, counting, &(counting->ex));
+          if (result.malloc == NULL) {
+               free(counting);
+          }
+     }
+     return result;
+}
+
+__PUBLIC__ int cad_counting_memory_stats(cad_memory_t memory, cad_memory_stats_t *stats) {
+     struct counting *counting = memory_data(memory, &counting_ops);
+     if (counting == NULL) {
+          return -1;
+     }
+     *stats = counting->stats;
+     return 0;
+}
+
+__PUBLIC__ int cad_counting_memory_report(cad_memory_t memory, cad_output_stream_t *out) {
+     cad_memory_stats_t stats;
+     size_t limit = 16;
+     int i;
+     if (cad_counting_memory_stats(memory, &stats)) {
+          return -1;
+     }
+     out->put(out, "live bytes:    %zu\n", stats.live_bytes);
+     out->put(out, "peak bytes:    %zu\n", stats.peak_bytes);
+     out->put(out, "allocations:   %zu\n", stats.allocations);
+     out->put(out, "reallocations: %zu\n", stats.reallocations);
+     out->put(out, "frees:         %zu\n", stats.frees);
+     out->put(out, "sizes:\n");
+     for (i = 0; i < CAD_MEMORY_HISTOGRAM - 1; i++) {
+          if (stats.histogram[i] != 0) {
+               out->put(out, "  <= %8zu: %zu\n", limit, stats.histogram[i]);
+          }
+          limit <<= 1;
+     }
+     if (stats.histogram[i] != 0) {
+          out->put(out, "   > %8zu: %zu\n", limit >> 1, stats.histogram[i]);
+     }
+     out->flush(out);
+     return 0;
+}
@@ -0,0 +1,62 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * This file contains the internal header for the memory managers.
+ */
+
+#include "cad_memory.h"
+
+/**
+ * Alignment of all the blocks returned by the memory managers.
+ */
+#define MEMORY_ALIGN 16
+#define MEMORY_ALIGNED(size) (((size) + MEMORY_ALIGN - 1) & ~(size_t)(MEMORY_ALIGN - 1))
+
+/**
+ * The operations of a stateful memory manager. Each function receives
+ * the `data` given to bind_memory().
+ */
+typedef struct memory_ops {
+     void *(*malloc)(void *data, size_t size);
+     void *(*realloc)(void *data, void *ptr, size_t size);
+     void  (*free)(void *data, void *ptr);
+     int   (*reset)(void *data);   /* may be NULL */
+     void  (*destroy)(void *data); /* may be NULL */
+} memory_ops_t;
+
+/**
+ * Binds `ops` and `data` to a free slot and returns the matching
+ * memory manager (with `NULL` functions if no slot is available).
+ * The optional `ex` is returned by cad_memory_ex().
+ */
+cad_memory_t bind_memory(const memory_ops_t *ops, void *data, cad_memory_ex_t *ex);
+
+/**
+ * Returns the data bound to `memory` if it was bound with `ops`,
+ * `NULL` otherwise.
+ */
+void *memory_data(cad_memory_t memory, const memory_ops_t *ops);
+
+/**
+ * Frees a block of the given `size` with the sized free of `ex` (as
+ * returned by cad_memory_ex() for `memory`), or with the plain free of
+ * `memory` if `ex` is `NULL`.
+ */
+void memory_free_sized(cad_memory_t memory, cad_memory_ex_t *ex, void *ptr, size_t size);
@@ -0,0 +1,318 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_utils
+ * @file
+ *
+ * This file contains the implementation of the pool memory manager.
+ *
+ * Small blocks are rounded up to a size class and carved out of
+ * page-sized, page-aligned slabs. Blocks have no header: the slab
+ * header is found by masking the block address. Big blocks get their
+ * own aligned "slab" so that they can be found the same way.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cad_memory_internal.h"
+
+#define SLAB_SIZE   4096
+#define SLAB_HEADER MEMORY_ALIGNED(sizeof(slab_t))
+#define MAX_SMALL   1024
+
+#define slab_of(ptr) ((slab_t*)((uintptr_t)(ptr) & ~(uintptr_t)(SLAB_SIZE - 1)))
+
+typedef struct block {
+     struct block *next;
+} block_t;
+
+typedef struct slab {
+     struct slab *prev;
+     struct slab *next;
+     int klass; /* -1 for big blocks */
+     size_t size;
+     unsigned int count;
+     unsigned int used;
+     unsigned int bump;
+     block_t *free;
+} slab_t;
+
+typedef struct slab_list {
+     slab_t *first;
+} slab_list_t;
+
+struct pool_class {
+     slab_list_t partial; /* slabs with free blocks */
+     slab_list_t full;
+     cad_pool_memory_class_stats_t stats;
+};
+
+struct pool {
+     cad_memory_ex_t ex;
+     struct pool_class classes[CAD_POOL_MEMORY_CLASSES];
+     slab_list_t big;
+     size_t big_count;
+     size_t big_bytes;
+};
+
+static int class_of(size_t size) {
+     if (size <= 128) {
+          return size == 0 ? 0 : (size - 1) / 16;
+     }
+     return 8 + (size - 129) / 64;
+}
+
+static size_t class_size(int klass) {
+     return klass < 8 ? (klass + 1) * 16 : 128 + (klass - 7) * 64;
+}
+
+static void link_slab(slab_list_t *list, slab_t *slab) {
+     slab->prev = NULL;
+     slab->next = list->first;
+     if (list->first != NULL) {
+          list->first->prev = slab;
+     }
+     list->first = slab;
+}
+
+static void unlink_slab(slab_list_t *list, slab_t *slab) {
+     if (slab->prev == NULL) {
+          list->first = slab->next;
+     } else {
+          slab->prev->next = slab->next;
+     }
+     if (slab->next != NULL) {
+          slab->next->prev = slab->prev;
+     }
+}
+
+static void free_slabs(slab_list_t *list) {
+     slab_t *slab = list->first, *next;
+     while (slab != NULL) {
+          next = slab->next;
+          free(slab);
+          slab = next;
+     }
+     list->first = NULL;
+}
+
+static slab_t *new_slab(size_t total) {
+     void *result = NULL;
+     if (posix_memalign(&result, SLAB_SIZE, total)) {
+          return NULL;
+     }
+     return result;
+}
+
+static void *big_malloc(struct pool *this, size_t offset, size_t size) {
+     slab_t *slab = new_slab(offset + size);
+     if (slab == NULL) {
+          return NULL;
+     }
+     slab->klass = -1;
+     slab->size  = size;
+     link_slab(&(this->big), slab);
+     this->big_count++;
+     this->big_bytes += size;
+     return (char*)slab + offset;
+}
+
+static void *pool_malloc(struct pool *this, size_t size) {
+     struct pool_class *c;
+     slab_t *slab;
+     block_t *result;
+     int klass;
+
+     if (size > MAX_SMALL) {
+          return big_malloc(this, SLAB_HEADER, size);
+     }
+
+     klass = class_of(size);
+     c = this->classes + klass;
+     slab = c->partial.first;
+     if (slab == NULL) {
+          slab = new_slab(SLAB_SIZE);
+          if (slab == NULL) {
+               return NULL;
+          }
+          slab->klass = klass;
+          slab->size  = class_size(klass);
+          slab->count = (SLAB_SIZE - SLAB_HEADER) / slab->size;
+          slab->used  = 0;
+          slab->bump  = 0;
+          slab->free  = NULL;
+          link_slab(&(c->partial), slab);
+          c->stats.slabs++;
+          c->stats.blocks += slab->count;
+     }
+
+     if (slab->free != NULL) {
+          result = slab->free;
+          slab->free = result->next;
+     } else {
+          result = (block_t*)((char*)slab + SLAB_HEADER + slab->bump * slab->size);
+          slab->bump++;
+     }
+     if (++slab->used == slab->count) {
+          unlink_slab(&(c->partial), slab);
+          link_slab(&(c->full), slab);
+     }
+
+     c->stats.allocations++;
+     if (++c->stats.used > c->stats.peak) {
+          c->stats.peak = c->stats.used;
+     }
+     return result;
+}
+
+static void pool_free(struct pool *this, void *ptr) {
+     struct pool_class *c;
+     slab_t *slab;
+     block_t *block = ptr;
+
+     if (ptr == NULL) {
+          return;
+     }
+
+     slab = slab_of(ptr);
+     if (slab->klass < 0) {
+          unlink_slab(&(this->big), slab);
+          this->big_count--;
+          this->big_bytes -= slab->size;
+          free(slab);
+          return;
+     }
+
+     c = this->classes + slab->klass;
+     c->stats.used--;
+     if (slab->used-- == slab->count) {
+          unlink_slab(&(c->full), slab);
+          link_slab(&(c->partial), slab);
+     }
+     if (slab->used == 0 && (slab->prev != NULL || slab->next != NULL)) {
+          /* empty, and not the last slab of its class: give it back */
+          unlink_slab(&(c->partial), slab);
+          c->stats.slabs--;
+          c->stats.blocks -= slab->count;
+          free(slab);
+     } else {
+          block->next = slab->free;
+          slab->free = block;
+     }
+}
+
+static void *pool_realloc(struct pool *this, void *ptr, size_t size) {
+     void *result;
+     slab_t *slab;
+
+     if (ptr == NULL) {
+          return pool_malloc(this, size);
+     }
+
+     slab = slab_of(ptr);
+     if (slab->klass >= 0 && size <= MAX_SMALL && class_of(size) == slab->klass) {
+          return ptr;
+     }
+
+     result = pool_malloc(this, size);
+     if (result != NULL) {
+          memcpy(result, ptr, slab->size < size ? slab->size : size);
+          pool_free(this, ptr);
+     }
+     return result;
+}
+
+static void pool_free_sized(struct pool *this, void *ptr, size_t size) {
+     pool_free(this, ptr);
+}
+
+static void *pool_realloc_sized(struct pool *this, void *ptr, size_t old_size, size_t size) {
+     return pool_realloc(this, ptr, size);
+}
+
+static size_t pool_usable_size(struct pool *this, void *ptr) {
+     return slab_of(ptr)->size;
+}
+
+static void *pool_aligned_malloc(struct pool *this, size_t alignment, size_t size) {
+     if (alignment <= MEMORY_ALIGN) {
+          return pool_malloc(this, size);
+     }
+     if (alignment >= SLAB_SIZE) {
+          return NULL;
+     }
+     /* class blocks are only 16-aligned: use a big block instead */
+     return big_malloc(this, (SLAB_HEADER + alignment - 1) & ~(alignment - 1), size);
+}
+
+static void pool_destroy(struct pool *this) {
+     int i;
+     for (i = 0; i < CAD_POOL_MEMORY_CLASSES; i++) {
+          free_slabs(&(this->classes[i].partial));
+          free_slabs(&(this->classes[i].full));
+     }
+     free_slabs(&(this->big));
+     free(this);
+}
+
+static cad_memory_ex_t pool_ex = {
+     (cad_memory_free_sized_fn    )pool_free_sized    ,
+     (cad_memory_realloc_sized_fn )pool_realloc_sized ,
+     (cad_memory_usable_size_fn   )pool_usable_size   ,
+     (cad_memory_aligned_malloc_fn)pool_aligned_malloc,
+};
+
+static memory_ops_t pool_ops = {
+     (void *(*)(void*, size_t)       )pool_malloc ,
+     (void *(*)(void*, void*, size_t))pool_realloc,
+     (void  (*)(void*, void*)        )pool_free   ,
+     NULL,
+     (void  (*)(void*)               )pool_destroy,
+};
+
+__PUBLIC__ cad_memory_t cad_new_pool_memory(void) {
+     cad_memory_t result = { NULL, NULL, NULL };
+     struct pool *pool = malloc(sizeof(struct pool));
+     int i;
+     if (pool != NULL) {
+          memset(pool, 0, sizeof(struct pool));
+          pool->ex = pool_ex;
+          for (i = 0; i < CAD_POOL_MEMORY_CLASSES; i++) {
+               pool->classes[i].stats.block_size = class_size(i);
+          }
+          result = bind_memory(&pool_ops, pool, &(pool->ex));
+          if (result.malloc == NULL) {
+               free(pool);
+          }
+     }
+     return result;
+}
+
+__PUBLIC__ int cad_pool_memory_stats(cad_memory_t memory, cad_pool_memory_stats_t *stats) {
+     struct pool *pool = memory_data(memory, &pool_ops);
+     int i;
+     if (pool == NULL) {
+          return -1;
+     }
+     for (i = 0; i < CAD_POOL_MEMORY_CLASSES; i++) {
+          stats->classes[i] = pool->classes[i].stats;
+     }
+     stats->big_count = pool->big_count;
+     stats->big_bytes = pool->big_bytes;
+     return 0;
+}
@@ -0,0 +1,399 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @ingroup cad_hash
+ * @file
+ *
+ * This file contains the implementation of hash sets.
+ *
+ * The index is the same "Swiss table" as the hash tables' one (see
+ * cad_hash_internal.h), but the slots hold the keys themselves: there
+ * is no value, and no dense array of entries. The keys, their hashes
+ * and the control bytes are kept in three arrays of one block, so
+ * that a slot costs 13 bytes on 64-bit machines.
+ *
+ * The hash of each key is kept, so that growing never calls the hash
+ * function again; neither does the set algebra when both sets share
+ * the same salt.
+ */
+
+#include <string.h>
+
+#include "cad_hash_internal.h"
+#include "cad_set.h"
+#include "cad_memory_internal.h"
+
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+struct cad_set_impl {
+     cad_set_t fn;
+     cad_memory_t memory;
+     cad_memory_ex_t *ex;
+     cad_hash_keys_t keys;
+     hash_seed_t seed;
+
+     unsigned int count;
+     unsigned int capacity; /* 0, or a power of two not less than GROUP_SIZE */
+     unsigned int used;     /* full and deleted slots */
+     const void **slots;    /* the block: the keys, then the hashes, then the control bytes */
+     unsigned int *hashes;
+     unsigned char *ctrl;
+};
+
+#define BLOCK_SIZE(capacity) ((capacity) * (sizeof(void*) + sizeof(unsigned int) + 1))
+
+static void free_block(struct cad_set_impl *this) {
+     if (this->capacity == 0) {
+          return;
+     }
+     memory_free_sized(this->memory, this->ex, this->slots, BLOCK_SIZE(this->capacity));
+}
+
+static int new_block(struct cad_set_impl *this, unsigned int capacity) {
+     this->slots = this->memory.malloc(BLOCK_SIZE(capacity));
+     if (this->slots == NULL) {
+          return -1;
+     }
+     this->hashes   = (unsigned int *)(this->slots + capacity);
+     this->ctrl     = (unsigned char *)(this->hashes + capacity);
+     this->capacity = capacity;
+     this->used     = 0;
+     memset(this->ctrl, CTRL_EMPTY, capacity);
+     return 0;
+}
+
+static unsigned int capacity_for(unsigned int count) {
+     unsigned int result = GROUP_SIZE;
+     while (MAX_LOAD(result) < count) {
+          result <<= 1;
+          if (result == 0) {
+               break;
+          }
+     }
+     return result;
+}
+
+static int find(struct cad_set_impl *this, const void *key, unsigned int hash) {
+     cad_hash_keys_compare_fn cmp = this->keys.compare;
+     unsigned char tag = tag_of(hash);
+     const unsigned char *group;
+     unsigned int match;
+     int slot;
+     probe_t probe;
+
+     if (this->capacity == 0) {
+          return -1;
+     }
+     start_probe(&probe, this->capacity, hash);
+     for (;;) {
+          group = this->ctrl + probe.group * GROUP_SIZE;
+          for (match = match_tag(group, tag); match != 0; match &= match - 1) {
+               slot = probe.group * GROUP_SIZE + __builtin_ctz(match);
+               if (this->hashes[slot] == hash && (this->slots[slot] == key || cmp(this->slots[slot], key) == 0)) {
+                    return slot;
+               }
+          }
+          if (match_empty(group)) {
+               return -1;
+          }
+          next_probe(&probe);
+     }
+}
+
+/* The key must not be in the set, and there must be room for it. */
+static void insert(struct cad_set_impl *this, const void *key, unsigned int hash) {
+     unsigned int match;
+     int slot;
+     probe_t probe;
+     start_probe(&probe, this->capacity, hash);
+     for (;;) {
+          match = match_free(this->ctrl + probe.group * GROUP_SIZE);
+          if (match != 0) {
+               break;
+          }
+          next_probe(&probe);
+     }
+     slot = probe.group * GROUP_SIZE + __builtin_ctz(match);
+     if (this->ctrl[slot] == CTRL_EMPTY) {
+          this->used++;
+     }
+     this->ctrl[slot]   = tag_of(hash);
+     this->slots[slot]  = key;
+     this->hashes[slot] = hash;
+     this->count++;
+}
+
+static int rehash(struct cad_set_impl *this, unsigned int capacity) {
+     struct cad_set_impl old = *this;
+     unsigned int i;
+     if (new_block(this, capacity)) {
+          *this = old;
+          return -1;
+     }
+     this->count = 0;
+     for (i = 0; i < old.capacity; i++) {
+          if (is_full(old.ctrl[i])) {
+               insert(this, old.slots[i], old.hashes[i]);
+          }
+     }
+     free_block(&old);
+     return 0;
+}
+
+static int make_room(struct cad_set_impl *this) {
+     if (this->used < MAX_LOAD(this->capacity)) {
+          return 0;
+     }
+     if (this->count < MAX_LOAD(this->capacity) / 2) {
+          /* mostly tombstones: squeeze them out */
+          return rehash(this, this->capacity);
+     }
+     return rehash(this, this->capacity == 0 ? GROUP_SIZE : this->capacity * 2);
+}
+
+static void free_keys(struct cad_set_impl *this) {
+     unsigned int i;
+     if (this->keys.clone == NULL && this->keys.size == NULL) {
+          return;
+     }
+     for (i = 0; i < this->capacity; i++) {
+          if (is_full(this->ctrl[i])) {
+               free_hash_key(this->memory, &(this->keys), this->slots[i]);
+          }
+     }
+}
+
+static void free_(struct cad_set_impl *this) {
+     free_keys(this);
+     free_block(this);
+     this->memory.free(this);
+}
+
+static unsigned int count(struct cad_set_impl *this) {
+     return this->count;
+}
+
+static void iterate(struct cad_set_impl *this, cad_set_iterator_fn iterator, void *data) {
+     unsigned int i;
+     int index = 0;
+     for (i = 0; i < this->capacity; i++) {
+          if (is_full(this->ctrl[i])) {
+               iterator(this, index++, this->slots[i], data);
+          }
+     }
+}
+
+static int add(struct cad_set_impl *this, const void *key) {
+     unsigned int hash = hash_key(&(this->keys), &(this->seed), key);
+     const void *clone;
+     if (find(this, key, hash) >= 0) {
+          return 0;
+     }
+     if (make_room(this)) {
+          return -1;
+     }
+     clone = clone_hash_key(this->memory, &(this->keys), key);
+     if (clone == NULL && key != NULL) {
+          return -1;
+     }
+     insert(this, clone, hash);
+     return 1;
+}
+
+static int contains(struct cad_set_impl *this, const void *key) {
+     if (this->count == 0) {
+          return 0;
+     }
+     return find(this, key, hash_key(&(this->keys), &(this->seed), key)) >= 0;
+}
+
+static int remove_(struct cad_set_impl *this, const void *key) {
+     int slot;
+     if (this->count == 0) {
+          return 0;
+     }
+     slot = find(this, key, hash_key(&(this->keys), &(this->seed), key));
+     if (slot < 0) {
+          return 0;
+     }
+     free_hash_key(this->memory, &(this->keys), this->slots[slot]);
+     if (match_empty(this->ctrl + (slot & ~(GROUP_SIZE - 1)))) {
+          /* see remove_slot() in cad_hash.c */
+          this->ctrl[slot] = CTRL_EMPTY;
+          this->used--;
+     } else {
+          this->ctrl[slot] = CTRL_DELETED;
+     }
+     this->count--;
+     return 1;
+}
+
+static void clean(struct cad_set_impl *this) {
+     free_keys(this);
+     if (this->capacity != 0) {
+          memset(this->ctrl, CTRL_EMPTY, this->capacity);
+     }
+     this->count = 0;
+     this->used  = 0;
+}
+
+static int reserve(struct cad_set_impl *this, unsigned int count) {
+     unsigned int capacity = capacity_for(count);
+     if (capacity <= this->capacity) {
+          return 0;
+     }
+     return rehash(this, capacity);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A result of the set algebra: like `this`, empty, with room for
+ * `count` keys. */
+static struct cad_set_impl *new_result(struct cad_set_impl *this, unsigned int count) {
+     struct cad_set_impl *result = this->memory.malloc(sizeof(struct cad_set_impl));
+     if (result == NULL) {
+          return NULL;
+     }
+     *result = *this;
+     result->count    = 0;
+     result->capacity = 0;
+     result->used     = 0;
+     result->slots    = NULL;
+     result->hashes   = NULL;
+     result->ctrl     = NULL;
+     if (count > 0 && new_block(result, capacity_for(count))) {
+          this->memory.free(result);
+          return NULL;
+     }
+     return result;
+}
+
+static int same_seed(struct cad_set_impl *this, struct cad_set_impl *other) {
+     return this->seed.salt == other->seed.salt
+          && this->seed.key[0] == other->seed.key[0]
+          && this->seed.key[1] == other->seed.key[1];
+}
+
+/* The hash of the key of the `other` set's slot, with the salt of `this` set. */
+static unsigned int hash_of(struct cad_set_impl *this, struct cad_set_impl *other, unsigned int slot) {
+     if (same_seed(this, other)) {
+          return other->hashes[slot];
+     }
+     return hash_key(&(this->keys), &(this->seed), other->slots[slot]);
+}
+
+static int insert_clone(struct cad_set_impl *this, const void *key, unsigned int hash) {
+     const void *clone = clone_hash_key(this->memory, &(this->keys), key);
+     if (clone == NULL && key != NULL) {
+          return -1;
+     }
+     insert(this, clone, hash);
+     return 0;
+}
+
+static cad_set_t *unite(struct cad_set_impl *this, struct cad_set_impl *other) {
+     struct cad_set_impl *result = new_result(this, this->count + other->count);
+     unsigned int i, hash;
+     if (result == NULL) {
+          return NULL;
+     }
+     for (i = 0; i < this->capacity; i++) {
+          if (is_full(this->ctrl[i]) && insert_clone(result, this->slots[i], this->hashes[i])) {
+               goto error;
+          }
+     }
+     for (i = 0; i < other->capacity; i++) {
+          if (is_full(other->ctrl[i])) {
+               hash = hash_of(result, other, i);
+               if (find(result, other->slots[i], hash) < 0 && insert_clone(result, other->slots[i], hash)) {
+                    goto error;
+               }
+          }
+     }
+     return (cad_set_t*)result;
+error:
+     free_(result);
+     return NULL;
+}
+
+static cad_set_t *intersect(struct cad_set_impl *this, struct cad_set_impl *other) {
+     /* look the keys of the smaller set up in the bigger one */
+     struct cad_set_impl *small = this->count <= other->count ? this : other;
+     struct cad_set_impl *big = small == this ? other : this;
+     struct cad_set_impl *result = new_result(this, small->count);
+     unsigned int i;
+     if (result == NULL) {
+          return NULL;
+     }
+     for (i = 0; i < small->capacity; i++) {
+          if (is_full(small->ctrl[i])
+              && find(big, small->slots[i], hash_of(big, small, i)) >= 0
+              && insert_clone(result, small->slots[i], hash_of(result, small, i))) {
+               free_(result);
+               return NULL;
+          }
+     }
+     return (cad_set_t*)result;
+}
+
+static cad_set_t *difference(struct cad_set_impl *this, struct cad_set_impl *other) {
+     struct cad_set_impl *result = new_result(this, this->count);
+     unsigned int i;
+     if (result == NULL) {
+          return NULL;
+     }
+     for (i = 0; i < this->capacity; i++) {
+          if (is_full(this->ctrl[i])
+              && (other->count == 0 || find(other, this->slots[i], hash_of(other, this, i)) < 0)
+              && insert_clone(result, this->slots[i], this->hashes[i])) {
+               free_(result);
+               return NULL;
+          }
+     }
+     return (cad_set_t*)result;
+}
+
+static cad_set_t fn = {
+     (cad_set_free_fn    )free_     ,
+     (cad_set_count_fn   )count     ,
+     (cad_set_iterate_fn )iterate   ,
+     (cad_set_add_fn     )add       ,
+     (cad_set_contains_fn)contains  ,
+     (cad_set_remove_fn  )remove_   ,
+     (cad_set_clean_fn   )clean     ,
+     (cad_set_reserve_fn )reserve   ,
+     (cad_set_algebra_fn )unite     ,
+     (cad_set_algebra_fn )intersect ,
+     (cad_set_algebra_fn )difference,
+};
+
+__PUBLIC__ cad_set_t *cad_new_set(cad_memory_t memory, cad_hash_keys_t keys) {
+     struct cad_set_impl *result = memory.malloc(sizeof(struct cad_set_impl));
+     if (!result) return NULL;
+     result->fn       = fn;
+     result->memory   = memory;
+     result->ex       = cad_memory_ex(memory);
+     result->keys     = keys;
+     result->count    = 0;
+     result->capacity = 0;
+     result->used     = 0;
+     result->slots    = NULL;
+     result->hashes   = NULL;
+     result->ctrl     = NULL;
+     init_hash_seed(&(result->seed));
+     return (cad_set_t*)result;
+}
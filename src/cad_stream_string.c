@@ -103,11 +103,8 @@ static int vput(struct cad_output_stream_string *this, const char *format, va_li
           new_capacity *= 2;
      }
      if (new_capacity > this->capacity) {
-          new_string = (char *)this->memory.malloc(new_capacity);
-          if (string) {
-               strcpy(new_string, string);
-               this->memory.free(string);
-          }
+          /* realloc lets arenas grow the string in place */
+          new_string = (char *)this->memory.realloc(string, new_capacity);
           *(this->string) = new_string;
           this->capacity = new_capacity;
      }
@@ -52,6 +52,35 @@ static int compare(const void *a, const void *b) {
      return strcmp(xa, xb);
 }
 
+static void test_cursor(void) {
+     cad_array_t *a = cad_new_array(stdlib_memory, sizeof(int));
+     cad_array_cursor_t cursor;
+     int i, more, sum = 0;
+
+     assert(!a->first(a, &cursor));
+     for (i = 0; i < 10; i++) {
+          a->insert(a, i, &i);
+     }
+     /* delete the even values while walking */
+     for (more = a->first(a, &cursor); more; more = cad_array_next(&cursor)) {
+          if (*(int*)cad_array_value(&cursor) % 2 == 0) {
+               cad_array_del_current(&cursor);
+          } else {
+               sum += *(int*)cad_array_value(&cursor);
+          }
+     }
+     assert(sum == 1 + 3 + 5 + 7 + 9);
+     assert(a->count(a) == 5);
+     for (more = a->first(a, &cursor); more; more = cad_array_next(&cursor)) {
+          assert(*(int*)cad_array_value(&cursor) == 2 * cad_array_index(&cursor) + 1);
+          if (cad_array_index(&cursor) == 2) {
+               break;
+          }
+     }
+     assert(cad_array_index(&cursor) == 2);
+     a->free(a);
+}
+
 int main() {
      cad_array_t *a = cad_new_array(stdlib_memory, sizeof(char*));
      char *foo = "foo";
@@ -85,5 +114,7 @@ int main() {
      a->sort(a, compare);
      check_array(a, 5, NULL, NULL, bar, foo, foo2);
 
+     test_cursor();
+
      return 0;
 }
@@ -0,0 +1,261 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "cad_btree.h"
+#include "cad_memory.h"
+
+#define KEYS 3000
+
+static int int_compare(const void *a, const void *b) {
+     intptr_t x = (intptr_t)a, y = (intptr_t)b;
+     return x < y ? -1 : x > y;
+}
+
+#define key(i) ((const void*)(intptr_t)(i))
+#define value(i) ((void*)(intptr_t)((i) + 1))
+
+/* the keys are checked against the model: in order, with their values */
+static void check(cad_btree_t *b, const char *present) {
+     cad_btree_cursor_t cursor;
+     int more, i = -1, n = 0, count = 0;
+     for (i = 0; i < KEYS; i++) {
+          count += present[i];
+     }
+     assert(b->count(b) == count);
+     i = -1;
+     for (more = b->first(b, &cursor); more; more = cad_btree_next(&cursor)) {
+          assert((intptr_t)cad_btree_key(&cursor) > i);
+          i = (intptr_t)cad_btree_key(&cursor);
+          assert(present[i]);
+          assert(cad_btree_value(&cursor) == value(i));
+          n++;
+     }
+     assert(n == count);
+}
+
+static void check_bounds(cad_btree_t *b, const char *present, int k) {
+     cad_btree_cursor_t cursor;
+     int i, more;
+     for (i = k; i < KEYS && !present[i]; i++) {
+     }
+     more = b->lower_bound(b, key(k), &cursor);
+     assert(more == (i < KEYS));
+     if (more) {
+          assert(cad_btree_key(&cursor) == key(i));
+     }
+     for (i = k + 1; i < KEYS && !present[i]; i++) {
+     }
+     more = b->upper_bound(b, key(k), &cursor);
+     assert(more == (i < KEYS));
+     if (more) {
+          assert(cad_btree_key(&cursor) == key(i));
+     }
+}
+
+static void range_iterator(void *btree, int index, const void *key, void *value, void *data) {
+     int *last = data;
+     assert((intptr_t)key > *last);
+     assert(value == value((intptr_t)key));
+     *last = (intptr_t)key;
+}
+
+static void test_random(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_btree_t *b = cad_new_btree(memory, int_compare);
+     char present[KEYS];
+     int round, i, k, from, to, removed, last;
+
+     memset(present, 0, sizeof(present));
+     assert(b->get(b, key(1)) == NULL);
+     assert(b->del(b, key(1)) == NULL);
+     assert(b->del_range(b, key(0), key(10), NULL, NULL) == 0);
+     check(b, present);
+     check_bounds(b, present, 0);
+
+     srand(42);
+     for (round = 0; round < 20; round++) {
+          for (i = 0; i < KEYS; i++) {
+               k = rand() % KEYS;
+               if (rand() % 3) {
+                    assert(b->set(b, key(k), value(k)) == (present[k] ? value(k) : NULL));
+                    present[k] = 1;
+               } else {
+                    assert(b->del(b, key(k)) == (present[k] ? value(k) : NULL));
+                    present[k] = 0;
+               }
+               assert(b->get(b, key(k)) == (present[k] ? value(k) : NULL));
+          }
+          check(b, present);
+          for (i = 0; i < 50; i++) {
+               check_bounds(b, present, rand() % KEYS);
+          }
+
+          from = rand() % KEYS;
+          to = from + rand() % (KEYS / (1 + round % 4));
+          removed = 0;
+          for (k = from; k < to && k < KEYS; k++) {
+               removed += present[k];
+               present[k] = 0;
+          }
+          last = from - 1;
+          assert(b->del_range(b, key(from), key(to), range_iterator, &last) == removed);
+          check(b, present);
+     }
+
+     for (k = KEYS / 2; k < KEYS; k++) {
+          present[k] = 0;
+     }
+     b->del_range(b, key(KEYS / 2), NULL, NULL, NULL);
+     check(b, present);
+     removed = 0;
+     for (k = 0; k < 100; k++) {
+          removed += present[k];
+          present[k] = 0;
+     }
+     assert(b->del_range(b, NULL, key(100), NULL, NULL) == removed);
+     check(b, present);
+
+     b->del_range(b, NULL, NULL, NULL, NULL);
+     memset(present, 0, sizeof(present));
+     check(b, present);
+     assert(b->set(b, key(7), value(7)) == NULL);
+     present[7] = 1;
+     check(b, present);
+
+     b->free(b);
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static void test_sequential(void) {
+     /* ascending and descending keys split and merge along the edges */
+     cad_btree_t *b = cad_new_btree(stdlib_memory, int_compare);
+     char present[KEYS];
+     int k;
+
+     memset(present, 0, sizeof(present));
+     for (k = 0; k < KEYS; k++) {
+          b->set(b, key(k), value(k));
+          present[k] = 1;
+     }
+     check(b, present);
+     for (k = KEYS - 1; k >= 0; k -= 2) {
+          assert(b->del(b, key(k)) == value(k));
+          present[k] = 0;
+     }
+     check(b, present);
+     for (k = 0; k < KEYS; k++) {
+          b->del(b, key(k));
+          present[k] = 0;
+     }
+     check(b, present);
+     for (k = KEYS - 1; k >= 0; k--) {
+          b->set(b, key(k), value(k));
+          present[k] = 1;
+     }
+     check(b, present);
+     b->free(b);
+}
+
+static void test_strings(void) {
+     cad_btree_t *b = cad_new_btree(stdlib_memory, (comparator_fn)strcmp);
+     const char *words[] = { "delta", "alpha", "echo", "charlie", "bravo", "foxtrot" };
+     cad_btree_cursor_t cursor;
+     char listed[64] = "";
+     int i, more;
+
+     for (i = 0; i < 6; i++) {
+          b->set(b, words[i], (void*)words[i]);
+     }
+     assert(b->get(b, "echo") == words[2]);
+     for (more = b->lower_bound(b, "b", &cursor); more && strcmp(cad_btree_key(&cursor), "d") < 0; more = cad_btree_next(&cursor)) {
+          strcat(listed, cad_btree_key(&cursor));
+          strcat(listed, " ");
+     }
+     assert(!strcmp(listed, "bravo charlie "));
+     assert(b->upper_bound(b, "foxtrot", &cursor) == 0);
+     assert(b->del_range(b, "b", "d", NULL, NULL) == 2);
+     assert(b->count(b) == 4);
+     assert(b->get(b, "bravo") == NULL);
+     b->free(b);
+}
+
+/* keys that remember being freed: the comparator must never see them again */
+typedef struct live_key {
+     int id;
+     int freed;
+} live_key_t;
+
+static int live_compare(const live_key_t *a, const live_key_t *b) {
+     assert(!a->freed && !b->freed);
+     return a->id < b->id ? -1 : a->id > b->id;
+}
+
+static void free_iterator(void *btree, int index, const void *key, void *value, void *data) {
+     ((live_key_t*)key)->freed = 1;
+}
+
+static void test_freed_keys(void) {
+     static live_key_t keys[KEYS];
+     cad_btree_t *b = cad_new_btree(stdlib_memory, (comparator_fn)live_compare);
+     live_key_t probe = { 0, 0 }, to = { 0, 0 };
+     cad_btree_cursor_t cursor;
+     int i;
+
+     for (i = 0; i < KEYS; i++) {
+          keys[i].id = i;
+          b->set(b, keys + i, keys + i);
+     }
+     /* removed keys are often separators of the inner nodes */
+     for (i = 0; i < KEYS; i += 8) {
+          assert(b->del(b, keys + i) == keys + i);
+          keys[i].freed = 1;
+     }
+     for (i = 0; i < KEYS; i++) {
+          probe.id = i;
+          assert(b->get(b, &probe) == (i % 8 ? keys + i : NULL));
+          assert(b->lower_bound(b, &probe, &cursor) == 1); /* KEYS - 1 is still there */
+     }
+     for (i = 100; i + 50 < KEYS; i += 200) {
+          probe.id = i;
+          to.id = i + 50;
+          b->del_range(b, &probe, &to, free_iterator, NULL);
+     }
+     for (i = 0; i < KEYS; i++) {
+          probe.id = i;
+          assert(b->get(b, &probe) == (keys[i].freed ? NULL : keys + i));
+     }
+     b->del_range(b, NULL, NULL, free_iterator, NULL);
+     assert(b->count(b) == 0);
+     b->free(b);
+}
+
+int main() {
+     test_random();
+     test_sequential();
+     test_strings();
+     test_freed_keys();
+     return 0;
+}
@@ -0,0 +1,289 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "cad_hamt.h"
+#include "cad_memory.h"
+
+#define key(i) ((const void*)(intptr_t)(i))
+
+static void test_versions(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_hamt_t *v0 = cad_new_hamt(memory, cad_hash_strings);
+     cad_hamt_t *v1, *v2, *v3, *v4;
+
+     assert(v0->count(v0) == 0);
+     assert(v0->get(v0, "a") == NULL);
+
+     v1 = v0->with(v0, "a", "A");
+     v2 = v1->with(v1, "b", "B");
+     v3 = v2->with(v2, "a", "AA");
+     v4 = v3->without(v3, "b");
+
+     assert(v0->count(v0) == 0);
+     assert(v1->count(v1) == 1 && v1->get(v1, "a") == (void*)"A" && v1->get(v1, "b") == NULL);
+     assert(v2->count(v2) == 2 && v2->get(v2, "a") == (void*)"A" && v2->get(v2, "b") == (void*)"B");
+     assert(v3->count(v3) == 2 && v3->get(v3, "a") == (void*)"AA" && v3->get(v3, "b") == (void*)"B");
+     assert(v4->count(v4) == 1 && v4->get(v4, "a") == (void*)"AA" && v4->get(v4, "b") == NULL);
+
+     /* versions are freed in any order */
+     v2->free(v2);
+     assert(v1->get(v1, "a") == (void*)"A");
+     assert(v3->get(v3, "b") == (void*)"B");
+     v0->free(v0);
+     v3->free(v3);
+     v1->free(v1);
+
+     v1 = v4->without(v4, "zz");
+     assert(v1->count(v1) == 1 && v1->get(v1, "a") == (void*)"AA");
+     v2 = v1->without(v1, "a");
+     assert(v2->count(v2) == 0 && v2->get(v2, "a") == NULL);
+     v3 = v2->without(v2, "a");
+     assert(v3->count(v3) == 0);
+     v1->free(v1);
+     v2->free(v2);
+     v3->free(v3);
+     v4->free(v4);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static void count_iterator(void *hamt, int index, const void *key, void *value, void *data) {
+     intptr_t *sum = data;
+     assert((intptr_t)value == (intptr_t)key + 1);
+     *sum += (intptr_t)key;
+}
+
+static void test_snapshots(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_hamt_t *h = cad_new_hamt(memory, cad_hash_ints), *next, *snapshot = NULL;
+     size_t before;
+     intptr_t i, sum = 0;
+
+     for (i = 0; i < 10000; i++) {
+          next = h->with(h, key(i), (void*)(i + 1));
+          assert(next != NULL);
+          h->free(h);
+          h = next;
+          if (i == 4999) {
+               /* a snapshot costs one handle, not a copy */
+               cad_counting_memory_stats(memory, &stats);
+               before = stats.allocations;
+               snapshot = h->snapshot(h);
+               cad_counting_memory_stats(memory, &stats);
+               assert(stats.allocations == before + 1);
+          }
+     }
+     assert(h->count(h) == 10000);
+     assert(snapshot->count(snapshot) == 5000);
+     for (i = 0; i < 10000; i++) {
+          assert(h->get(h, key(i)) == (void*)(i + 1));
+          assert(snapshot->get(snapshot, key(i)) == (i < 5000 ? (void*)(i + 1) : NULL));
+     }
+     h->iterate(h, count_iterator, &sum);
+     assert(sum == 10000 * 9999 / 2);
+     sum = 0;
+     snapshot->iterate(snapshot, count_iterator, &sum);
+     assert(sum == 5000 * 4999 / 2);
+
+     for (i = 0; i < 10000; i++) {
+          next = h->without(h, key(i));
+          assert(next != NULL);
+          h->free(h);
+          h = next;
+     }
+     assert(h->count(h) == 0);
+     assert(snapshot->count(snapshot) == 5000);
+     assert(snapshot->get(snapshot, key(4999)) == (void*)5000);
+     h->free(h);
+     snapshot->free(snapshot);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static unsigned int length_hash(const char *key) {
+     return strlen(key); /* a poor hash: many twins */
+}
+
+static void test_collisions(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_hash_keys_t keys = cad_hash_strings;
+     cad_hamt_t *h, *next, *old;
+     char key[32];
+     long i;
+
+     keys.hash = (cad_hash_keys_hash_fn)length_hash;
+     h = cad_new_hamt(memory, keys);
+     for (i = 0; i < 300; i++) {
+          sprintf(key, "k%ld", i);
+          next = h->with(h, key, (void*)(i + 1));
+          h->free(h);
+          h = next;
+     }
+     assert(h->count(h) == 300);
+     old = h->snapshot(h);
+     for (i = 0; i < 300; i++) {
+          sprintf(key, "k%ld", i);
+          assert(h->get(h, key) == (void*)(i + 1));
+     }
+     assert(h->get(h, "k300") == NULL);
+
+     /* empty the twins of one length, then of another, in a different order */
+     for (i = 299; i >= 0; i -= 2) {
+          sprintf(key, "k%ld", i);
+          next = h->without(h, key);
+          h->free(h);
+          h = next;
+     }
+     assert(h->count(h) == 150);
+     for (i = 0; i < 300; i++) {
+          sprintf(key, "k%ld", i);
+          assert(h->get(h, key) == (i % 2 ? NULL : (void*)(i + 1)));
+          assert(old->get(old, key) == (void*)(i + 1));
+     }
+     for (i = 0; i < 300; i += 2) {
+          sprintf(key, "k%ld", i);
+          next = h->without(h, key);
+          h->free(h);
+          h = next;
+     }
+     assert(h->count(h) == 0);
+     h->free(h);
+     old->free(old);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static void test_model(void) {
+     /* random operations on random versions, checked against plain arrays */
+     enum { VERSIONS = 8, KEYS = 2000 };
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_hamt_t *versions[VERSIONS], *next;
+     static intptr_t model[VERSIONS][KEYS];
+     unsigned int counts[VERSIONS];
+     int i, from, to, k, n;
+
+     srand(42);
+     for (i = 0; i < VERSIONS; i++) {
+          versions[i] = cad_new_hamt(memory, cad_hash_ints);
+          counts[i] = 0;
+     }
+     memset(model, 0, sizeof(model));
+     for (n = 0; n < 200000; n++) {
+          from = rand() % VERSIONS;
+          to = rand() % VERSIONS;
+          k = rand() % KEYS;
+          if (rand() % 3) {
+               next = versions[from]->with(versions[from], key(k), (void*)(intptr_t)(n + 1));
+          } else {
+               next = versions[from]->without(versions[from], key(k));
+          }
+          assert(next != NULL);
+          if (from != to) {
+               memcpy(model[to], model[from], sizeof(model[to]));
+          }
+          counts[to] = counts[from];
+          if (next->get(next, key(k)) != NULL) {
+               counts[to] += model[to][k] == 0;
+               model[to][k] = n + 1;
+          } else {
+               counts[to] -= model[to][k] != 0;
+               model[to][k] = 0;
+          }
+          versions[to]->free(versions[to]);
+          versions[to] = next;
+          assert(next->count(next) == counts[to]);
+          assert(next->get(next, key(k)) == (void*)model[to][k]);
+     }
+     for (i = 0; i < VERSIONS; i++) {
+          for (k = 0; k < KEYS; k++) {
+               assert(versions[i]->get(versions[i], key(k)) == (void*)model[i][k]);
+          }
+          versions[i]->free(versions[i]);
+     }
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+#define THREADS 4
+
+static void *reader(void *data) {
+     cad_hamt_t *snapshot = data;
+     unsigned int count = snapshot->count(snapshot);
+     intptr_t i;
+     for (i = 0; i < 100000; i++) {
+          assert(snapshot->get(snapshot, key(i % count)) == (void*)(i % count + 1));
+     }
+     snapshot->free(snapshot);
+     return NULL;
+}
+
+static void test_readers(void) {
+     cad_memory_t memory = cad_new_thread_cache_memory();
+     cad_hamt_t *h = cad_new_hamt(memory, cad_hash_ints), *next;
+     pthread_t threads[THREADS];
+     intptr_t i;
+     int t;
+
+     for (i = 0; i < 1000; i++) {
+          next = h->with(h, key(i), (void*)(i + 1));
+          h->free(h);
+          h = next;
+     }
+     for (t = 0; t < THREADS; t++) {
+          assert(0 == pthread_create(threads + t, NULL, reader, h->snapshot(h)));
+     }
+     /* the writer goes on while the readers use their snapshots */
+     for (i = 0; i < 1000; i++) {
+          next = h->without(h, key(i));
+          h->free(h);
+          h = next;
+     }
+     assert(h->count(h) == 0);
+     for (t = 0; t < THREADS; t++) {
+          pthread_join(threads[t], NULL);
+     }
+     h->free(h);
+     cad_free_memory(memory);
+}
+
+int main() {
+     test_versions();
+     test_snapshots();
+     test_collisions();
+     test_model();
+     test_readers();
+     return 0;
+}
@@ -14,11 +14,20 @@
   along with libCad.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "test.h"
 #include "cad_hash.h"
+#include "cad_memory.h"
 
 struct check_data {
      va_list data;
@@ -50,6 +59,762 @@ static void check_hash(cad_hash_t *h, int count, ...) {
      assert(count == data.index);
 }
 
+static void count_iterator(void *hash, int index, const void *key, void *value, int *count) {
+     assert(index == *count);
+     (*count)++;
+}
+
+static void test_many_in(cad_hash_t *h) {
+     char key[16];
+     int i;
+
+     assert(h->reserve(h, 1000) == 0);
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%d", i);
+          assert(h->set(h, key, (void*)(long)(i + 1)) == NULL);
+     }
+     assert(h->count(h) == 1000);
+     for (i = 0; i < 1000; i += 2) {
+          sprintf(key, "key%d", i);
+          assert(h->del(h, key) == (void*)(long)(i + 1));
+     }
+     assert(h->count(h) == 500);
+     assert(h->shrink_to_fit(h) == 0);
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%d", i);
+          assert(h->get(h, key) == (i % 2 ? (void*)(long)(i + 1) : NULL));
+     }
+     for (i = 0; i < 1000; i += 2) {
+          sprintf(key, "key%d", i);
+          assert(h->set(h, key, (void*)(long)(i + 1)) == NULL);
+     }
+     assert(h->count(h) == 1000);
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%d", i);
+          assert(h->get(h, key) == (void*)(long)(i + 1));
+     }
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%d", i);
+          h->del(h, key);
+     }
+     assert(h->shrink_to_fit(h) == 0);
+     assert(h->get(h, "key1") == NULL);
+     assert(h->set(h, "key1", key) == NULL);
+     assert(h->get(h, "key1") == key);
+
+     h->free(h);
+}
+
+static void test_many(cad_hash_keys_t keys) {
+     test_many_in(cad_new_hash(stdlib_memory, keys));
+}
+
+static void test_reserve_overflow(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings);
+     assert(h->reserve(h, UINT_MAX) == -1);
+     assert(h->reserve(h, UINT_MAX / 2) == -1);
+     assert(h->set(h, "key", (void*)1) == NULL);
+     assert(h->get(h, "key") == (void*)1);
+     h->free(h);
+}
+
+static void order_iterator(void *hash, int index, const void *key, void *value, long *last) {
+     assert((long)value > *last);
+     *last = (long)value;
+}
+
+/* values are insertion ranks: the iteration must see them in order */
+static void test_order(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings);
+     char key[16];
+     long i, last;
+
+     for (i = 0; i < 3000; i++) {
+          sprintf(key, "key%ld", i);
+          h->set(h, key, (void*)(i + 1));
+          if (i % 7 == 0) {
+               /* also while migrating */
+               last = 0;
+               h->iterate(h, (cad_hash_iterator_fn)order_iterator, &last);
+               assert(last == i + 1);
+          }
+     }
+     for (i = 0; i < 3000; i += 3) {
+          sprintf(key, "key%ld", i);
+          h->del(h, key);
+     }
+     for (i = 1; i < 3000; i += 3) {
+          /* replacing a value keeps the key's place */
+          sprintf(key, "key%ld", i);
+          assert(h->set(h, key, (void*)(i + 1)) == (void*)(i + 1));
+     }
+     for (i = 0; i < 3000; i += 3) {
+          sprintf(key, "key%ld", i);
+          h->set(h, key, (void*)(i + 3001));
+     }
+     last = 0;
+     h->iterate(h, (cad_hash_iterator_fn)order_iterator, &last);
+     assert(last == 3000 + 3000 - 2);
+     assert(h->shrink_to_fit(h) == 0);
+     last = 0;
+     h->iterate(h, (cad_hash_iterator_fn)order_iterator, &last);
+     assert(last == 3000 + 3000 - 2);
+
+     /* churn: the holes are squeezed out while migrating */
+     for (i = 0; i < 3000; i++) {
+          sprintf(key, "key%ld", i);
+          h->del(h, key);
+          sprintf(key, "new%ld", i);
+          h->set(h, key, (void*)(i + 6001));
+          if (i % 7 == 0) {
+               last = 0;
+               h->iterate(h, (cad_hash_iterator_fn)order_iterator, &last);
+               assert(last == i + 6001);
+          }
+     }
+     assert(h->count(h) == 3000);
+     h->free(h);
+}
+
+static void test_cursor_in(cad_hash_t *h) {
+     cad_hash_cursor_t cursor;
+     char key[32];
+     long i, n = 0;
+     int more;
+
+     assert(!h->first(h, &cursor));
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%ld", i);
+          h->set(h, key, (void*)(i + 1));
+     }
+     /* delete the odd values while walking */
+     for (more = h->first(h, &cursor); more; more = cad_hash_next(&cursor)) {
+          i = (long)cad_hash_value(&cursor) - 1;
+          sprintf(key, "key%ld", i);
+          assert(!strcmp(key, cad_hash_key(&cursor)));
+          if (i % 2) {
+               assert(cad_hash_del_current(&cursor) == (void*)(i + 1));
+          }
+          n++;
+     }
+     assert(n == 1000);
+     assert(h->count(h) == 500);
+     n = 0;
+     for (more = h->first(h, &cursor); more; more = cad_hash_next(&cursor)) {
+          assert((long)cad_hash_value(&cursor) % 2 == 1);
+          if (++n == 10) {
+               break;
+          }
+     }
+     assert(n == 10);
+     h->free(h);
+}
+
+static void test_cursor(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings);
+     cad_hash_cursor_t cursor;
+     long i, last = 0;
+     int more;
+     char key[32];
+
+     /* same order as iterate(), also while migrating */
+     for (i = 0; i < 100; i++) {
+          sprintf(key, "key%ld", i);
+          h->set(h, key, (void*)(i + 1));
+     }
+     for (more = h->first(h, &cursor); more; more = cad_hash_next(&cursor)) {
+          order_iterator(h, 0, cad_hash_key(&cursor), cad_hash_value(&cursor), &last);
+     }
+     assert(last == 100);
+     h->free(h);
+
+     test_cursor_in(cad_new_hash(stdlib_memory, cad_hash_strings));
+     test_cursor_in(cad_new_hash(stdlib_memory, cad_hash_packed_keys(cad_hash_strings_fast)));
+     test_cursor_in(cad_new_concurrent_hash(stdlib_memory, cad_hash_strings, 4));
+}
+
+static void test_batch_in(cad_hash_t *h) {
+     static char names[100][16];
+     const void *keys[100];
+     void *values[100], *old[100];
+     long i;
+
+     for (i = 0; i < 100; i++) {
+          sprintf(names[i], "key%ld", i);
+          keys[i] = names[i];
+          values[i] = (void*)(i + 1);
+     }
+     h->get_many(h, keys, 100, old);
+     for (i = 0; i < 100; i++) {
+          assert(old[i] == NULL);
+     }
+     h->set_many(h, keys, values, 50, NULL);
+     h->set_many(h, keys, values, 100, old);
+     for (i = 0; i < 100; i++) {
+          assert(old[i] == (i < 50 ? (void*)(i + 1) : NULL));
+     }
+     h->del(h, "key7");
+     h->get_many(h, keys, 100, old);
+     for (i = 0; i < 100; i++) {
+          assert(old[i] == (i == 7 ? NULL : (void*)(i + 1)));
+     }
+     h->free(h);
+}
+
+#define THREADS 4
+#define THREAD_KEYS 2000
+
+static cad_hash_t *shared;
+
+static void *concurrent_worker(void *arg) {
+     long id = (long)arg, i, round;
+     char key[32];
+     void *value;
+     for (round = 0; round < 10; round++) {
+          for (i = 0; i < THREAD_KEYS; i++) {
+               sprintf(key, "t%ld-%ld", id, i);
+               assert(shared->set(shared, key, (void*)(i + 1)) == (round == 0 ? NULL : (void*)(i + 1)));
+               /* shared keys: any thread may have set or deleted them */
+               sprintf(key, "s%ld", i % 100);
+               value = shared->get(shared, key);
+               assert(value == NULL || value == (void*)(i % 100 + 1));
+               if (i % 3 == 0) {
+                    shared->del(shared, key);
+               } else {
+                    shared->set(shared, key, (void*)(i % 100 + 1));
+               }
+          }
+          for (i = 0; i < THREAD_KEYS; i++) {
+               sprintf(key, "t%ld-%ld", id, i);
+               assert(shared->get(shared, key) == (void*)(i + 1));
+          }
+     }
+     for (i = 0; i < THREAD_KEYS; i++) {
+          sprintf(key, "t%ld-%ld", id, i);
+          assert(shared->del(shared, key) == (void*)(i + 1));
+     }
+     return NULL;
+}
+
+static void test_concurrent(void) {
+     pthread_t threads[THREADS];
+     long i;
+     int count = 0;
+
+     test_many_in(cad_new_concurrent_hash(stdlib_memory, cad_hash_strings, 4));
+     test_many_in(cad_new_concurrent_hash(stdlib_memory, cad_hash_packed_keys(cad_hash_strings_fast), 1));
+
+     shared = cad_new_concurrent_hash(stdlib_memory, cad_hash_strings_fast, 8);
+     for (i = 0; i < THREADS; i++) {
+          assert(0 == pthread_create(threads + i, NULL, concurrent_worker, (void*)i));
+     }
+     for (i = 0; i < THREADS; i++) {
+          pthread_join(threads[i], NULL);
+     }
+     shared->iterate(shared, (cad_hash_iterator_fn)count_iterator, &count);
+     assert(count == shared->count(shared));
+     assert(count <= 100);
+     count = 0;
+     shared->clean(shared, (cad_hash_iterator_fn)count_iterator, &count);
+     assert(shared->count(shared) == 0);
+     assert(shared->get(shared, "s1") == NULL);
+     shared->free(shared);
+}
+
+static void test_migration(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings);
+     char key[16];
+     int i, n;
+
+     /* check each step of the incremental migrations */
+     for (i = 0; i < 5000; i++) {
+          sprintf(key, "key%d", i);
+          h->set(h, key, (void*)(long)(i + 1));
+          if (i % 3 == 0) {
+               sprintf(key, "key%d", i / 2);
+               h->del(h, key);
+               h->set(h, key, (void*)(long)(i / 2 + 1));
+          }
+          assert(h->get(h, "key0") == (void*)1);
+          assert(h->get(h, key) != NULL);
+          assert(h->count(h) == i + 1);
+          if (i % 10 == 0) {
+               /* iterate() finishes the migration: not at each step */
+               n = 0;
+               h->iterate(h, (cad_hash_iterator_fn)count_iterator, &n);
+               assert(n == i + 1);
+          }
+     }
+     for (i = 0; i < 5000; i++) {
+          sprintf(key, "key%d", i);
+          assert(h->get(h, key) == (void*)(long)(i + 1));
+     }
+
+     h->free(h);
+}
+
+static void get_iterator(cad_hash_t *hash, int index, const void *key, void *value, int *count) {
+     /* get() would also move entries if the migration was not finished */
+     assert(hash->get(hash, key) == value);
+     assert(index == *count);
+     (*count)++;
+}
+
+static void test_iterate_get(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings);
+     char key[16];
+     int i, n;
+
+     for (i = 0; i < 3000; i++) {
+          sprintf(key, "key%d", i);
+          h->set(h, key, (void*)(long)(i + 1));
+          if (i % 7 == 0) {
+               n = 0;
+               h->iterate(h, (cad_hash_iterator_fn)get_iterator, &n);
+               assert(n == i + 1);
+          }
+     }
+     h->free(h);
+}
+
+static void test_borrowed(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_borrowed_keys(cad_hash_strings));
+     char foo1[] = "foo", foo2[] = "foo";
+     h->set(h, foo1, foo1);
+     check_hash(h, 1, foo1, foo1);
+     h->set(h, foo2, foo2);
+     check_hash(h, 1, foo2, foo2);
+     /* the latest key is kept */
+     foo1[0] = 'x';
+     assert(h->get(h, "foo") == foo2);
+     h->free(h);
+}
+
+static void test_packed(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_packed_keys(cad_hash_strings_fast));
+     char big[2048];
+     memset(big, 'x', sizeof(big) - 1);
+     big[sizeof(big) - 1] = 0;
+     h->set(h, "foo", (void*)1);
+     h->set(h, big, (void*)2);
+     h->set(h, "bar", (void*)3);
+     assert(h->get(h, big) == (void*)2);
+     h->del(h, "foo");
+     big[0] = 'y'; /* the key was copied */
+     assert(h->get(h, big) == NULL);
+     big[0] = 'x';
+     assert(h->shrink_to_fit(h) == 0);
+     assert(h->get(h, big) == (void*)2);
+     assert(h->get(h, "bar") == (void*)3);
+     check_hash(h, 2, big, (void*)2, "bar", (void*)3);
+     h->free(h);
+}
+
+static void test_frozen_in(cad_hash_keys_t keys, int n) {
+     cad_hash_t *source = cad_new_hash(stdlib_memory, keys);
+     cad_hash_t *h;
+     cad_hash_cursor_t cursor;
+     const void *many_keys[3];
+     void *values[3];
+     char key[32];
+     long i, sum = 0;
+     int more, count = 0;
+
+     for (i = 0; i < n; i++) {
+          sprintf(key, "key%ld", i);
+          source->set(source, key, (void*)(i + 1));
+     }
+     h = cad_new_frozen_hash(stdlib_memory, keys, source);
+     assert(h != NULL);
+     source->free(source); /* the keys were copied */
+
+     assert(h->count(h) == n);
+     for (i = 0; i < n; i++) {
+          sprintf(key, "key%ld", i);
+          assert(h->get(h, key) == (void*)(i + 1));
+     }
+     assert(h->get(h, "unknown") == NULL);
+     assert(h->get(h, "") == NULL);
+
+     for (more = h->first(h, &cursor); more; more = cad_hash_next(&cursor)) {
+          i = (long)cad_hash_value(&cursor) - 1;
+          sprintf(key, "key%ld", i);
+          assert(!strcmp(key, cad_hash_key(&cursor)));
+          sum += i + 1;
+     }
+     assert(sum == (long)n * (n + 1) / 2);
+     h->iterate(h, (cad_hash_iterator_fn)count_iterator, &count);
+     assert(count == n);
+
+     /* read-only */
+     assert(h->set(h, "key0", (void*)42) == NULL);
+     assert(h->set(h, "new", (void*)42) == NULL);
+     assert(h->del(h, "key0") == NULL);
+     assert(h->count(h) == n);
+     assert(h->get(h, "new") == NULL);
+     assert(h->reserve(h, n + 1) == -1);
+     assert(h->shrink_to_fit(h) == 0);
+
+     many_keys[0] = "key0";
+     many_keys[1] = "unknown";
+     many_keys[2] = n > 1 ? "key1" : "key0";
+     h->get_many(h, many_keys, 3, values);
+     assert(values[0] == (n > 0 ? (void*)1 : NULL));
+     assert(values[1] == NULL);
+     assert(values[2] == (n > 1 ? (void*)2 : values[0]));
+
+     h->free(h);
+}
+
+static unsigned int length_hash(const char *key) {
+     return strlen(key); /* a poor hash: many twins */
+}
+
+static void test_frozen_twins(void) {
+     cad_hash_keys_t keys = cad_hash_strings;
+     cad_hash_t *source, *h;
+     cad_hash_stats_t stats;
+     char key[32];
+     long i;
+     keys.hash = (cad_hash_keys_hash_fn)length_hash;
+     source = cad_new_hash(stdlib_memory, keys);
+     for (i = 0; i < 300; i++) {
+          sprintf(key, "k%ld", i);
+          source->set(source, key, (void*)(i + 1));
+     }
+     h = cad_new_frozen_hash(stdlib_memory, keys, source);
+     source->free(source);
+     assert(h->count(h) == 300);
+     for (i = 0; i < 300; i++) {
+          sprintf(key, "k%ld", i);
+          assert(h->get(h, key) == (void*)(i + 1));
+     }
+     assert(h->get(h, "k300") == NULL);
+     assert(h->get(h, "k-1") == NULL);
+     assert(h->get(h, "unknown") == NULL);
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.count == 300);
+     assert(stats.max_probe > 1);
+     h->free(h);
+}
+
+static void test_frozen(void) {
+     test_frozen_in(cad_hash_strings, 0);
+     test_frozen_in(cad_hash_strings, 1);
+     test_frozen_in(cad_hash_strings, 5);
+     test_frozen_in(cad_hash_strings, 10000);
+     test_frozen_in(cad_hash_packed_keys(cad_hash_strings_fast), 1000);
+     test_frozen_in(cad_hash_strings_siphash, 1000);
+     test_frozen_twins();
+}
+
+static void test_ints_in(cad_hash_t *h) {
+     cad_hash_cursor_t cursor;
+     long i, n = 0;
+     int more;
+
+     for (i = 0; i < 10000; i++) {
+          assert(h->set(h, (const void*)(intptr_t)i, (void*)(i + 1)) == NULL);
+     }
+     assert(h->count(h) == 10000);
+     assert(h->get(h, (const void*)(intptr_t)0) == (void*)1);
+     for (i = 0; i < 10000; i++) {
+          assert(h->get(h, (const void*)(intptr_t)i) == (void*)(i + 1));
+     }
+     assert(h->get(h, (const void*)(intptr_t)-1) == NULL);
+     assert(h->get(h, (const void*)(intptr_t)10000) == NULL);
+     for (i = 0; i < 10000; i += 2) {
+          assert(h->del(h, (const void*)(intptr_t)i) == (void*)(i + 1));
+     }
+     for (more = h->first(h, &cursor); more; more = cad_hash_next(&cursor)) {
+          i = (intptr_t)cad_hash_key(&cursor);
+          assert(i % 2 == 1);
+          assert(cad_hash_value(&cursor) == (void*)(i + 1));
+          n++;
+     }
+     assert(n == 5000);
+     h->free(h);
+}
+
+static void test_pointers(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_pointers);
+     char a[] = "foo", b[] = "foo";
+     h->set(h, a, (void*)1);
+     h->set(h, b, (void*)2);
+     /* compared by address, not by content */
+     assert(h->count(h) == 2);
+     assert(h->get(h, a) == (void*)1);
+     assert(h->get(h, b) == (void*)2);
+     assert(h->get(h, "foo") == NULL);
+     h->free(h);
+}
+
+static void test_hole_key(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_ints);
+     cad_hash_cursor_t cursor;
+     const void *hole;
+     intptr_t i;
+
+     assert(!memcmp(&cad_hash_pointers, &cad_hash_ints, sizeof(cad_hash_keys_t)));
+     h->set(h, (const void*)(intptr_t)1, (void*)1);
+     assert(h->first(h, &cursor));
+     hole = cursor.hole;
+     /* the key of the deleted entries is never stored */
+     assert(h->set(h, hole, (void*)2) == NULL);
+     assert(h->count(h) == 1);
+     assert(h->get(h, hole) == NULL);
+     for (i = 0; i < 100; i++) {
+          h->set(h, (const void*)(i + 2), (void*)(i + 2));
+     }
+     assert(h->set(h, hole, (void*)2) == NULL);
+     assert(h->count(h) == 101);
+     assert(h->get(h, hole) == NULL);
+     h->free(h);
+}
+
+static size_t value_size(const char *value) {
+     return strlen(value) + 1;
+}
+
+static void test_mapped(void) {
+     char path[] = "/tmp/test_hash.XXXXXX";
+     cad_hash_t *source = cad_new_hash(stdlib_memory, cad_hash_strings);
+     cad_hash_t *frozen, *h;
+     cad_hash_cursor_t cursor;
+     const void *many_keys[2] = { "key7", "unknown" };
+     void *values[2];
+     char key[32];
+     long i, sum = 0;
+     int fd, more;
+     struct stat st;
+
+     fd = mkstemp(path);
+     assert(fd >= 0);
+     close(fd);
+
+     /* raw values */
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%ld", i);
+          source->set(source, key, (void*)(i + 1));
+     }
+     assert(cad_hash_write_mapped(source, cad_hash_strings, NULL, path) == 0);
+     assert(stat(path, &st) == 0);
+     assert((st.st_mode & 0777) == 0644);
+     h = cad_new_mapped_hash(stdlib_memory, cad_hash_strings, path);
+     assert(h != NULL);
+     assert(h->count(h) == 1000);
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%ld", i);
+          assert(h->get(h, key) == (void*)(i + 1));
+     }
+     assert(h->get(h, "unknown") == NULL);
+     for (more = h->first(h, &cursor); more; more = cad_hash_next(&cursor)) {
+          i = (long)cad_hash_value(&cursor) - 1;
+          sprintf(key, "key%ld", i);
+          assert(!strcmp(key, cad_hash_key(&cursor)));
+          sum += i + 1;
+     }
+     assert(sum == 1000 * 1001 / 2);
+     h->get_many(h, many_keys, 2, values);
+     assert(values[0] == (void*)8);
+     assert(values[1] == NULL);
+     assert(h->set(h, "key0", (void*)42) == NULL);
+     assert(h->get(h, "key0") == (void*)1);
+     h->free(h);
+
+     /* values copied in the file, written from a frozen table */
+     source->free(source);
+     source = cad_new_hash(stdlib_memory, cad_hash_strings);
+     source->set(source, "text/html", "html");
+     source->set(source, "image/png", "png");
+     frozen = cad_new_frozen_hash(stdlib_memory, cad_hash_strings, source);
+     assert(cad_hash_write_mapped(frozen, cad_hash_strings, (cad_hash_value_size_fn)value_size, path) == 0);
+     frozen->free(frozen);
+     h = cad_new_mapped_hash(stdlib_memory, cad_hash_strings, path);
+     assert(h != NULL);
+     assert(h->count(h) == 2);
+     assert(!strcmp(h->get(h, "text/html"), "html"));
+     assert(!strcmp(h->get(h, "image/png"), "png"));
+     assert(h->get(h, "text/plain") == NULL);
+     h->free(h);
+
+     /* empty */
+     source->free(source);
+     source = cad_new_hash(stdlib_memory, cad_hash_strings);
+     assert(cad_hash_write_mapped(source, cad_hash_strings, NULL, path) == 0);
+     h = cad_new_mapped_hash(stdlib_memory, cad_hash_strings, path);
+     assert(h != NULL);
+     assert(h->count(h) == 0);
+     assert(h->get(h, "key0") == NULL);
+     assert(!h->first(h, &cursor));
+     h->free(h);
+
+     /* corrupted slots: offsets out of the file, or into the header */
+     source->free(source);
+     source = cad_new_hash(stdlib_memory, cad_hash_strings);
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "key%ld", i);
+          source->set(source, key, (void*)(i + 1));
+     }
+     for (i = 0; i < 2; i++) {
+          assert(cad_hash_write_mapped(source, cad_hash_strings, NULL, path) == 0);
+          /* the slots of 1000 keys span from about 1 KB to 25 KB */
+          memset(key, i ? 0xff : 0, sizeof(key));
+          fd = open(path, O_WRONLY);
+          assert(pwrite(fd, key, sizeof(key), 4096) == sizeof(key));
+          close(fd);
+          assert(cad_new_mapped_hash(stdlib_memory, cad_hash_strings, path) == NULL);
+     }
+
+     /* not a mapped hash file */
+     fd = open(path, O_WRONLY | O_TRUNC);
+     assert(write(fd, "garbage", 7) == 7);
+     close(fd);
+     assert(cad_new_mapped_hash(stdlib_memory, cad_hash_strings, path) == NULL);
+     unlink(path);
+     assert(cad_new_mapped_hash(stdlib_memory, cad_hash_strings, path) == NULL);
+
+     source->free(source);
+}
+
+static void check_stats(cad_hash_t *h, unsigned int count) {
+     cad_hash_stats_t stats;
+     unsigned int i, n = 0;
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.count == count);
+     assert(stats.capacity >= count);
+     assert(stats.load_factor <= 1);
+     for (i = 0; i < CAD_HASH_PROBES; i++) {
+          n += stats.probes[i];
+     }
+     assert(n == count);
+     if (count > 0) {
+          assert(stats.average_probe >= 1);
+          assert(stats.max_probe >= 1);
+          assert(stats.average_probe <= stats.max_probe);
+     }
+}
+
+static void test_stats(void) {
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_strings);
+     cad_hash_t *frozen;
+     cad_hash_stats_t stats;
+     char key[32];
+     long i;
+
+     check_stats(h, 0);
+     for (i = 0; i < 10000; i++) {
+          sprintf(key, "key%ld", i);
+          h->set(h, key, (void*)(i + 1));
+     }
+     check_stats(h, 10000);
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.grows > 0);
+     assert(stats.rehashes == 0);
+     assert(stats.load_factor == 10000.0 / stats.capacity);
+
+     for (i = 0; i < 9000; i++) {
+          sprintf(key, "key%ld", i);
+          h->del(h, key);
+     }
+     assert(h->shrink_to_fit(h) == 0);
+     check_stats(h, 1000);
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.rehashes > 0);
+
+     frozen = cad_new_frozen_hash(stdlib_memory, cad_hash_strings, h);
+     assert(frozen->stats(frozen, &stats) == 0);
+     assert(stats.capacity == 1000);
+     assert(stats.max_probe == 1);
+     assert(stats.probes[0] == 1000);
+     frozen->free(frozen);
+     h->free(h);
+
+     h = cad_new_concurrent_hash(stdlib_memory, cad_hash_strings, 4);
+     for (i = 0; i < 10000; i++) {
+          sprintf(key, "key%ld", i);
+          h->set(h, key, (void*)(i + 1));
+     }
+     check_stats(h, 10000);
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.grows > 0);
+     h->free(h);
+}
+
+static void test_small(void) {
+     cad_memory_t counting = cad_new_counting_memory(stdlib_memory);
+     cad_hash_t *h = cad_new_hash(counting, cad_hash_ints);
+     cad_memory_stats_t memory_stats;
+     cad_hash_stats_t stats;
+     long i;
+
+     /* up to 8 keys: no allocation besides the hash table itself */
+     for (i = 0; i < 8; i++) {
+          h->set(h, (const void*)(intptr_t)i, (void*)(i + 1));
+     }
+     assert(cad_counting_memory_stats(counting, &memory_stats) == 0);
+     assert(memory_stats.allocations == 1);
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.capacity == 8);
+     assert(stats.grows == 0);
+     check_stats(h, 8);
+
+     /* churn below the limit stays small */
+     for (i = 0; i < 100; i++) {
+          assert(h->del(h, (const void*)(intptr_t)(i % 8)) == (void*)(i % 8 + 1));
+          h->set(h, (const void*)(intptr_t)(i % 8), (void*)(i % 8 + 1));
+     }
+     for (i = 0; i < 5; i++) {
+          h->del(h, (const void*)(intptr_t)i);
+     }
+     for (i = 100; i < 104; i++) {
+          h->set(h, (const void*)(intptr_t)i, (void*)(i + 1));
+     }
+     assert(cad_counting_memory_stats(counting, &memory_stats) == 0);
+     assert(memory_stats.allocations == 1);
+     assert(h->count(h) == 7);
+
+     /* then it gets an index */
+     for (i = 8; i < 20; i++) {
+          h->set(h, (const void*)(intptr_t)i, (void*)(i + 1));
+     }
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.capacity > 8);
+     assert(stats.grows > 0);
+     for (i = 5; i < 20; i++) {
+          assert(h->get(h, (const void*)(intptr_t)i) == (void*)(i + 1));
+     }
+
+     /* and gives it back when shrunk */
+     for (i = 8; i < 20; i++) {
+          h->del(h, (const void*)(intptr_t)i);
+     }
+     assert(h->shrink_to_fit(h) == 0);
+     assert(h->stats(h, &stats) == 0);
+     assert(stats.capacity == 8);
+     assert(cad_counting_memory_stats(counting, &memory_stats) == 0);
+     for (i = 5; i < 8; i++) {
+          assert(h->get(h, (const void*)(intptr_t)i) == (void*)(i + 1));
+     }
+     for (i = 100; i < 104; i++) {
+          assert(h->get(h, (const void*)(intptr_t)i) == (void*)(i + 1));
+     }
+     assert(h->get(h, (const void*)(intptr_t)8) == NULL);
+     check_stats(h, 7);
+
+     h->free(h);
+     assert(cad_counting_memory_stats(counting, &memory_stats) == 0);
+     assert(memory_stats.live_bytes == 0);
+     cad_free_memory(counting);
+}
+
+static void test_siphash(void) {
+     /* reference vector: empty message, key 00 01 .. 0f */
+     static const unsigned long long key[2] = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL };
+     assert(cad_hash_strings_siphash.salted_hash("", key) == (0x726fdb47U ^ 0xdd0e0e31U));
+     assert(cad_hash_strings_siphash.salted_hash("foo", key) != cad_hash_strings_siphash.hash("foo"));
+}
+
 int main() {
      set_hash_salt(test_salt);
 
@@ -98,5 +863,29 @@ int main() {
      h->del(h, "bar");
      assert(h->count(h) == 0);
 
+     test_many(cad_hash_strings);
+     test_many(cad_hash_strings_fast);
+     test_many(cad_hash_strings_siphash);
+     test_many(cad_hash_packed_keys(cad_hash_strings_fast));
+     test_reserve_overflow();
+     test_siphash();
+     test_ints_in(cad_new_hash(stdlib_memory, cad_hash_ints));
+     test_ints_in(cad_new_concurrent_hash(stdlib_memory, cad_hash_ints, 4));
+     test_pointers();
+     test_hole_key();
+     test_frozen();
+     test_mapped();
+     test_stats();
+     test_small();
+     test_borrowed();
+     test_packed();
+     test_migration();
+     test_iterate_get();
+     test_order();
+     test_cursor();
+     test_batch_in(cad_new_hash(stdlib_memory, cad_hash_strings));
+     test_batch_in(cad_new_concurrent_hash(stdlib_memory, cad_hash_strings, 4));
+     test_concurrent();
+
      return 0;
 }
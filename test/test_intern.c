@@ -0,0 +1,68 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "cad_intern.h"
+
+int main() {
+     cad_intern_t *intern = cad_new_intern(stdlib_memory);
+     cad_hash_t *h = cad_new_hash(stdlib_memory, cad_hash_atoms);
+     char foo[] = "foo", big[2048], key[16];
+     const char *atom_foo, *atom_bar, *atom_big;
+     int i;
+
+     assert(intern->count(intern) == 0);
+     assert(intern->lookup(intern, "foo") == NULL);
+
+     atom_foo = intern->intern(intern, foo);
+     assert(atom_foo != foo);
+     assert(!strcmp(atom_foo, "foo"));
+     assert(intern->intern(intern, "foo") == atom_foo);
+     assert(intern->lookup(intern, "foo") == atom_foo);
+     foo[0] = 'x';
+     assert(!strcmp(atom_foo, "foo"));
+
+     atom_bar = intern->intern(intern, "bar");
+     assert(atom_bar != atom_foo);
+     assert(intern->count(intern) == 2);
+
+     memset(big, 'x', sizeof(big) - 1);
+     big[sizeof(big) - 1] = 0;
+     atom_big = intern->intern(intern, big);
+     assert(!strcmp(atom_big, big));
+     assert(intern->intern(intern, "foo") == atom_foo);
+
+     h->set(h, atom_foo, (void*)1);
+     h->set(h, atom_bar, (void*)2);
+     assert(h->get(h, intern->lookup(intern, "foo")) == (void*)1);
+     assert(h->get(h, intern->lookup(intern, "bar")) == (void*)2);
+     assert(h->get(h, atom_big) == NULL);
+
+     for (i = 0; i < 1000; i++) {
+          sprintf(key, "atom%d", i);
+          assert(!strcmp(intern->intern(intern, key), key));
+     }
+     assert(intern->count(intern) == 1003);
+     assert(intern->lookup(intern, "atom999") == intern->intern(intern, "atom999"));
+     assert(intern->lookup(intern, "foo") == atom_foo);
+
+     h->free(h);
+     intern->free(intern);
+     return 0;
+}
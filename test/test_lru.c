@@ -0,0 +1,181 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "cad_lru.h"
+#include "cad_memory.h"
+
+#define key(i) ((const void*)(intptr_t)(i))
+
+typedef struct evicted {
+     intptr_t keys[16];
+     int count;
+} evicted_t;
+
+static void record(void *lru, const void *key, void *value, void *data) {
+     evicted_t *evicted = data;
+     assert(value == key || (intptr_t)value == (intptr_t)key + 100);
+     evicted->keys[evicted->count++ % 16] = (intptr_t)key;
+}
+
+static void test_entries(void) {
+     evicted_t evicted = { {0}, 0 };
+     cad_lru_t *lru = cad_new_lru(stdlib_memory, cad_hash_ints, 3, record, &evicted);
+     cad_lru_stats_t stats;
+
+     assert(lru->get(lru, key(1)) == NULL);
+     assert(lru->put(lru, key(1), (void*)key(1), 1) == 0);
+     assert(lru->put(lru, key(2), (void*)key(2), 1) == 0);
+     assert(lru->put(lru, key(3), (void*)key(3), 1) == 0);
+     assert(lru->count(lru) == 3);
+     assert(evicted.count == 0);
+
+     /* 1 becomes the most recently used: 2 goes first */
+     assert(lru->get(lru, key(1)) == key(1));
+     assert(lru->put(lru, key(4), (void*)key(4), 1) == 0);
+     assert(evicted.count == 1 && evicted.keys[0] == 2);
+     assert(lru->get(lru, key(2)) == NULL);
+     assert(lru->put(lru, key(5), (void*)key(5), 1) == 0);
+     assert(evicted.count == 2 && evicted.keys[1] == 3);
+     assert(lru->count(lru) == 3);
+
+     /* refreshing a value tells nothing: the evict function may free it */
+     assert(lru->put(lru, key(1), (void*)key(1), 1) == 0);
+     assert(evicted.count == 2);
+     /* replacing a value tells the old one */
+     assert(lru->put(lru, key(1), (void*)key(101), 1) == 0);
+     assert(evicted.count == 3 && evicted.keys[2] == 1);
+     assert(lru->count(lru) == 3);
+
+     assert(lru->del(lru, key(4)) == key(4));
+     assert(lru->del(lru, key(4)) == NULL);
+     assert(evicted.count == 3);
+     assert(lru->count(lru) == 2);
+
+     lru->stats(lru, &stats);
+     assert(stats.capacity == 3);
+     assert(stats.size == 2);
+     assert(stats.count == 2);
+     assert(stats.hits == 1);
+     assert(stats.misses == 2);
+     assert(stats.evictions == 2);
+
+     assert(lru->put(lru, key(6), (void*)key(6), 4) == -1);
+     lru->clean(lru);
+     assert(evicted.count == 5);
+     assert(lru->count(lru) == 0);
+     assert(lru->get(lru, key(5)) == NULL);
+     lru->free(lru);
+}
+
+static void test_bytes(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_lru_t *lru = cad_new_lru(memory, cad_hash_packed_keys(cad_hash_strings), 100, NULL, NULL);
+     char key[16];
+     int i;
+
+     strcpy(key, "big");
+     assert(lru->put(lru, key, "big", 60) == 0);
+     key[0] = 'x';
+     assert(lru->get(lru, "big") != NULL);
+     assert(lru->put(lru, "small", "small", 30) == 0);
+     assert(lru->count(lru) == 2);
+     /* growing a value evicts the others, not itself */
+     assert(lru->put(lru, "small", "small", 50) == 0);
+     assert(lru->count(lru) == 1);
+     assert(lru->get(lru, "big") == NULL);
+     assert(!strcmp(lru->get(lru, "small"), "small"));
+     for (i = 0; i < 1000; i++) {
+          snprintf(key, sizeof(key), "%d", i);
+          assert(lru->put(lru, key, "x", 10) == 0);
+     }
+     assert(lru->count(lru) == 10);
+     assert(lru->get(lru, "989") == NULL);
+     assert(lru->get(lru, "990") != NULL);
+     assert(lru->get(lru, "999") != NULL);
+     lru->free(lru);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static const char *failing_clone(const char *key) {
+     return key[0] == '!' ? NULL : strdup(key);
+}
+
+static void test_failed_put(void) {
+     evicted_t evicted = { {0}, 0 };
+     cad_hash_keys_t keys = cad_hash_strings;
+     cad_lru_t *lru;
+
+     keys.clone = (cad_hash_keys_clone_fn)failing_clone;
+     lru = cad_new_lru(stdlib_memory, keys, 2, NULL, &evicted);
+     assert(lru->put(lru, "a", "a", 1) == 0);
+     assert(lru->put(lru, "b", "b", 1) == 0);
+     /* the key cannot be cloned: the cache is left as it was */
+     assert(lru->put(lru, "!c", "!c", 1) == -1);
+     assert(lru->count(lru) == 2);
+     assert(lru->get(lru, "a") != NULL);
+     assert(lru->get(lru, "b") != NULL);
+     assert(lru->put(lru, "c", "c", 1) == 0);
+     assert(lru->count(lru) == 2);
+     assert(lru->get(lru, "a") == NULL);
+     lru->free(lru);
+}
+
+static void test_no_allocation(void) {
+     /* once full, a cache of integer keys reuses its entries: no allocation per access */
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_lru_t *lru = cad_new_lru(memory, cad_hash_ints, 1000, NULL, NULL);
+     size_t allocations;
+     intptr_t i;
+
+     for (i = 0; i < 2000; i++) {
+          lru->put(lru, key(i), (void*)key(i), 1);
+     }
+     cad_counting_memory_stats(memory, &stats);
+     allocations = stats.allocations + stats.reallocations;
+     for (i = 2000; i < 100000; i++) {
+          assert(lru->get(lru, key(i - 500)) == key(i - 500));
+          assert(lru->get(lru, key(i + 100000)) == NULL);
+          assert(lru->put(lru, key(i), (void*)key(i), 1) == 0);
+     }
+     assert(lru->count(lru) == 1000);
+     cad_counting_memory_stats(memory, &stats);
+     /* only the index allocates, once in a while, to squeeze the deleted keys out */
+     assert(stats.allocations + stats.reallocations - allocations < 98000 / 1000);
+     lru->free(lru);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+int main() {
+     test_entries();
+     test_bytes();
+     test_failed_put();
+     test_no_allocation();
+     return 0;
+}
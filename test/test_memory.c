@@ -0,0 +1,282 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+#include "cad_memory.h"
+#include "cad_array.h"
+#include "cad_hash.h"
+#include "cad_stream.h"
+
+static cad_memory_t thread_memory;
+
+static void test_arena(void) {
+     cad_memory_t arena = cad_new_arena_memory(256);
+     char *a, *b, *c, *string;
+     cad_hash_t *h;
+     cad_output_stream_t *out;
+
+     assert(arena.malloc != NULL);
+
+     a = arena.malloc(10);
+     assert(a != NULL);
+     assert(((uintptr_t)a & 15) == 0);
+     strcpy(a, "foo");
+
+     b = arena.malloc(10);
+     assert(b != NULL && b != a);
+     strcpy(b, "bar");
+
+     c = arena.realloc(b, 100);
+     assert(c == b); /* last block grown in place */
+     assert(!strcmp(c, "bar"));
+
+     c = arena.realloc(a, 20);
+     assert(c != a); /* not the last block: moved */
+     assert(!strcmp(c, "foo"));
+
+     a = arena.malloc(1000); /* bigger than a chunk */
+     assert(a != NULL);
+     memset(a, 'x', 1000);
+
+     arena.free(a);
+     assert(cad_reset_memory(arena) == 0);
+
+     h = cad_new_hash(arena, cad_hash_strings);
+     h->set(h, "foo", "bar");
+     assert(!strcmp(h->get(h, "foo"), "bar"));
+
+     out = new_cad_output_stream_from_string(&string, arena);
+     out->put(out, "%s=%d", "answer", 42);
+     assert(!strcmp(string, "answer=42"));
+     out->free(out);
+
+     h->free(h);
+     cad_free_memory(arena);
+
+     assert(cad_reset_memory(stdlib_memory) == -1);
+     cad_free_memory(stdlib_memory);
+}
+
+static void test_pool(void) {
+     cad_memory_t pool = cad_new_pool_memory();
+     cad_pool_memory_stats_t stats;
+     char *a, *b, *big;
+     void *many[1000];
+     int i;
+
+     assert(pool.malloc != NULL);
+
+     a = pool.malloc(10);
+     b = pool.malloc(16);
+     assert(a != NULL && b != NULL && a != b);
+     assert(((uintptr_t)a & 15) == 0);
+     strcpy(a, "foo");
+
+     assert(cad_pool_memory_stats(pool, &stats) == 0);
+     assert(stats.classes[0].block_size == 16);
+     assert(stats.classes[0].used == 2);
+     assert(stats.classes[0].slabs == 1);
+
+     a = pool.realloc(a, 200);
+     assert(!strcmp(a, "foo"));
+     assert(cad_pool_memory_stats(pool, &stats) == 0);
+     assert(stats.classes[0].used == 1);
+
+     big = pool.malloc(5000);
+     memset(big, 'x', 5000);
+     assert(cad_pool_memory_stats(pool, &stats) == 0);
+     assert(stats.big_count == 1 && stats.big_bytes == 5000);
+     pool.free(big);
+
+     for (i = 0; i < 1000; i++) {
+          many[i] = pool.malloc(32);
+          memset(many[i], i & 0xff, 32);
+     }
+     assert(cad_pool_memory_stats(pool, &stats) == 0);
+     assert(stats.classes[1].used == 1000);
+     assert(stats.classes[1].slabs > 1);
+     for (i = 0; i < 1000; i++) {
+          pool.free(many[i]);
+     }
+     assert(cad_pool_memory_stats(pool, &stats) == 0);
+     assert(stats.classes[1].used == 0);
+     assert(stats.classes[1].peak == 1000);
+     assert(stats.classes[1].slabs == 1);
+     assert(stats.big_count == 0);
+
+     pool.free(a);
+     pool.free(b);
+     cad_free_memory(pool);
+
+     assert(cad_pool_memory_stats(stdlib_memory, &stats) == -1);
+}
+
+static void test_counting(void) {
+     cad_memory_t counting = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_output_stream_t *out;
+     char *a, *b, *report;
+     int i;
+
+     assert(counting.malloc != NULL);
+
+     a = counting.malloc(10);
+     b = counting.malloc(100);
+     assert(cad_counting_memory_stats(counting, &stats) == 0);
+     assert(stats.live_bytes == 110);
+     assert(stats.peak_bytes == 110);
+     assert(stats.allocations == 2);
+     assert(stats.histogram[0] == 1);
+     assert(stats.histogram[3] == 1);
+
+     strcpy(a, "foo");
+     a = counting.realloc(a, 1000);
+     assert(!strcmp(a, "foo"));
+     counting.free(b);
+     assert(cad_counting_memory_stats(counting, &stats) == 0);
+     assert(stats.live_bytes == 1000);
+     assert(stats.peak_bytes == 1100);
+     assert(stats.reallocations == 1);
+     assert(stats.frees == 1);
+
+     counting.free(a);
+     assert(cad_counting_memory_stats(counting, &stats) == 0);
+     assert(stats.live_bytes == 0);
+
+     out = new_cad_output_stream_from_string(&report, stdlib_memory);
+     assert(cad_counting_memory_report(counting, out) == 0);
+     assert(strstr(report, "peak bytes:    1100\n") != NULL);
+     out->free(out);
+     free(report);
+
+     /* aligned blocks stay aligned when they move */
+     a = cad_memory_ex(counting)->aligned_malloc(cad_memory_ex(counting), 256, 100);
+     strcpy(a, "foo");
+     for (i = 1; i <= 10; i++) {
+          b = counting.malloc(10); /* keeps the block from growing in place */
+          a = counting.realloc(a, 100 << i);
+          assert(((uintptr_t)a & 255) == 0);
+          assert(!strcmp(a, "foo"));
+          counting.free(b);
+     }
+     counting.free(a);
+     assert(cad_counting_memory_stats(counting, &stats) == 0);
+     assert(stats.live_bytes == 0);
+     assert(stats.reallocations == 11);
+
+     cad_free_memory(counting);
+
+     assert(cad_counting_memory_stats(stdlib_memory, &stats) == -1);
+}
+
+static void check_ex(cad_memory_t memory) {
+     cad_memory_ex_t *ex = cad_memory_ex(memory);
+     char *a;
+
+     assert(ex != NULL);
+
+     a = memory.malloc(20);
+     assert(ex->usable_size(ex, a) >= 20);
+     strcpy(a, "foo");
+     a = ex->realloc_sized(ex, a, 20, 2000);
+     assert(ex->usable_size(ex, a) >= 2000);
+     assert(!strcmp(a, "foo"));
+     ex->free_sized(ex, a, 2000);
+
+     a = ex->aligned_malloc(ex, 256, 100);
+     assert(a != NULL);
+     assert(((uintptr_t)a & 255) == 0);
+     memset(a, 'x', 100);
+     memory.free(a);
+}
+
+static void test_ex(void) {
+     cad_memory_t arena = cad_new_arena_memory(0);
+     cad_memory_t pool = cad_new_pool_memory();
+     cad_memory_t counting = cad_new_counting_memory(pool);
+     cad_memory_stats_t stats;
+     cad_array_t *array;
+     int i;
+
+     check_ex(stdlib_memory);
+     check_ex(arena);
+     check_ex(pool);
+     check_ex(counting);
+
+     array = cad_new_array(counting, sizeof(int));
+     for (i = 0; i < 100; i++) {
+          array->insert(array, i, &i);
+     }
+     for (i = 0; i < 100; i++) {
+          assert(*(int*)array->get(array, i) == i);
+     }
+     array->free(array);
+     assert(cad_counting_memory_stats(counting, &stats) == 0);
+     assert(stats.live_bytes == 0);
+
+     cad_free_memory(counting);
+     cad_free_memory(pool);
+     cad_free_memory(arena);
+}
+
+static void *free_all(void **blocks) {
+     int i;
+     for (i = 0; blocks[i] != NULL; i++) {
+          thread_memory.free(blocks[i]);
+     }
+     return NULL;
+}
+
+static void test_thread_cache(void) {
+     void *blocks[1001];
+     pthread_t thread;
+     char *a;
+     int i;
+
+     thread_memory = cad_new_thread_cache_memory();
+     assert(thread_memory.malloc != NULL);
+
+     for (i = 0; i < 1000; i++) {
+          blocks[i] = thread_memory.malloc(i);
+          memset(blocks[i], 'x', i);
+     }
+     blocks[1000] = NULL;
+     assert(pthread_create(&thread, NULL, (void *(*)(void *))free_all, blocks) == 0);
+     pthread_join(thread, NULL);
+
+     /* freed blocks are given back by the other thread */
+     a = thread_memory.malloc(10);
+     assert(a != NULL);
+     strcpy(a, "foo");
+     a = thread_memory.realloc(a, 2000);
+     assert(!strcmp(a, "foo"));
+     thread_memory.free(a);
+
+     cad_free_memory(thread_memory);
+}
+
+int main() {
+     test_arena();
+     test_pool();
+     test_counting();
+     test_ex();
+     test_thread_cache();
+     return 0;
+}
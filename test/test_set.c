@@ -0,0 +1,238 @@
+/*
+  This file is part of libCad.
+
+  libCad is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  libCad is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libCad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "cad_set.h"
+#include "cad_memory.h"
+
+#define MANY 5000
+
+static void count_iterator(void *set, int index, const void *key, void *data) {
+     int *count = data;
+     assert(index == *count);
+     (*count)++;
+}
+
+static int iterated(cad_set_t *s) {
+     int result = 0;
+     s->iterate(s, count_iterator, &result);
+     return result;
+}
+
+static cad_set_t *new_numbers(cad_memory_t memory, int from, int to) {
+     cad_set_t *result = cad_new_set(memory, cad_hash_strings);
+     char key[16];
+     int i;
+     for (i = from; i < to; i++) {
+          snprintf(key, sizeof(key), "%d", i);
+          assert(result->add(result, key) == 1);
+     }
+     return result;
+}
+
+static int has_number(cad_set_t *s, int i) {
+     char key[16];
+     snprintf(key, sizeof(key), "%d", i);
+     return s->contains(s, key);
+}
+
+static void test_basic(void) {
+     cad_set_t *s = cad_new_set(stdlib_memory, cad_hash_strings);
+     char key[16];
+     int i;
+
+     assert(s->count(s) == 0);
+     assert(!s->contains(s, "foo"));
+     assert(s->remove(s, "foo") == 0);
+     assert(iterated(s) == 0);
+
+     strcpy(key, "foo");
+     assert(s->add(s, key) == 1);
+     key[0] = 'x';
+     assert(s->contains(s, "foo"));
+     assert(!s->contains(s, key));
+     assert(s->add(s, "foo") == 0);
+     assert(s->count(s) == 1);
+     assert(s->remove(s, "foo") == 1);
+     assert(s->remove(s, "foo") == 0);
+     assert(!s->contains(s, "foo"));
+     assert(s->count(s) == 0);
+
+     for (i = 0; i < MANY; i++) {
+          snprintf(key, sizeof(key), "%d", i);
+          assert(s->add(s, key) == 1);
+     }
+     assert(s->count(s) == MANY);
+     assert(iterated(s) == MANY);
+     for (i = 0; i < MANY; i += 2) {
+          snprintf(key, sizeof(key), "%d", i);
+          assert(s->remove(s, key) == 1);
+     }
+     assert(s->count(s) == MANY / 2);
+     for (i = 0; i < MANY; i++) {
+          assert(has_number(s, i) == (i % 2));
+     }
+
+     s->clean(s);
+     assert(s->count(s) == 0);
+     assert(!has_number(s, 1));
+     assert(s->add(s, "bar") == 1);
+     assert(s->contains(s, "bar"));
+     s->free(s);
+}
+
+static void test_churn(void) {
+     /* adding and removing keys must not grow the set forever */
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_set_t *s = cad_new_set(memory, cad_hash_ints);
+     size_t live;
+     intptr_t i;
+
+     assert(s->reserve(s, 100) == 0);
+     cad_counting_memory_stats(memory, &stats);
+     live = stats.live_bytes;
+     for (i = 0; i < 100000; i++) {
+          assert(s->add(s, (void*)i) == 1);
+          assert(s->contains(s, (void*)i));
+          if (i >= 50) {
+               assert(s->remove(s, (void*)(i - 50)) == 1);
+          }
+     }
+     assert(s->count(s) == 50);
+     assert(!s->contains(s, (void*)0));
+     assert(s->contains(s, NULL) == 0);
+     assert(s->add(s, NULL) == 1);
+     assert(s->contains(s, NULL));
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == live);
+     s->free(s);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static void key_iterator(void *set, int index, const void *key, void *data) {
+     *(const void **)data = key;
+}
+
+static void test_key_modes(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_set_t *packed = cad_new_set(memory, cad_hash_packed_keys(cad_hash_strings));
+     cad_set_t *borrowed = cad_new_set(memory, cad_hash_borrowed_keys(cad_hash_strings));
+     char key[16];
+     const void *stored = NULL;
+
+     strcpy(key, "foo");
+     assert(packed->add(packed, key) == 1);
+     assert(borrowed->add(borrowed, key) == 1);
+     borrowed->iterate(borrowed, key_iterator, &stored);
+     assert(stored == key);
+     packed->iterate(packed, key_iterator, &stored);
+     assert(stored != key);
+     key[0] = 'x';
+     assert(packed->contains(packed, "foo"));
+     assert(!packed->contains(packed, "xoo"));
+     assert(packed->remove(packed, "foo") == 1);
+     assert(packed->add(packed, "bar") == 1);
+     packed->free(packed);
+     borrowed->free(borrowed);
+
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+static void test_algebra(void) {
+     cad_memory_t memory = cad_new_counting_memory(stdlib_memory);
+     cad_memory_stats_t stats;
+     cad_set_t *a = new_numbers(memory, 0, 1000);
+     cad_set_t *b = new_numbers(memory, 500, 2000);
+     cad_set_t *empty = cad_new_set(memory, cad_hash_strings);
+     cad_set_t *u, *i, *d, *dd, *e;
+     size_t allocations;
+     int n;
+
+     cad_counting_memory_stats(memory, &stats);
+     allocations = stats.allocations;
+     u = a->unite(a, b);
+     cad_counting_memory_stats(memory, &stats);
+     /* the set, its table, and the cloned keys (strdup does not use the memory manager) */
+     assert(stats.allocations == allocations + 2);
+
+     i = a->intersect(a, b);
+     d = a->difference(a, b);
+     assert(u->count(u) == 2000);
+     assert(i->count(i) == 500);
+     assert(d->count(d) == 500);
+     for (n = 0; n < 2000; n++) {
+          assert(has_number(u, n));
+          assert(has_number(i, n) == (n >= 500 && n < 1000));
+          assert(has_number(d, n) == (n < 500));
+     }
+
+     /* results share the salt of their target: no hash is computed again */
+     dd = u->difference(u, d);
+     assert(dd->count(dd) == 1500);
+     assert(!has_number(dd, 499));
+     assert(has_number(dd, 500));
+     dd->free(dd);
+     dd = i->intersect(i, a);
+     assert(dd->count(dd) == 500);
+     dd->free(dd);
+
+     e = a->intersect(a, empty);
+     assert(e->count(e) == 0);
+     e->free(e);
+     e = empty->unite(empty, b);
+     assert(e->count(e) == 1500);
+     assert(has_number(e, 1999));
+     e->free(e);
+     e = a->difference(a, empty);
+     assert(e->count(e) == 1000);
+     assert(e->add(e, "foo") == 1);
+     assert(e->count(e) == 1001);
+     e->free(e);
+     e = empty->difference(empty, a);
+     assert(e->count(e) == 0);
+     assert(!has_number(e, 0));
+     e->free(e);
+
+     u->free(u);
+     i->free(i);
+     d->free(d);
+     a->free(a);
+     b->free(b);
+     empty->free(empty);
+     cad_counting_memory_stats(memory, &stats);
+     assert(stats.live_bytes == 0);
+     cad_free_memory(memory);
+}
+
+int main() {
+     test_basic();
+     test_churn();
+     test_key_modes();
+     test_algebra();
+     return 0;
+}